@@ -3,16 +3,18 @@
 use alloc::boxed::Box;
 use alloc::format;
 use alloc::string::String;
+use alloc::vec;
 use alloc::vec::Vec;
 use core::ffi::{c_char, c_int, CStr};
 use core::mem;
 #[cfg(not(feature = "std"))]
 use num_traits::FromPrimitive;
-use sqlite_nostd::{sqlite3, Connection, ResultCode, StrRef};
+use sqlite_nostd::{sqlite3, ColumnType, Connection, ResultCode};
 
+use crate::backfill::fill_column;
 use crate::c::crsql_ExtData;
-use crate::db_version::fill_db_version_if_needed;
-use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+use crate::create_crr::create_crr_without_backfill;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, pk_is_rowid_alias, TableInfo};
 
 #[no_mangle]
 pub unsafe extern "C" fn crsql_compact_post_alter(
@@ -33,11 +35,6 @@ unsafe fn compact_post_alter(
     errmsg: *mut *mut c_char,
 ) -> Result<ResultCode, ResultCode> {
     let tbl_name_str = CStr::from_ptr(tbl_name).to_str()?;
-    fill_db_version_if_needed(db, ext_data).or_else(|msg| {
-        errmsg.set(&msg);
-        Err(ResultCode::ERROR)
-    })?;
-    let current_db_version = (*ext_data).dbVersion;
 
     // If primary key columns change (in the schema)
     // We need to drop, re-create and backfill
@@ -46,53 +43,23 @@ unsafe fn compact_post_alter(
     // of all rows.
     // We can determine this by comparing unique index on lookaside table vs
     // pks on source table
-    let stmt = db.prepare_v2(&format!(
-        "SELECT count(name) FROM (
-        SELECT name FROM pragma_table_info('{table_name}')
-          WHERE pk > 0 AND name NOT IN
-            (SELECT name FROM pragma_index_info('{table_name}__crsql_pks_pks'))
-          UNION SELECT name FROM pragma_index_info('{table_name}__crsql_pks_pks') WHERE name NOT IN 
-            (SELECT name FROM pragma_table_info('{table_name}') WHERE pk > 0) AND name != 'col_name'
-        );",
-        table_name = crate::util::escape_ident_as_value(tbl_name_str),
-    ))?;
-    stmt.step()?;
-
-    let pk_diff = stmt.column_int(0);
-    // immediately drop stmt, otherwise clock table is considered locked.
-    drop(stmt);
-
-    if pk_diff > 0 {
+    if pk_changed(db, tbl_name_str)? {
         // drop the clock table so we can re-create it
         db.exec_safe(&format!(
             "DROP TABLE \"{table_name}__crsql_clock\";
-             DROP TABLE \"{table_name}__crsql_pks\";",
+             DROP TABLE IF EXISTS \"{table_name}__crsql_pks\";
+             DROP TABLE \"{table_name}__crsql_cols\";",
             table_name = crate::util::escape_ident(tbl_name_str),
         ))?;
     } else {
         // clock table is still relevant but needs compacting
         // in case columns were removed during the migration
 
-        // First delete entries that no longer have a column
-        let sql = format!(
-            "DELETE FROM \"{tbl_name_ident}__crsql_clock\" WHERE \"col_name\" NOT IN (
-              SELECT name FROM pragma_table_info('{tbl_name_val}') UNION SELECT '{cl_sentinel}'
-            )",
-            tbl_name_ident = crate::util::escape_ident(tbl_name_str),
-            tbl_name_val = crate::util::escape_ident_as_value(tbl_name_str),
-            cl_sentinel = crate::c::DELETE_SENTINEL,
-        );
-        db.exec_safe(&sql)?;
+        // First delete entries that no longer have a column.
+        drop_clocks_of_removed_columns(db, tbl_name_str)?;
 
         // Next delete entries that no longer have a row but keeping tombstones
         // TODO: if we move the sentinel metadata to the lookaside this becomes much simpler
-        let mut sql = String::from(
-            format!(
-              "DELETE FROM \"{tbl_name}__crsql_clock\" WHERE (col_name != '-1' OR (col_name = '-1' AND col_version % 2 != 0))
-              AND NOT EXISTS (SELECT 1 FROM \"{tbl_name}\" JOIN \"{tbl_name}__crsql_pks\" ON ",
-              tbl_name = crate::util::escape_ident(tbl_name_str),
-            ),
-        );
         let c_rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, errmsg);
         if c_rc != ResultCode::OK as c_int {
             if let Some(rc) = ResultCode::from_i32(c_rc) {
@@ -109,41 +76,156 @@ unsafe fn compact_post_alter(
         // TODO: safe since we checked above but make more idiomatic
         let table_info = table_info.unwrap();
 
-        // for each pk col, append \"%w\".\"%w\" = \"%w__crsql_pks\".\"%w\"
-        // to the where clause then close the statement.
-        for (i, col) in table_info.pks.iter().enumerate() {
-            if i > 0 {
-                sql.push_str(" AND ");
-            }
+        let (key, key_join) = table_info.key_of_row("t", "k");
+        db.exec_safe(&format!(
+            "DELETE FROM \"{tbl_name}__crsql_clock\" WHERE (col_id != -1 OR (col_id = -1 AND col_version % 2 != 0))
+              AND NOT EXISTS (SELECT 1 FROM \"{tbl_name}\" AS t {key_join}
+                WHERE {key} = \"{tbl_name}__crsql_clock\".key LIMIT 1)",
+            tbl_name = crate::util::escape_ident(tbl_name_str),
+        ))?;
 
-            sql.push_str(&format!(
-                "\"{tbl_name}\".\"{col_name}\" = \"{tbl_name}__crsql_pks\".\"{col_name}\"",
+        if !table_info.key_is_pk {
+            // now delete pk lookasides that no longer map to anything in the clock tables
+            let sql = format!(
+                "DELETE FROM \"{tbl_name}__crsql_pks\" WHERE __crsql_key NOT IN (
+            SELECT key FROM \"{tbl_name}__crsql_clock\"
+          )",
                 tbl_name = crate::util::escape_ident(tbl_name_str),
-                col_name = &col.name,
-            ));
+            );
+            db.exec_safe(&sql)?;
         }
-        sql.push_str(
-          &format!(
-            " WHERE \"{tbl_name}__crsql_clock\".key = \"{tbl_name}__crsql_pks\".__crsql_key LIMIT 1)",
-            tbl_name = crate::util::escape_ident(tbl_name_str)
-          )
-        );
-        db.exec_safe(&sql)?;
-
-        // now delete pk lookasides that no longer map to anything in the clock tables
-        let sql = format!(
-            "DELETE FROM \"{tbl_name}__crsql_pks\" WHERE __crsql_key NOT IN (
-        SELECT key FROM \"{tbl_name}__crsql_clock\"
-      )",
-            tbl_name = crate::util::escape_ident(tbl_name_str),
-        );
-        db.exec_safe(&sql)?;
     }
 
-    let stmt = db.prepare_v2(
-        "INSERT OR REPLACE INTO crsql_master (key, value) VALUES ('pre_compact_dbversion', ?)",
+    Ok(ResultCode::OK)
+}
+
+fn pk_changed(db: *mut sqlite3, tbl_name: &str) -> Result<bool, ResultCode> {
+    let stmt =
+        db.prepare_v2("SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?")?;
+    stmt.bind_text(
+        1,
+        &format!("{tbl_name}__crsql_pks"),
+        sqlite_nostd::Destructor::TRANSIENT,
     )?;
-    stmt.bind_int64(1, current_db_version)?;
     stmt.step()?;
-    Ok(ResultCode::OK)
+    if stmt.column_int(0) == 0 {
+        // Clocks are keyed by the pk. Any rowid alias keeps the keys valid, even if renamed.
+        return Ok(!pk_is_rowid_alias(db, tbl_name)?);
+    }
+    drop(stmt);
+
+    let stmt = db.prepare_v2(&format!(
+        "SELECT count(name) FROM (
+        SELECT name FROM pragma_table_info('{table_name}')
+          WHERE pk > 0 AND name NOT IN
+            (SELECT name FROM pragma_index_info('{table_name}__crsql_pks_pks'))
+          UNION SELECT name FROM pragma_index_info('{table_name}__crsql_pks_pks') WHERE name NOT IN 
+            (SELECT name FROM pragma_table_info('{table_name}') WHERE pk > 0) AND name != 'col_name'
+        );",
+        table_name = crate::util::escape_ident_as_value(tbl_name),
+    ))?;
+    stmt.step()?;
+    Ok(stmt.column_int(0) > 0)
+}
+
+/**
+ * Forgets the columns the alter removed, renamed columns included, along with
+ * their clocks. Ids of surviving columns are kept so existing clock rows stay
+ * valid.
+ */
+fn drop_clocks_of_removed_columns(db: *mut sqlite3, tbl_name: &str) -> Result<(), ResultCode> {
+    let stmt = db.prepare_v2(&format!(
+        "SELECT group_concat(col_id) FROM \"{tbl_name_ident}__crsql_cols\"
+          WHERE col_id != {sentinel_id} AND col_name NOT IN (
+            SELECT name FROM pragma_table_info('{tbl_name_val}')
+          )",
+        tbl_name_ident = crate::util::escape_ident(tbl_name),
+        tbl_name_val = crate::util::escape_ident_as_value(tbl_name),
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+    ))?;
+    stmt.step()?;
+    if stmt.column_type(0)? == ColumnType::Null {
+        // No column was removed. Spare the scan of the clock table.
+        return Ok(());
+    }
+    let removed_col_ids = String::from(stmt.column_text(0)?);
+    // immediately drop stmt, otherwise the cols table is considered locked.
+    drop(stmt);
+
+    db.exec_safe(&format!(
+        "DELETE FROM \"{tbl_name_ident}__crsql_cols\" WHERE col_id IN ({removed_col_ids});
+        DELETE FROM \"{tbl_name_ident}__crsql_clock\" WHERE col_id IN ({removed_col_ids})",
+        tbl_name_ident = crate::util::escape_ident(tbl_name),
+    ))?;
+    Ok(())
+}
+
+/**
+ * Whether rows of any table may have been written since `crsql_begin_alter`.
+ * Such writes went untracked since the crr triggers were down.
+ *
+ * DDL, e.g. `ALTER TABLE`, does not count towards `total_changes()`. Inserts,
+ * updates and deletes, including the copy of a 12 step alter, do.
+ */
+unsafe fn rows_written_during_alter(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<bool, ResultCode> {
+    let total_changes_at_begin = (*ext_data).totalChangesAtBeginAlter;
+    // Every commit starts over. Nested alters keep the earliest count.
+    (*ext_data).totalChangesAtBeginAlter = -1;
+    if total_changes_at_begin < 0 {
+        return Ok(true);
+    }
+    Ok(total_changes(db)? != total_changes_at_begin)
+}
+
+pub fn total_changes(db: *mut sqlite3) -> Result<i64, ResultCode> {
+    let stmt = db.prepare_v2("SELECT total_changes()")?;
+    stmt.step()?;
+    Ok(stmt.column_int64(0))
+}
+
+/**
+ * Commits an alter that left the rows and the primary key of `tbl_name` as
+ * they were, which covers adding, dropping and renaming columns. Only the
+ * clocks of removed columns are dropped and only added columns are backfilled.
+ *
+ * Returns false, having changed nothing, if the alter needs the full compaction
+ * and backfill instead.
+ */
+pub unsafe fn commit_column_alter(
+    db: *mut sqlite3,
+    tbl_name: &str,
+    ext_data: *mut crsql_ExtData,
+    errmsg: *mut *mut c_char,
+) -> Result<bool, ResultCode> {
+    if rows_written_during_alter(db, ext_data)? || pk_changed(db, tbl_name)? {
+        return Ok(false);
+    }
+    let stmt = db.prepare_v2(&format!(
+        "SELECT col_name FROM \"{tbl_name_ident}__crsql_cols\" WHERE col_id != {sentinel_id}",
+        tbl_name_ident = crate::util::escape_ident(tbl_name),
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+    ))?;
+    let mut prior_cols = vec![];
+    while stmt.step()? == ResultCode::ROW {
+        prior_cols.push(String::from(stmt.column_text(0)?));
+    }
+    drop(stmt);
+
+    drop_clocks_of_removed_columns(db, tbl_name)?;
+
+    let table_info = match create_crr_without_backfill(db, tbl_name, errmsg)? {
+        Some(table_info) => table_info,
+        // crsql_begin_alter was never called. The triggers are still in place.
+        None => return Ok(true),
+    };
+    for col in table_info.non_pks.iter() {
+        if !prior_cols.contains(&col.name) {
+            fill_column(db, &table_info, col, true, None)?;
+        }
+    }
+
+    Ok(true)
 }
@@ -1,8 +1,8 @@
 extern crate alloc;
 
-// nit: use vecs rather than btreesets. Likely never enough elements
-// for a btreeset to perform better.
-use alloc::collections::BTreeSet;
+// nit: use vecs rather than btreemaps. Likely never enough elements
+// for a btreemap to perform better.
+use alloc::collections::BTreeMap;
 use alloc::format;
 use alloc::string::String;
 use alloc::string::ToString;
@@ -16,8 +16,11 @@ use sqlite::{args, sqlite3, ManagedConnection, Value};
 use sqlite::{strlit, Context};
 use sqlite::{Connection, ResultCode};
 
-static IS_UNIQUE_IDX_SQL: &str = "SELECT \"unique\" FROM pragma_index_list(?) WHERE name = ?";
-static IDX_COLS_SQL: &str = "SELECT name FROM pragma_index_info(?) ORDER BY seqno ASC";
+static USER_TABLES_WHERE: &str = "m.type = 'table'
+        AND m.name NOT LIKE 'sqlite_%'
+        AND m.name NOT LIKE 'crsql_%'
+        AND m.name NOT LIKE '__crsql_%'
+        AND m.name NOT LIKE '%__crsql_%'";
 
 /**
 * Automigrate args:
@@ -66,6 +69,13 @@ fn automigrate_impl(
     };
     let local_db = ctx.db_handle();
     let desired_schema = args[0].text();
+
+    let fingerprint = schema_fingerprint(local_db, desired_schema)?;
+    if read_applied_fingerprint(local_db)?.as_ref() == Some(&fingerprint) {
+        // Nothing changed since this schema was last applied.
+        return Ok(ResultCode::OK);
+    }
+
     let stripped_schema = strip_crr_statements(desired_schema);
 
     let result = sqlite::open(strlit!(":memory:"));
@@ -95,6 +105,14 @@ fn automigrate_impl(
         if !desired_schema.is_empty() {
             local_db.exec_safe(desired_schema)?;
         }
+        // The schema version moved with the migration.
+        let fingerprint = schema_fingerprint(local_db, desired_schema)?;
+        let stmt = local_db.prepare_v2(
+            "INSERT OR REPLACE INTO crsql_master (key, value) VALUES ('automigrate_fingerprint', ?)",
+        )?;
+        stmt.bind_text(1, &fingerprint, sqlite::Destructor::STATIC)?;
+        stmt.step()?;
+        drop(stmt);
         local_db.exec_safe("RELEASE automigrate_tables")
     } else {
         ctx.result_error("could not open the temporary migration db");
@@ -103,40 +121,134 @@ fn automigrate_impl(
     }
 }
 
+/**
+* The schema last applied by automigrate, normalized, along with the schema
+* version of the database right after. The schema version changes with any
+* change to the schema, made by automigrate or not. If neither changed, there is
+* nothing to migrate.
+*/
+fn schema_fingerprint(local_db: *mut sqlite3, desired_schema: &str) -> Result<String, ResultCode> {
+    let stmt = local_db.prepare_v2("PRAGMA schema_version")?;
+    stmt.step()?;
+    let mut fingerprint = stmt.column_int64(0).to_string();
+    for token in desired_schema.split_whitespace() {
+        fingerprint.push(' ');
+        fingerprint.push_str(token);
+    }
+    Ok(fingerprint)
+}
+
+fn read_applied_fingerprint(local_db: *mut sqlite3) -> Result<Option<String>, ResultCode> {
+    let stmt = local_db
+        .prepare_v2("SELECT value FROM crsql_master WHERE key = 'automigrate_fingerprint'")?;
+    if stmt.step()? == ResultCode::ROW {
+        Ok(Some(stmt.column_text(0)?.to_string()))
+    } else {
+        Ok(None)
+    }
+}
+
+struct ColumnDef {
+    name: String,
+    col_type: String,
+    notnull: bool,
+    dflt_value: Option<String>,
+    pk: bool,
+}
+
+#[derive(PartialEq)]
+struct IndexDef {
+    unique: bool,
+    // Column names in index order. Empty for expressions.
+    columns: Vec<String>,
+}
+
+/**
+* The user tables of a database with their columns and indices, read in a
+* couple of catalog queries rather than a round of pragmas per table and index.
+*/
+struct Catalog {
+    tables: BTreeMap<String, Vec<ColumnDef>>,
+    // indices, other than the primary key's, by table then by name
+    indices: BTreeMap<String, BTreeMap<String, IndexDef>>,
+}
+
+impl Catalog {
+    fn read<C: Connection>(db: &C) -> Result<Catalog, ResultCode> {
+        let mut tables: BTreeMap<String, Vec<ColumnDef>> = BTreeMap::new();
+        let stmt = db.prepare_v2(&format!(
+            "SELECT m.name, p.name, p.type, p.\"notnull\", p.dflt_value, p.pk
+              FROM sqlite_master AS m, pragma_table_info(m.name) AS p
+              WHERE {USER_TABLES_WHERE} ORDER BY m.name, p.cid"
+        ))?;
+        while stmt.step()? == ResultCode::ROW {
+            let dflt_value = if stmt.column_type(4)? == ColumnType::Null {
+                None
+            } else {
+                Some(stmt.column_text(4)?.to_string())
+            };
+            tables
+                .entry(stmt.column_text(0)?.to_string())
+                .or_insert_with(Vec::new)
+                .push(ColumnDef {
+                    name: stmt.column_text(1)?.to_string(),
+                    col_type: stmt.column_text(2)?.to_string(),
+                    notnull: stmt.column_int(3) == 1,
+                    dflt_value,
+                    pk: stmt.column_int(5) > 0,
+                });
+        }
+
+        // We do not pull PK indices because we do not support alterations that changes
+        // primary key definitions.
+        // User would need to perform a manual migration for that.
+        // This is due to the fact that SQLite itself does not support changing primary key
+        // definitions in alter table statements.
+        let mut indices: BTreeMap<String, BTreeMap<String, IndexDef>> = BTreeMap::new();
+        let stmt = db.prepare_v2(&format!(
+            "SELECT m.name, il.name, il.\"unique\", ii.name
+              FROM sqlite_master AS m, pragma_index_list(m.name) AS il
+              LEFT JOIN pragma_index_info(il.name) AS ii
+              WHERE {USER_TABLES_WHERE} AND il.origin != 'pk'
+              ORDER BY m.name, il.name, ii.seqno"
+        ))?;
+        while stmt.step()? == ResultCode::ROW {
+            let idx = indices
+                .entry(stmt.column_text(0)?.to_string())
+                .or_insert_with(BTreeMap::new)
+                .entry(stmt.column_text(1)?.to_string())
+                .or_insert_with(|| IndexDef {
+                    unique: stmt.column_int(2) == 1,
+                    columns: vec![],
+                });
+            if stmt.column_type(3)? != ColumnType::Null {
+                idx.columns.push(stmt.column_text(3)?.to_string());
+            }
+        }
+
+        Ok(Catalog { tables, indices })
+    }
+}
+
 fn migrate_to(
     local_db: *mut sqlite3,
     mem_db: &ManagedConnection,
 ) -> Result<ResultCode, ResultCode> {
-    // TODO: why not HashSet?
-    let mut mem_tables: BTreeSet<String> = BTreeSet::new();
-
-    let sql = "SELECT name FROM sqlite_master WHERE type = 'table'
-        AND name NOT LIKE 'sqlite_%'
-        AND name NOT LIKE 'crsql_%'
-        AND name NOT LIKE '__crsql_%'
-        AND name NOT LIKE '%__crsql_%'";
-    let fetch_mem_tables = mem_db.prepare_v2(sql)?;
-    let fetch_local_tables = local_db.prepare_v2(sql)?;
-
-    while fetch_mem_tables.step()? == ResultCode::ROW {
-        mem_tables.insert(fetch_mem_tables.column_text(0)?.to_string());
-    }
+    let local = Catalog::read(&local_db)?;
+    let mem = Catalog::read(mem_db)?;
 
     let mut removed_tables: Vec<String> = vec![];
-    let mut maybe_modified_tables: Vec<String> = vec![];
-
-    while fetch_local_tables.step()? == ResultCode::ROW {
-        let table_name = fetch_local_tables.column_text(0)?;
-        if mem_tables.contains(table_name) {
-            maybe_modified_tables.push(table_name.to_string());
-        } else {
-            removed_tables.push(table_name.to_string());
+    for table in local.tables.keys() {
+        if !mem.tables.contains_key(table) {
+            removed_tables.push(table.to_string());
         }
     }
 
     drop_tables(local_db, removed_tables)?;
-    for table in maybe_modified_tables {
-        maybe_modify_table(local_db, &table, &mem_db)?;
+    for table in local.tables.keys() {
+        if mem.tables.contains_key(table) {
+            maybe_modify_table(local_db, table, &local, &mem)?;
+        }
     }
     // no add tables. Schema file application will add tables.
     Ok(ResultCode::OK)
@@ -181,36 +293,37 @@ fn drop_tables(local_db: *mut sqlite3, tables: Vec<String>) -> Result<ResultCode
 fn maybe_modify_table(
     local_db: *mut sqlite3,
     table: &str,
-    mem_db: &ManagedConnection,
+    local: &Catalog,
+    mem: &Catalog,
 ) -> Result<ResultCode, ResultCode> {
-    let mut local_columns = BTreeSet::new();
-    let mut mem_columns = BTreeSet::new();
-
-    let sql = "SELECT name FROM pragma_table_info(?)";
-    let local_stmt = local_db.prepare_v2(sql)?;
-    let mem_stmt = mem_db.prepare_v2(sql)?;
-    local_stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
-    mem_stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
-
-    while mem_stmt.step()? == ResultCode::ROW {
-        mem_columns.insert(mem_stmt.column_text(0)?.to_string());
-    }
-
-    let mut removed_columns: Vec<String> = vec![];
-    let mut added_columns: Vec<String> = vec![];
-
-    while local_stmt.step()? == ResultCode::ROW {
-        let col_name = local_stmt.column_text(0)?;
-        local_columns.insert(col_name.to_string());
-        if !mem_columns.contains(col_name) {
-            removed_columns.push(col_name.to_string());
-        }
-    }
-
-    for mem_col in mem_columns {
-        if !local_columns.contains(&mem_col) {
-            added_columns.push(mem_col);
-        }
+    let no_columns = vec![];
+    let local_columns = local.tables.get(table).unwrap_or(&no_columns);
+    let mem_columns = mem.tables.get(table).unwrap_or(&no_columns);
+
+    let removed_columns = local_columns
+        .iter()
+        .filter(|c| !mem_columns.iter().any(|m| m.name == c.name))
+        .map(|c| c.name.to_string())
+        .collect::<Vec<_>>();
+    let added_columns = mem_columns
+        .iter()
+        .filter(|m| !local_columns.iter().any(|c| c.name == m.name))
+        .collect::<Vec<_>>();
+
+    let no_indices = BTreeMap::new();
+    let local_indices = local.indices.get(table).unwrap_or(&no_indices);
+    let mem_indices = mem.indices.get(table).unwrap_or(&no_indices);
+    // SQLite does not support alter index statements.
+    // Indices that are gone or have a new definition are dropped.
+    // Schema file application adds them back.
+    let changed_indices = local_indices
+        .iter()
+        .filter(|(name, def)| mem_indices.get(*name) != Some(def))
+        .map(|(name, _)| name.to_string())
+        .collect::<Vec<_>>();
+
+    if removed_columns.is_empty() && added_columns.is_empty() {
+        return drop_indices(local_db, &changed_indices);
     }
 
     let is_a_crr = crate::is_crr(local_db, table)?;
@@ -221,8 +334,8 @@ fn maybe_modify_table(
     }
 
     drop_columns(local_db, table, removed_columns)?;
-    add_columns(local_db, table, added_columns, mem_db)?;
-    maybe_update_indices(local_db, table, mem_db)?;
+    add_columns(local_db, table, added_columns)?;
+    drop_indices(local_db, &changed_indices)?;
 
     if is_a_crr {
         let stmt = local_db.prepare_v2("SELECT crsql_commit_alter(?)")?;
@@ -256,43 +369,15 @@ fn drop_columns(
 fn add_columns(
     local_db: *mut sqlite3,
     table: &str,
-    columns: Vec<String>,
-    mem_db: &ManagedConnection,
+    columns: Vec<&ColumnDef>,
 ) -> Result<ResultCode, ResultCode> {
-    if columns.is_empty() {
-        return Ok(ResultCode::OK);
-    }
-    let sql = format!(
-        "SELECT name, type, \"notnull\", dflt_value, pk FROM pragma_table_info(?) WHERE name IN ({qs})",
-        qs = columns.iter().map(|_| "?").collect::<Vec<_>>().join(", "),
-    );
-    let stmt = mem_db.prepare_v2(&sql)?;
-    stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
-    let mut b = 2;
-    for col in &columns {
-        stmt.bind_text(b, &col, sqlite::Destructor::STATIC)?;
-        b += 1;
-    }
-
-    let mut processed_cols = 0;
-    while stmt.step()? == ResultCode::ROW {
-        let is_pk = stmt.column_int(4) == 1;
-
-        if is_pk {
+    for col in columns {
+        if col.pk {
             // We do not support adding PK columns to existing tables in auto-migration
             return Err(ResultCode::MISUSE);
         }
 
-        let name = stmt.column_text(0)?;
-        let col_type = stmt.column_text(1)?;
-        let notnull = stmt.column_int(2) == 1;
-        let dflt_val = stmt.column_value(3)?;
-
-        add_column(local_db, table, name, col_type, notnull, dflt_val)?;
-        processed_cols += 1;
-    }
-    if processed_cols != columns.len() {
-        return Err(ResultCode::ERROR_MISSING_COLLSEQ);
+        add_column(local_db, table, col)?;
     }
 
     Ok(ResultCode::OK)
@@ -301,76 +386,26 @@ fn add_columns(
 fn add_column(
     local_db: *mut sqlite3,
     table: &str,
-    name: &str,
-    col_type: &str,
-    notnull: bool,
-    dflt_val: *mut sqlite::value,
+    col: &ColumnDef,
 ) -> Result<ResultCode, ResultCode> {
     // ideally we'd extract out the SQL for the specific column
     // so we can get all constraints
     // as it is now, we don't support many things in auto-migration
-    let dflt_val_str = if dflt_val.value_type() == ColumnType::Null {
-        String::from("")
-    } else {
-        format!("DEFAULT {}", dflt_val.text())
+    let dflt_val_str = match &col.dflt_value {
+        Some(dflt) => format!("DEFAULT {}", dflt),
+        None => String::from(""),
     };
 
     local_db.exec_safe(&format!(
         "ALTER TABLE \"{table}\" ADD COLUMN \"{name}\" {col_type} {notnull} {dflt}",
         table = crate::util::escape_ident(table),
-        name = crate::util::escape_ident(name),
-        col_type = col_type,
-        notnull = if notnull { "NOT NULL " } else { "" },
+        name = crate::util::escape_ident(&col.name),
+        col_type = col.col_type,
+        notnull = if col.notnull { "NOT NULL " } else { "" },
         dflt = dflt_val_str
     ))
 }
 
-fn maybe_update_indices(
-    local_db: *mut sqlite3,
-    table: &str,
-    mem_db: &ManagedConnection,
-) -> Result<ResultCode, ResultCode> {
-    // We do not pull PK indices because we do not support alterations that changes
-    // primary key definitions.
-    // User would need to perform a manual migration for that.
-    // This is due to the fact that SQLite itself does not support changing primary key
-    // definitions in alter table statements.
-    let sql = "SELECT name FROM pragma_index_list(?) WHERE origin != 'pk';";
-    let local_fetch = local_db.prepare_v2(sql)?;
-    let mem_fetch = mem_db.prepare_v2(sql)?;
-    local_fetch.bind_text(1, table, sqlite::Destructor::STATIC)?;
-    mem_fetch.bind_text(1, table, sqlite::Destructor::STATIC)?;
-
-    let mut local_indices = BTreeSet::new();
-    let mut mem_indices = BTreeSet::new();
-
-    while mem_fetch.step()? == ResultCode::ROW {
-        mem_indices.insert(mem_fetch.column_text(0)?.to_string());
-    }
-
-    let mut removed: Vec<String> = vec![];
-    let mut maybe_modified: Vec<String> = vec![];
-
-    while local_fetch.step()? == ResultCode::ROW {
-        let name = local_fetch.column_text(0)?;
-        local_indices.insert(name.to_string());
-        if !mem_indices.contains(name) {
-            removed.push(name.to_string());
-        } else {
-            maybe_modified.push(name.to_string());
-        }
-    }
-
-    drop_indices(local_db, &removed)?;
-    // no add, schema file application will add
-
-    for idx in maybe_modified {
-        maybe_recreate_index(local_db, table, &idx, mem_db)?;
-    }
-
-    Ok(ResultCode::OK)
-}
-
 fn drop_indices(local_db: *mut sqlite3, dropped: &Vec<String>) -> Result<ResultCode, ResultCode> {
     // drop if exists given column dropping could have destroyed the index
     // already.
@@ -385,69 +420,3 @@ fn drop_indices(local_db: *mut sqlite3, dropped: &Vec<String>) -> Result<ResultC
     }
     Ok(ResultCode::OK)
 }
-
-/**
-* SQLite does not support alter index statements.
-* What we are doing here is looking to see if indices with the same
-* name have different definitions.
-*
-* If so, drop the index and re-create it with the new definiton.
-*/
-fn maybe_recreate_index(
-    local_db: *mut sqlite3,
-    table: &str,
-    idx: &str,
-    mem_db: &ManagedConnection,
-) -> Result<ResultCode, ResultCode> {
-    let fetch_is_unique_mem = mem_db.prepare_v2(IS_UNIQUE_IDX_SQL)?;
-    fetch_is_unique_mem.bind_text(1, table, sqlite::Destructor::STATIC)?;
-    fetch_is_unique_mem.bind_text(2, idx, sqlite::Destructor::STATIC)?;
-    let fetch_is_unique_local = local_db.prepare_v2(IS_UNIQUE_IDX_SQL)?;
-    fetch_is_unique_local.bind_text(1, table, sqlite::Destructor::STATIC)?;
-    fetch_is_unique_local.bind_text(2, idx, sqlite::Destructor::STATIC)?;
-
-    if fetch_is_unique_mem.step()? != ResultCode::ROW
-        || fetch_is_unique_local.step()? != ResultCode::ROW
-    {
-        return Err(ResultCode::CONSTRAINT);
-    }
-
-    if fetch_is_unique_mem.column_int(0) != fetch_is_unique_local.column_int(0) {
-        // We cannot alter a table against which we have open statements
-        // drop to finalize those statements
-        drop(fetch_is_unique_mem);
-        drop(fetch_is_unique_local);
-        return recreate_index(local_db, idx);
-    }
-
-    let fetch_idx_cols_mem = mem_db.prepare_v2(IDX_COLS_SQL)?;
-    let fetch_idx_cols_local = local_db.prepare_v2(IDX_COLS_SQL)?;
-
-    let mem_result = fetch_idx_cols_mem.step()?;
-    let local_result = fetch_idx_cols_local.step()?;
-    while mem_result == ResultCode::ROW && local_result == ResultCode::ROW {
-        if fetch_idx_cols_mem.column_text(0) != fetch_idx_cols_local.column_text(0) {
-            // We cannot alter a table against which we have open statements
-            // drop to finalize those statements
-            drop(fetch_idx_cols_local);
-            drop(fetch_idx_cols_mem);
-            return recreate_index(local_db, idx);
-        }
-        fetch_idx_cols_mem.step()?;
-        fetch_idx_cols_local.step()?;
-    }
-
-    if mem_result != local_result {
-        return recreate_index(local_db, idx);
-    }
-
-    Ok(ResultCode::OK)
-}
-
-fn recreate_index(local_db: *mut sqlite3, idx: &str) -> Result<ResultCode, ResultCode> {
-    let indices = vec![idx.to_string()];
-    drop_indices(local_db, &indices)?;
-    // no need to call add_indices
-    // they'll be added later with schema reapplication
-    Ok(ResultCode::OK)
-}
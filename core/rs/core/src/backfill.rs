@@ -1,10 +1,15 @@
-use sqlite_nostd::{sqlite3, Connection, Destructor, ManagedStmt, ResultCode};
+use core::ffi::{c_char, c_int};
+use core::mem::ManuallyDrop;
+use sqlite_nostd::{sqlite3, ColumnType, Connection, Context, ResultCode, Value};
 extern crate alloc;
-use crate::tableinfo::ColumnInfo;
+use crate::c::crsql_ExtData;
+use crate::create_crr::create_crr_without_backfill;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, ColumnInfo, TableInfo};
 use crate::util::get_dflt_value;
+use alloc::boxed::Box;
 use alloc::format;
 use alloc::string::String;
-use alloc::{vec, vec::Vec};
+use alloc::vec::Vec;
 use sqlite_nostd as sqlite;
 
 /**
@@ -12,9 +17,7 @@ use sqlite_nostd as sqlite;
  */
 pub fn backfill_table(
     db: *mut sqlite3,
-    table: &str,
-    pk_cols: &Vec<ColumnInfo>,
-    non_pk_cols: &Vec<ColumnInfo>,
+    table_info: &TableInfo,
     is_commit_alter: bool,
     no_tx: bool,
 ) -> Result<ResultCode, ResultCode> {
@@ -22,40 +25,7 @@ pub fn backfill_table(
         db.exec_safe("SAVEPOINT backfill")?;
     }
 
-    let sql = format!(
-        "SELECT {pk_cols} FROM \"{table}\" AS t1
-        EXCEPT SELECT {pk_cols} FROM \"{table}__crsql_pks\" AS t2",
-        table = crate::util::escape_ident(table),
-        pk_cols = pk_cols
-            .iter()
-            .map(|f| format!("\"{}\"", crate::util::escape_ident(&f.name)))
-            .collect::<Vec<_>>()
-            .join(", "),
-    );
-    let stmt = db.prepare_v2(&sql);
-
-    let non_pk_cols_refs = non_pk_cols.iter().collect::<Vec<_>>();
-    let result = match stmt {
-        Ok(stmt) => create_clock_rows_from_stmt(
-            stmt,
-            db,
-            table,
-            pk_cols,
-            &non_pk_cols_refs,
-            is_commit_alter,
-        ),
-        Err(e) => Err(e),
-    };
-
-    if let Err(e) = result {
-        if !no_tx {
-            db.exec_safe("ROLLBACK")?;
-        }
-
-        return Err(e);
-    }
-
-    if let Err(e) = backfill_missing_columns(db, table, pk_cols, non_pk_cols, is_commit_alter) {
+    if let Err(e) = backfill_rows(db, table_info, is_commit_alter, None) {
         if !no_tx {
             db.exec_safe("ROLLBACK")?;
         }
@@ -70,103 +40,138 @@ pub fn backfill_table(
     }
 }
 
+// We do not grab nextdbversion on migration.
+// The idea is that other nodes will apply the same migration
+// in the future so if they have already seen this node up
+// to the current db version then the migration will place them into the correct
+// state. No need to re-sync post migration.
+fn db_version_getter(is_commit_alter: bool) -> &'static str {
+    if is_commit_alter {
+        "crsql_db_version()"
+    } else {
+        "crsql_next_db_version()"
+    }
+}
+
 /**
-* Given a statement that returns rows in the source table not present
-* in the clock table, create those rows in the clock table.
+* Creates the missing clock rows of the rows in `chunk`, a table of primary keys,
+* or of every row in the table if there is no chunk.
 */
-fn create_clock_rows_from_stmt(
-    read_stmt: ManagedStmt,
+fn backfill_rows(
     db: *mut sqlite3,
-    table: &str,
-    pk_cols: &Vec<ColumnInfo>,
-    non_pk_cols: &Vec<&ColumnInfo>,
+    table_info: &TableInfo,
     is_commit_alter: bool,
+    chunk: Option<&str>,
 ) -> Result<ResultCode, ResultCode> {
-    let select_key = db.prepare_v2(&format!(
-        "SELECT __crsql_key FROM \"{table}__crsql_pks\" WHERE {pk_where_conditions}",
-        table = crate::util::escape_ident(table),
-        pk_where_conditions = crate::util::where_list(pk_cols, None)?
-    ))?;
-    let create_key = db.prepare_v2(&format!(
-        "INSERT INTO \"{table}__crsql_pks\" ({pk_cols}) VALUES ({pk_values}) RETURNING __crsql_key",
-        table = crate::util::escape_ident(table),
-        pk_cols = pk_cols
-            .iter()
-            .map(|f| format!("\"{}\"", crate::util::escape_ident(&f.name)))
-            .collect::<Vec<_>>()
-            .join(", "),
-        pk_values = pk_cols.iter().map(|_| "?").collect::<Vec<_>>().join(", "),
-    ))?;
-    // We do not grab nextdbversion on migration.
-    // The idea is that other nodes will apply the same migration
-    // in the future so if they have already seen this node up
-    // to the current db version then the migration will place them into the correct
-    // state. No need to re-sync post migration.
-    // or-ignore since we do not drop sentinel values during compaction as they act as our metadata
-    // to determine if rows should resurrect on a future insertion event provided by a peer.
-    let sql = format!(
-        "INSERT OR IGNORE INTO \"{table}__crsql_clock\"
-          (key, col_name, col_version, db_version, seq) VALUES
-          (?, ?, 1, {dbversion_getter}, crsql_increment_and_get_seq())",
-        table = crate::util::escape_ident(table),
-        dbversion_getter = if is_commit_alter {
-            "crsql_db_version()"
-        } else {
-            "crsql_next_db_version()"
-        }
-    );
-    let write_stmt = db.prepare_v2(&sql)?;
-
-    while read_stmt.step()? == ResultCode::ROW {
-        let key = get_or_create_key(&select_key, &create_key, pk_cols, &read_stmt)?;
-        write_stmt.bind_int64(1, key)?;
-
-        for col in non_pk_cols.iter() {
-            // We even backfill default values since we can't differentiate between an explicit
-            // reset to a default vs an implicit set to default on create. Do we? I don't think we do set defaults.
-            write_stmt.bind_text(2, &col.name, Destructor::STATIC)?;
-            write_stmt.step()?;
-            write_stmt.reset()?;
-        }
-        if non_pk_cols.len() == 0 {
-            write_stmt.bind_text(2, crate::c::INSERT_SENTINEL, Destructor::STATIC)?;
-            write_stmt.step()?;
-            write_stmt.reset()?;
-        }
-    }
+    create_clock_rows_for_new_rows(db, table_info, is_commit_alter, chunk)?;
+    backfill_missing_columns(db, table_info, is_commit_alter, chunk)
+}
 
-    Ok(ResultCode::OK)
+/**
+* Seqs of a set based insert are numbered by a window function, starting at the
+* current seq. Reserves the seqs the insert used once it is done.
+*/
+fn insert_clock_rows(db: *mut sqlite3, sql: &str) -> Result<ResultCode, ResultCode> {
+    db.exec_safe(sql)?;
+    // Every selected clock row is new so each one was inserted.
+    db.exec_safe("SELECT crsql_increment_and_get_seq(changes())")
 }
 
-fn get_or_create_key(
-    select_stmt: &ManagedStmt,
-    create_stmt: &ManagedStmt,
-    pk_cols: &Vec<ColumnInfo>,
-    read_stmt: &ManagedStmt,
-) -> Result<sqlite::int64, ResultCode> {
-    for (i, _name) in pk_cols.iter().enumerate() {
-        let value = read_stmt.column_value(i as i32)?;
-        // TODO: ok to bind into to places at once?
-        select_stmt.bind_value(i as i32 + 1, value)?;
-        create_stmt.bind_value(i as i32 + 1, value)?;
-    }
+/**
+* Gives rows in the source table that have no lookaside key yet a key, then
+* creates clock rows for every column of them. Done as a couple of
+* `INSERT ... SELECT`s rather than row by row.
+*
+* Tables keyed by their pk have no lookaside. Their new rows are the ones
+* without clock rows.
+*/
+fn create_clock_rows_for_new_rows(
+    db: *mut sqlite3,
+    table_info: &TableInfo,
+    is_commit_alter: bool,
+    chunk: Option<&str>,
+) -> Result<ResultCode, ResultCode> {
+    let table_ident = crate::util::escape_ident(&table_info.tbl_name);
+    let pk_list = crate::util::as_identifier_list(&table_info.pks, None)?;
+    let source = match chunk {
+        Some(chunk) => String::from(chunk),
+        None => format!("\"{table_ident}\""),
+    };
 
-    if let Ok(ResultCode::ROW) = select_stmt.step() {
-        let key = select_stmt.column_int64(0);
-        create_stmt.clear_bindings()?;
-        select_stmt.reset()?;
-        return Ok(key);
-    }
-    select_stmt.reset()?;
+    let new_keys = if table_info.key_is_pk {
+        format!(
+            "(SELECT {pk_list} AS __crsql_key FROM {source} AS s
+              WHERE NOT EXISTS (SELECT 1 FROM \"{table_ident}__crsql_clock\" WHERE key = s.{pk_list}))"
+        )
+    } else {
+        // Keys are rowids so new keys are all above the current max.
+        let max_key_stmt = db.prepare_v2(&format!(
+            "SELECT coalesce(max(__crsql_key), 0) FROM \"{table_ident}__crsql_pks\""
+        ))?;
+        max_key_stmt.step()?;
+        let max_key = max_key_stmt.column_int64(0);
 
-    if let Ok(ResultCode::ROW) = create_stmt.step() {
-        let key = create_stmt.column_int64(0);
-        create_stmt.reset()?;
-        return Ok(key);
-    }
-    create_stmt.reset()?;
+        let new_pks = match chunk {
+            // Probe the lookaside's pk index for each row of the chunk. An EXCEPT
+            // would scan the whole lookaside on every step.
+            Some(chunk) => format!(
+                "SELECT {pk_list} FROM {chunk} AS s
+                  WHERE NOT EXISTS (SELECT 1 FROM \"{table_ident}__crsql_pks\" AS p WHERE {pk_eq})",
+                pk_eq = table_info
+                    .pks
+                    .iter()
+                    .map(|c| format!(
+                        "p.\"{col}\" = s.\"{col}\"",
+                        col = crate::util::escape_ident(&c.name)
+                    ))
+                    .collect::<Vec<_>>()
+                    .join(" AND "),
+            ),
+            None => format!(
+                "SELECT {pk_list} FROM {source}
+                  EXCEPT SELECT {pk_list} FROM \"{table_ident}__crsql_pks\""
+            ),
+        };
+        db.exec_safe(&format!(
+            "INSERT INTO \"{table_ident}__crsql_pks\" ({pk_list}) {new_pks}"
+        ))?;
+        let changes_stmt = db.prepare_v2("SELECT changes()")?;
+        changes_stmt.step()?;
+        if changes_stmt.column_int64(0) == 0 {
+            return Ok(ResultCode::OK);
+        }
+        format!(
+            "(SELECT __crsql_key FROM \"{table_ident}__crsql_pks\" WHERE __crsql_key > {max_key})"
+        )
+    };
 
-    return Err(ResultCode::ERROR);
+    // We even backfill default values since we can't differentiate between an explicit
+    // reset to a default vs an implicit set to default on create.
+    // Tables with no columns other than their primary key just get a sentinel.
+    let columns = if table_info.non_pks.len() == 0 {
+        format!("SELECT {} AS id, 0 AS idx", crate::c::SENTINEL_COL_ID)
+    } else {
+        table_info
+            .non_pks
+            .iter()
+            .enumerate()
+            .map(|(i, c)| format!("SELECT {} AS id, {} AS idx", c.col_id, i))
+            .collect::<Vec<_>>()
+            .join(" UNION ALL ")
+    };
+    // or-ignore since we do not drop sentinel values during compaction as they act as our metadata
+    // to determine if rows should resurrect on a future insertion event provided by a peer.
+    insert_clock_rows(
+        db,
+        &format!(
+            "INSERT OR IGNORE INTO \"{table_ident}__crsql_clock\"
+              (key, col_id, col_version, db_version, seq)
+              SELECT k.__crsql_key, c.id, 1, {dbversion_getter},
+                crsql_get_seq() + row_number() OVER (ORDER BY k.__crsql_key, c.idx) - 1
+              FROM {new_keys} AS k, ({columns}) AS c",
+            dbversion_getter = db_version_getter(is_commit_alter),
+        ),
+    )
 }
 
 /**
@@ -178,13 +183,12 @@ fn get_or_create_key(
 */
 fn backfill_missing_columns(
     db: *mut sqlite3,
-    table: &str,
-    pk_cols: &Vec<ColumnInfo>,
-    non_pk_cols: &Vec<ColumnInfo>,
+    table_info: &TableInfo,
     is_commit_alter: bool,
+    chunk: Option<&str>,
 ) -> Result<ResultCode, ResultCode> {
-    for non_pk_col in non_pk_cols {
-        fill_column(db, table, pk_cols, non_pk_col, is_commit_alter)?;
+    for non_pk_col in table_info.non_pks.iter() {
+        fill_column(db, table_info, non_pk_col, is_commit_alter, chunk)?;
     }
 
     Ok(ResultCode::OK)
@@ -192,47 +196,255 @@ fn backfill_missing_columns(
 
 // This doesn't fill compeltely new columns...
 // Wel... does it not? The on condition x left join should do it.
-fn fill_column(
+pub fn fill_column(
     db: *mut sqlite3,
-    table: &str,
-    pk_cols: &Vec<ColumnInfo>,
+    table_info: &TableInfo,
     non_pk_col: &ColumnInfo,
     is_commit_alter: bool,
+    chunk: Option<&str>,
 ) -> Result<ResultCode, ResultCode> {
     // Only fill rows for which
     // - a row does not exist for that pk combo _and_ the cid in the clock table.
     // - the value is not the default value for that column.
-    let dflt_value = get_dflt_value(db, table, &non_pk_col.name)?;
-    let sql = format!(
-        "SELECT {pk_cols} FROM {table} as t1
-          JOIN \"{table}__crsql_pks\" as t2 ON {pk_on_conditions}
-          LEFT JOIN \"{table}__crsql_clock\" as t3 ON t3.key = t2.__crsql_key AND t3.col_name = ?
-          WHERE t3.key IS NULL {dflt_value_condition}",
-        table = crate::util::escape_ident(table),
-        pk_cols = pk_cols
-            .iter()
-            .map(|f| format!("t1.\"{}\"", crate::util::escape_ident(&f.name)))
-            .collect::<Vec<_>>()
-            .join(", "),
-        pk_on_conditions = pk_cols
-            .iter()
-            .map(|f| format!(
-                "t1.\"{}\" = t2.\"{}\"",
-                crate::util::escape_ident(&f.name),
-                crate::util::escape_ident(&f.name)
-            ))
-            .collect::<Vec<_>>()
-            .join(" AND "),
-        dflt_value_condition = if let Some(dflt) = dflt_value {
-            format!("AND t1.\"{}\" IS NOT {}", &non_pk_col.name, dflt)
-        } else {
-            String::from("")
-        },
-    );
-    let read_stmt = db.prepare_v2(&sql)?;
-    read_stmt.bind_text(1, &non_pk_col.name, Destructor::STATIC)?;
-
-    // TODO: rm clone?
-    let non_pk_cols = vec![non_pk_col];
-    create_clock_rows_from_stmt(read_stmt, db, table, pk_cols, &non_pk_cols, is_commit_alter)
+    let pk_cols = &table_info.pks;
+    let dflt_value = get_dflt_value(db, &table_info.tbl_name, &non_pk_col.name)?;
+    let table_ident = crate::util::escape_ident(&table_info.tbl_name);
+    let (key, key_join) = table_info.key_of_row("t1", "t2");
+    insert_clock_rows(
+        db,
+        &format!(
+            "INSERT OR IGNORE INTO \"{table_ident}__crsql_clock\"
+              (key, col_id, col_version, db_version, seq)
+              SELECT {key}, {col_id}, 1, {dbversion_getter},
+                crsql_get_seq() + row_number() OVER (ORDER BY {key}) - 1
+              FROM \"{table_ident}\" as t1
+              {key_join}
+              LEFT JOIN \"{table_ident}__crsql_clock\" as t3 ON t3.key = {key} AND t3.col_id = {col_id}
+              WHERE t3.key IS NULL {dflt_value_condition} {chunk_condition}",
+            col_id = non_pk_col.col_id,
+            dbversion_getter = db_version_getter(is_commit_alter),
+            dflt_value_condition = if let Some(dflt) = dflt_value {
+                format!(
+                    "AND t1.\"{}\" IS NOT {}",
+                    crate::util::escape_ident(&non_pk_col.name),
+                    dflt
+                )
+            } else {
+                String::from("")
+            },
+            chunk_condition = if let Some(chunk) = chunk {
+                format!(
+                    "AND ({t1_pk_list}) IN (SELECT {pk_list} FROM {chunk})",
+                    t1_pk_list = crate::util::as_identifier_list(pk_cols, Some("t1."))?,
+                    pk_list = crate::util::as_identifier_list(pk_cols, None)?,
+                )
+            } else {
+                String::from("")
+            },
+        ),
+    )
+}
+
+/**
+ * crsql_backfill_step(table, max_rows)
+ *
+ * Makes `table` a crr in chunks so that a large table can be converted without
+ * holding the write lock for the whole backfill. The first call makes the table
+ * a crr without backfilling it. Every call then creates the clock rows of the
+ * next `max_rows` rows, in primary key order. Writes to rows not yet backfilled
+ * are tracked by the crr triggers as usual.
+ *
+ * Call again, in a new transaction, until it returns 0. Progress is kept in
+ * `crsql_master` so an interrupted backfill picks up where it left off.
+ *
+ * Returns an estimate of the number of rows left to backfill.
+ */
+pub unsafe extern "C" fn x_crsql_backfill_step(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_backfill_step. Provide the table name and the max number of rows to backfill.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let table = args[0].text();
+    let max_rows = args[1].int64();
+    let db = ctx.db_handle();
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+    if max_rows < 1 {
+        ctx.result_error("crsql_backfill_step must backfill at least one row per step");
+        return;
+    }
+
+    if let Err(_) = db.exec_safe("SAVEPOINT backfill_step") {
+        ctx.result_error("failed to start backfill_step savepoint");
+        return;
+    }
+
+    match backfill_step(db, ext_data, table, max_rows) {
+        Ok(remaining) => {
+            if let Err(_) = db.exec_safe("RELEASE backfill_step") {
+                ctx.result_error("failed to release backfill_step savepoint");
+                return;
+            }
+            ctx.result_int64(remaining);
+        }
+        Err(msg) => {
+            let _ = db.exec_safe("ROLLBACK TO backfill_step; RELEASE backfill_step;");
+            ctx.result_error(&msg);
+        }
+    }
+}
+
+fn backfill_step(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table: &str,
+    max_rows: i64,
+) -> Result<i64, String> {
+    let table_ident = crate::util::escape_ident(table);
+    // The last primary key backfilled, packed. NULL before the first chunk.
+    let cursor_key = format!("backfill_cursor.{}", table);
+    // Rows of the table left to backfill as of the last step.
+    let remaining_key = format!("backfill_remaining.{}", table);
+
+    let mut err: *mut c_char = core::ptr::null_mut();
+    let created = create_crr_without_backfill(db, table, &mut err as *mut _)
+        .or_else(|_| Err(format!("failed to make {} a crr", table)))?;
+    if created.is_some() {
+        db.exec_safe(&format!(
+            "INSERT OR REPLACE INTO crsql_master (key, value) VALUES
+              ('{cursor_key}', NULL),
+              ('{remaining_key}', (SELECT count(*) FROM \"{table_ident}\"))",
+            cursor_key = crate::util::escape_ident_as_value(&cursor_key),
+            remaining_key = crate::util::escape_ident_as_value(&remaining_key),
+        ))
+        .or_else(|_| Err("failed to start backfill"))?;
+    }
+
+    let progress = read_backfill_progress(db, &cursor_key, &remaining_key)
+        .or_else(|_| Err("failed to read backfill progress"))?;
+    let (cursor, remaining) = match progress {
+        Some(progress) => progress,
+        // Not being backfilled in steps. Either done or backfilled by crsql_as_crr.
+        None => return Ok(0),
+    };
+
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut err as *mut _);
+    if rc != ResultCode::OK as c_int {
+        return Err(format!(
+            "failed to ensure table infos are up to date: {}",
+            rc
+        ));
+    }
+    let table_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+    let tbl_info = table_infos
+        .iter()
+        .find(|t| t.tbl_name == table)
+        .ok_or_else(|| format!("crsql_backfill_step: {} is not a crr", table))?;
+    let pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)
+        .or_else(|_| Err("failed to create pk list"))?;
+
+    // The next chunk of primary keys, in order. Rowids keep the order.
+    db.exec_safe(&format!(
+        "CREATE TEMP TABLE crsql_backfill_chunk AS SELECT {pk_list} FROM \"{table_ident}\" LIMIT 0"
+    ))
+    .or_else(|_| Err("failed to create backfill chunk table"))?;
+    let select_chunk = db
+        .prepare_v2(&format!(
+            "INSERT INTO temp.crsql_backfill_chunk
+              SELECT {pk_list} FROM \"{table_ident}\" {after_cursor}
+              ORDER BY {pk_list} LIMIT {max_rows}",
+            after_cursor = if cursor.is_some() {
+                format!(
+                    "WHERE ({pk_list}) > ({})",
+                    crate::util::binding_list(tbl_info.pks.len())
+                )
+            } else {
+                String::from("")
+            },
+        ))
+        .or_else(|_| Err("failed to prepare backfill chunk selection"))?;
+    if let Some(cursor) = cursor {
+        let cursor = crate::pack_columns::unpack_columns_ref(&cursor)
+            .or_else(|_| Err("failed to unpack backfill cursor"))?;
+        crate::pack_columns::bind_package_to_stmt(select_chunk.stmt, &cursor, 0)
+            .or_else(|_| Err("failed to bind backfill cursor"))?;
+    }
+    select_chunk
+        .step()
+        .or_else(|_| Err(format!("failed to select rows to backfill from {}", table)))?;
+
+    let chunk_stmt = db
+        .prepare_v2(&format!(
+            "SELECT count(*), (SELECT crsql_pack_columns({pk_list}) FROM temp.crsql_backfill_chunk ORDER BY rowid DESC LIMIT 1)
+              FROM temp.crsql_backfill_chunk"
+        ))
+        .or_else(|_| Err("failed to prepare backfill chunk summary"))?;
+    chunk_stmt
+        .step()
+        .or_else(|_| Err("failed to summarize backfill chunk"))?;
+    let chunk_rows = chunk_stmt.column_int64(0);
+
+    backfill_rows(db, tbl_info, false, Some("temp.crsql_backfill_chunk"))
+        .or_else(|_| Err(format!("failed to backfill {}", table)))?;
+    // Clock rows were written from plain SQL. Keep the table's max db_version honest.
+    tbl_info.note_db_version(unsafe { (*ext_data).pendingDbVersion });
+
+    let remaining = if chunk_rows < max_rows {
+        db.exec_safe(&format!(
+            "DELETE FROM crsql_master WHERE key IN ('{cursor_key}', '{remaining_key}')",
+            cursor_key = crate::util::escape_ident_as_value(&cursor_key),
+            remaining_key = crate::util::escape_ident_as_value(&remaining_key),
+        ))
+        .or_else(|_| Err("failed to finish backfill"))?;
+        0
+    } else {
+        // Rows written since the backfill started aren't counted. Only report
+        // done once the table is.
+        let remaining = core::cmp::max(remaining - chunk_rows, 1);
+        let save_progress = db
+            .prepare_v2("INSERT OR REPLACE INTO crsql_master (key, value) VALUES (?, ?), (?, ?)")
+            .and_then(|stmt| {
+                stmt.bind_text(1, &cursor_key, sqlite::Destructor::STATIC)?;
+                stmt.bind_value(2, chunk_stmt.column_value(1)?)?;
+                stmt.bind_text(3, &remaining_key, sqlite::Destructor::STATIC)?;
+                stmt.bind_int64(4, remaining)?;
+                stmt.step()
+            });
+        save_progress.or_else(|_| Err("failed to save backfill progress"))?;
+        remaining
+    };
+
+    db.exec_safe("DROP TABLE temp.crsql_backfill_chunk")
+        .or_else(|_| Err("failed to drop backfill chunk table"))?;
+
+    Ok(remaining)
+}
+
+fn read_backfill_progress(
+    db: *mut sqlite3,
+    cursor_key: &str,
+    remaining_key: &str,
+) -> Result<Option<(Option<Vec<u8>>, i64)>, ResultCode> {
+    let stmt = db.prepare_v2(
+        "SELECT (SELECT value FROM crsql_master WHERE key = ?), value FROM crsql_master WHERE key = ?",
+    )?;
+    stmt.bind_text(1, cursor_key, sqlite::Destructor::STATIC)?;
+    stmt.bind_text(2, remaining_key, sqlite::Destructor::STATIC)?;
+    if stmt.step()? != ResultCode::ROW {
+        return Ok(None);
+    }
+    let cursor = if stmt.column_type(0)? == ColumnType::Null {
+        None
+    } else {
+        Some(stmt.column_blob(0)?.to_vec())
+    };
+    Ok(Some((cursor, stmt.column_int64(1))))
 }
@@ -1,7 +1,8 @@
 use core::ffi::{c_char, c_int};
 
-use crate::{consts, tableinfo::TableInfo};
-use alloc::{ffi::CString, format};
+use crate::{consts, tableinfo::TableInfo, util::get_db_version_union_query};
+use alloc::string::ToString;
+use alloc::{ffi::CString, format, vec};
 use core::slice;
 use sqlite::{sqlite3, Connection, Destructor, ResultCode};
 use sqlite_nostd as sqlite;
@@ -165,6 +166,10 @@ fn maybe_update_db_inner(
     //     update_to_0_15_0(db)?;
     // }
 
+    if recorded_version < consts::CRSQLITE_VERSION_0_17_0 {
+        update_to_0_17_0(db)?;
+    }
+
     // write the db version if we migrated to a new one or we are a blank slate db
     if recorded_version < consts::CRSQLITE_VERSION || is_blank_slate {
         let stmt =
@@ -176,6 +181,72 @@ fn maybe_update_db_inner(
     Ok(ResultCode::OK)
 }
 
+/**
+ * 0.17.0 changes every clock table in one pass:
+ * - clock rows are keyed by column id rather than column name. Ids are assigned
+ *   to the names found in each clock table and the table is rewritten.
+ * - clock rows are indexed by (db_version, seq) so reading changes in order needs
+ *   no sort within a db_version.
+ * - the db version is persisted in `crsql_master` rather than derived from
+ *   `max(db_version)` over every clock table. It is seeded from the clock tables.
+ */
+fn update_to_0_17_0(db: *mut sqlite3) -> Result<ResultCode, ResultCode> {
+    let clock_tables_stmt = db.prepare_v2(
+        "SELECT tbl_name FROM sqlite_master WHERE type='table' AND tbl_name LIKE '%__crsql_clock'",
+    )?;
+    let mut clock_tbl_names = vec![];
+    while clock_tables_stmt.step()? == ResultCode::ROW {
+        clock_tbl_names.push(clock_tables_stmt.column_text(0)?.to_string());
+    }
+    drop(clock_tables_stmt);
+    if clock_tbl_names.len() == 0 {
+        return Ok(ResultCode::OK);
+    }
+
+    db.exec_safe(&format!(
+        "INSERT OR REPLACE INTO crsql_master (key, value)
+          SELECT 'db_version', version FROM ({union}) WHERE version IS NOT NULL",
+        union = get_db_version_union_query(&clock_tbl_names)
+    ))?;
+
+    for clock_tbl_name in &clock_tbl_names {
+        let table_name = &clock_tbl_name[..clock_tbl_name.len() - "__crsql_clock".len()];
+        create_clock_columns_table(db, table_name)?;
+        db.exec_safe(&format!(
+            "INSERT OR IGNORE INTO \"{table_name}__crsql_cols\" (col_id, col_name)
+              SELECT row_number() OVER (ORDER BY name), name FROM (
+                SELECT DISTINCT col_name AS name FROM \"{table_name}__crsql_clock\" WHERE col_name != '{sentinel}'
+                UNION SELECT name FROM pragma_table_info('{table_name_val}') WHERE pk = 0
+              );
+            CREATE TABLE \"{table_name}__crsql_clock_0_17_0\" (
+              key INTEGER NOT NULL,
+              col_id INTEGER NOT NULL,
+              col_version INTEGER NOT NULL,
+              db_version INTEGER NOT NULL,
+              site_id INTEGER NOT NULL DEFAULT 0,
+              seq INTEGER NOT NULL,
+              PRIMARY KEY (key, col_id)
+            ) WITHOUT ROWID, STRICT;
+            INSERT INTO \"{table_name}__crsql_clock_0_17_0\"
+              SELECT clock.key, cols.col_id, clock.col_version, clock.db_version, clock.site_id, clock.seq
+              FROM \"{table_name}__crsql_clock\" AS clock
+              JOIN \"{table_name}__crsql_cols\" AS cols ON cols.col_name = clock.col_name;
+            DROP TABLE \"{table_name}__crsql_clock\";
+            ALTER TABLE \"{table_name}__crsql_clock_0_17_0\" RENAME TO \"{table_name}__crsql_clock\";
+            CREATE INDEX \"{table_name}__crsql_clock_dbv_idx\" ON \"{table_name}__crsql_clock\" (\"db_version\", \"seq\");",
+            table_name = crate::util::escape_ident(table_name),
+            table_name_val = crate::util::escape_ident_as_value(table_name),
+            sentinel = crate::c::INSERT_SENTINEL,
+        ))?;
+    }
+
+    if local_changes_index_enabled(db)? {
+        set_local_changes_index(db, true)?;
+    }
+
+    Ok(ResultCode::OK)
+}
+
 /**
  * The clock table holds the versions for each column of a given row.
  *
@@ -203,21 +274,30 @@ pub fn create_clock_table(
     db.exec_safe(&format!(
         "CREATE TABLE IF NOT EXISTS \"{table_name}__crsql_clock\" (
       key INTEGER NOT NULL,
-      col_name TEXT NOT NULL,
+      col_id INTEGER NOT NULL,
       col_version INTEGER NOT NULL,
       db_version INTEGER NOT NULL,
       site_id INTEGER NOT NULL DEFAULT 0,
       seq INTEGER NOT NULL,
-      PRIMARY KEY (key, col_name)
+      PRIMARY KEY (key, col_id)
     ) WITHOUT ROWID, STRICT",
         table_name = crate::util::escape_ident(table_name),
     ))?;
+    create_clock_columns_table(db, table_name)?;
+    register_clock_columns(db, table_name)?;
 
     db.exec_safe(
       &format!(
-        "CREATE INDEX IF NOT EXISTS \"{table_name}__crsql_clock_dbv_idx\" ON \"{table_name}__crsql_clock\" (\"db_version\")",
+        "CREATE INDEX IF NOT EXISTS \"{table_name}__crsql_clock_dbv_idx\" ON \"{table_name}__crsql_clock\" (\"db_version\", \"seq\")",
         table_name = crate::util::escape_ident(table_name),
       ))?;
+    if local_changes_index_enabled(db)? {
+        create_local_changes_index(db, table_name)?;
+    }
+    if table_info.key_is_pk {
+        // Clocks are keyed by the pk itself. No lookaside needed.
+        return Ok(ResultCode::OK);
+    }
     db.exec_safe(
       &format!(
         "CREATE TABLE IF NOT EXISTS \"{table_name}__crsql_pks\" (__crsql_key INTEGER PRIMARY KEY, {pk_list})",
@@ -233,3 +313,122 @@ pub fn create_clock_table(
       )
     )
 }
+
+/**
+ * Local changes are the clock rows with `site_id = 0`. Push-style sync asks for
+ * the local changes since some db_version. With only the db_version index that
+ * query also walks every merged change past that version.
+ *
+ * Opt in with `crsql_config_set('local-changes-index', 1)`. It costs an index
+ * write for every local write.
+ */
+fn local_changes_index_enabled(db: *mut sqlite3) -> Result<bool, ResultCode> {
+    let stmt = db.prepare_v2("SELECT value FROM crsql_master WHERE key = ?")?;
+    stmt.bind_text(
+        1,
+        &format!("config.{}", crate::config::LOCAL_CHANGES_INDEX),
+        Destructor::TRANSIENT,
+    )?;
+    if stmt.step()? == ResultCode::ROW {
+        Ok(stmt.column_int(0) != 0)
+    } else {
+        Ok(false)
+    }
+}
+
+fn create_local_changes_index(
+    db: *mut sqlite3,
+    table_name: &str,
+) -> Result<ResultCode, ResultCode> {
+    db.exec_safe(&format!(
+        "CREATE INDEX IF NOT EXISTS \"{table_name}__crsql_clock_local_dbv_idx\" ON \"{table_name}__crsql_clock\" (\"db_version\", \"seq\") WHERE site_id = 0",
+        table_name = crate::util::escape_ident(table_name),
+    ))
+}
+
+/**
+ * Creates or drops the local changes index of every crr.
+ */
+pub fn set_local_changes_index(db: *mut sqlite3, enabled: bool) -> Result<ResultCode, ResultCode> {
+    let clock_tables_stmt = db.prepare_v2(
+        "SELECT tbl_name FROM sqlite_master WHERE type='table' AND tbl_name LIKE '%__crsql_clock'",
+    )?;
+    let mut clock_tbl_names = vec![];
+    while clock_tables_stmt.step()? == ResultCode::ROW {
+        clock_tbl_names.push(clock_tables_stmt.column_text(0)?.to_string());
+    }
+    drop(clock_tables_stmt);
+
+    for clock_tbl_name in clock_tbl_names {
+        let table_name = &clock_tbl_name[..clock_tbl_name.len() - "__crsql_clock".len()];
+        if enabled {
+            create_local_changes_index(db, table_name)?;
+        } else {
+            db.exec_safe(&format!(
+                "DROP INDEX IF EXISTS \"{table_name}__crsql_clock_local_dbv_idx\"",
+                table_name = crate::util::escape_ident(table_name),
+            ))?;
+        }
+    }
+
+    Ok(ResultCode::OK)
+}
+
+fn create_clock_columns_table(
+    db: *mut sqlite3,
+    table_name: &str,
+) -> Result<ResultCode, ResultCode> {
+    db.exec_safe(&format!(
+        "CREATE TABLE IF NOT EXISTS \"{table_name}__crsql_cols\" (
+      col_id INTEGER PRIMARY KEY AUTOINCREMENT,
+      col_name TEXT NOT NULL UNIQUE
+    ) STRICT;
+    INSERT OR IGNORE INTO \"{table_name}__crsql_cols\" (col_id, col_name) VALUES ({sentinel_id}, '{sentinel}');",
+        table_name = crate::util::escape_ident(table_name),
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+        sentinel = crate::c::INSERT_SENTINEL,
+    ))
+}
+
+/**
+ * Clock rows refer to columns by a small integer id rather than repeating the
+ * column name in every row. `{table}__crsql_cols` maps ids to names.
+ *
+ * A name keeps its id for as long as the column exists so clock rows stay valid
+ * across `crsql_begin_alter` / `crsql_commit_alter`. Columns without an id get
+ * a new one. `AUTOINCREMENT` keeps the ids of dropped columns from being handed
+ * out again, even the highest, so a stale clock row of a dropped column can never
+ * be taken for a new column. Called when a crr is created and when an alter of
+ * it is committed.
+ */
+pub fn register_clock_columns(
+    db: *mut sqlite3,
+    table_name: &str,
+) -> Result<ResultCode, ResultCode> {
+    let stmt = db.prepare_v2(&format!(
+        "SELECT name FROM pragma_table_info('{table_name_val}')
+          WHERE pk = 0 AND name NOT IN (SELECT col_name FROM \"{table_name}__crsql_cols\")
+          ORDER BY cid",
+        table_name = crate::util::escape_ident(table_name),
+        table_name_val = crate::util::escape_ident_as_value(table_name),
+    ))?;
+    let mut unregistered = vec![];
+    while stmt.step()? == ResultCode::ROW {
+        unregistered.push(stmt.column_text(0)?.to_string());
+    }
+    drop(stmt);
+    if unregistered.len() == 0 {
+        return Ok(ResultCode::OK);
+    }
+
+    let stmt = db.prepare_v2(&format!(
+        "INSERT INTO \"{table_name}__crsql_cols\" (col_name) VALUES (?)",
+        table_name = crate::util::escape_ident(table_name),
+    ))?;
+    for name in &unregistered {
+        stmt.bind_text(1, name, Destructor::STATIC)?;
+        stmt.step()?;
+        stmt.reset()?;
+    }
+    Ok(ResultCode::OK)
+}
@@ -0,0 +1,180 @@
+use core::ffi::{c_char, c_int};
+use core::mem::ManuallyDrop;
+
+use alloc::boxed::Box;
+use alloc::format;
+use alloc::string::String;
+use alloc::vec::Vec;
+use sqlite::{sqlite3, Connection, Context, ResultCode, Stmt, Value};
+use sqlite_nostd as sqlite;
+
+use crate::c::crsql_ExtData;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+
+/**
+ * crsql_delete_where("table", "where_clause")
+ *
+ * Deletes every row of the crr matching `where_clause` and records the deletes
+ * with set-based statements rather than firing the delete trigger once per row.
+ * All rows are deleted at the same db_version, each with its own seq.
+ *
+ * Returns the number of rows deleted.
+ */
+pub unsafe extern "C" fn x_crsql_delete_where(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_delete_where. Provide the table name and a where clause.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let table = args[0].text();
+    let where_clause = args[1].text();
+    let db = ctx.db_handle();
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+
+    if let Err(_) = db.exec_safe("SAVEPOINT delete_where") {
+        ctx.result_error("failed to start delete_where savepoint");
+        return;
+    }
+
+    match delete_where(db, ext_data, table, where_clause) {
+        Ok(deleted) => {
+            if let Err(_) = db.exec_safe("RELEASE delete_where") {
+                ctx.result_error("failed to release delete_where savepoint");
+                return;
+            }
+            ctx.result_int64(deleted);
+        }
+        Err(msg) => {
+            let _ = db.exec_safe("ROLLBACK TO delete_where; RELEASE delete_where;");
+            ctx.result_error(&msg);
+        }
+    }
+}
+
+fn delete_where(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table: &str,
+    where_clause: &str,
+) -> Result<i64, String> {
+    let mut err: *mut c_char = core::ptr::null_mut();
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut err as *mut _);
+    if rc != ResultCode::OK as c_int {
+        return Err(format!(
+            "failed to ensure table infos are up to date: {}",
+            rc
+        ));
+    }
+
+    let table_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+    let tbl_info = match table_infos.iter().find(|t| t.tbl_name == table) {
+        Some(t) => t,
+        None => {
+            return Err(format!("crsql_delete_where: {} is not a crr", table));
+        }
+    };
+
+    let table_ident = crate::util::escape_ident(table);
+    let pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)
+        .or_else(|_| Err("failed to build primary key list"))?;
+    let (key, key_join) = tbl_info.key_of_row("v", "k");
+
+    // Evaluate the caller's where clause exactly once.
+    db.exec_safe(&format!(
+        "CREATE TEMP TABLE crsql_delete_where_victims AS SELECT {pk_list} FROM \"{table_ident}\" WHERE {where_clause}",
+    ))
+    .or_else(|_| Err(format!("failed to select rows to delete from {}", table)))?;
+
+    // Nothing matched. Don't take a db_version for a no-op.
+    let any_victims = {
+        let any_stmt = db
+            .prepare_v2("SELECT EXISTS (SELECT 1 FROM temp.crsql_delete_where_victims)")
+            .or_else(|_| Err("failed to prepare victim count statement"))?;
+        any_stmt
+            .step()
+            .or_else(|_| Err("failed to count rows to delete"))?;
+        any_stmt.column_int(0) != 0
+    };
+    if !any_victims {
+        db.exec_safe("DROP TABLE temp.crsql_delete_where_victims")
+            .or_else(|_| Err("failed to drop delete_where temp table"))?;
+        return Ok(0);
+    }
+
+    // Rows written before the table became a crr may not have a lookaside key yet.
+    if !tbl_info.key_is_pk {
+        db.exec_safe(&format!(
+            "INSERT OR IGNORE INTO \"{table_ident}__crsql_pks\" ({pk_list}) SELECT {pk_list} FROM temp.crsql_delete_where_victims",
+        ))
+        .or_else(|_| Err("failed to create lookaside keys for deleted rows"))?;
+    }
+
+    let db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+    tbl_info.note_db_version(db_version);
+    let seq = unsafe { (*ext_data).seq };
+
+    // Mark every victim deleted. Same semantics as `mark_locally_deleted_stmt`
+    // but one statement for the whole set.
+    let mark_deleted_stmt = db
+        .prepare_v2(&format!(
+            "INSERT INTO \"{table_ident}__crsql_clock\" (key, col_id, col_version, db_version, seq, site_id)
+              SELECT {key}, {sentinel_id}, 2, ?1, ?2 + row_number() OVER () - 1, 0
+              FROM temp.crsql_delete_where_victims AS v {key_join} WHERE true
+            ON CONFLICT DO UPDATE SET
+              col_version = 1 + col_version,
+              db_version = excluded.db_version,
+              seq = excluded.seq,
+              site_id = 0",
+            sentinel_id = crate::c::SENTINEL_COL_ID,
+        ))
+        .or_else(|_| Err("failed to prepare mark deleted statement"))?;
+    mark_deleted_stmt
+        .bind_int64(1, db_version)
+        .and_then(|_| mark_deleted_stmt.bind_int(2, seq))
+        .and_then(|_| mark_deleted_stmt.step())
+        .or_else(|_| Err("failed to mark rows as deleted"))?;
+    unsafe { (*ext_data).seq += db.changes64() as c_int };
+
+    // Drop clocks _after_ recording the deletes so we never lose track of the max db_version.
+    db.exec_safe(&format!(
+        "DELETE FROM \"{table_ident}__crsql_clock\" WHERE key IN (
+          SELECT {key} FROM temp.crsql_delete_where_victims AS v {key_join}
+        ) AND col_id != {sentinel_id}",
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+    ))
+    .or_else(|_| Err("failed to drop clocks of deleted rows"))?;
+
+    // The clock rows are already written. Keep the delete trigger out of it.
+    unsafe {
+        (*ext_data)
+            .pSetSyncBitStmt
+            .step()
+            .and_then(|_| (*ext_data).pSetSyncBitStmt.reset())
+            .or_else(|_| Err("failed to set sync bit"))?;
+    }
+    let delete_rc = db.exec_safe(&format!(
+        "DELETE FROM \"{table_ident}\" WHERE ({pk_list}) IN (SELECT {pk_list} FROM temp.crsql_delete_where_victims)",
+    ));
+    let deleted = db.changes64();
+    unsafe {
+        (*ext_data)
+            .pClearSyncBitStmt
+            .step()
+            .and_then(|_| (*ext_data).pClearSyncBitStmt.reset())
+            .or_else(|_| Err("failed to clear sync bit"))?;
+    }
+    delete_rc.or_else(|_| Err(format!("failed to delete rows from {}", table)))?;
+
+    db.exec_safe("DROP TABLE temp.crsql_delete_where_victims")
+        .or_else(|_| Err("failed to drop delete_where temp table"))?;
+
+    Ok(deleted)
+}
@@ -0,0 +1,284 @@
+use core::ffi::{c_char, c_int, CStr};
+use core::mem::ManuallyDrop;
+
+use alloc::boxed::Box;
+use alloc::format;
+use alloc::string::String;
+use alloc::vec::Vec;
+use sqlite::{sqlite3, Connection, Context, ResultCode, Stmt, StrRef, Value};
+use sqlite_nostd as sqlite;
+
+use crate::c::crsql_ExtData;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+
+/**
+ * crsql_bulk_insert("table", "select_statement")
+ *
+ * Inserts all rows returned by `select_statement` into the crr and creates their
+ * lookaside keys and clock rows with set-based statements rather than firing the
+ * insert trigger once per row. The select must return the table's columns in
+ * declaration order. The batch is recorded at a single db_version.
+ *
+ * Returns the number of rows inserted.
+ */
+pub unsafe extern "C" fn x_crsql_bulk_insert(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_bulk_insert. Provide the table name and a select statement.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+    match bulk_insert_in_savepoint(ctx.db_handle(), ext_data, args[0].text(), args[1].text()) {
+        Ok(inserted) => ctx.result_int64(inserted),
+        Err(msg) => ctx.result_error(&msg),
+    }
+}
+
+/**
+ * C entrypoint for `crsql_bulk_insert`. The number of inserted rows is written
+ * to `inserted` on success.
+ */
+#[no_mangle]
+pub extern "C" fn crsql_bulk_insert(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table: *const c_char,
+    select_sql: *const c_char,
+    inserted: *mut sqlite::int64,
+    err: *mut *mut c_char,
+) -> c_int {
+    let table = unsafe { CStr::from_ptr(table).to_str() };
+    let select_sql = unsafe { CStr::from_ptr(select_sql).to_str() };
+    let (table, select_sql) = match (table, select_sql) {
+        (Ok(table), Ok(select_sql)) => (table, select_sql),
+        _ => return ResultCode::MISUSE as c_int,
+    };
+
+    match bulk_insert_in_savepoint(db, ext_data, table, select_sql) {
+        Ok(count) => {
+            if !inserted.is_null() {
+                unsafe { *inserted = count };
+            }
+            ResultCode::OK as c_int
+        }
+        Err(msg) => {
+            err.set(&msg);
+            ResultCode::ERROR as c_int
+        }
+    }
+}
+
+fn bulk_insert_in_savepoint(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table: &str,
+    select_sql: &str,
+) -> Result<i64, String> {
+    db.exec_safe("SAVEPOINT bulk_insert")
+        .or_else(|_| Err("failed to start bulk_insert savepoint"))?;
+
+    match bulk_insert(db, ext_data, table, select_sql) {
+        Ok(inserted) => {
+            db.exec_safe("RELEASE bulk_insert")
+                .or_else(|_| Err("failed to release bulk_insert savepoint"))?;
+            Ok(inserted)
+        }
+        Err(msg) => {
+            let _ = db.exec_safe("ROLLBACK TO bulk_insert; RELEASE bulk_insert;");
+            Err(msg)
+        }
+    }
+}
+
+fn bulk_insert(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table: &str,
+    select_sql: &str,
+) -> Result<i64, String> {
+    let mut err: *mut c_char = core::ptr::null_mut();
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut err as *mut _);
+    if rc != ResultCode::OK as c_int {
+        return Err(format!(
+            "failed to ensure table infos are up to date: {}",
+            rc
+        ));
+    }
+
+    let table_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+    let tbl_info = match table_infos.iter().find(|t| t.tbl_name == table) {
+        Some(t) => t,
+        None => {
+            return Err(format!("crsql_bulk_insert: {} is not a crr", table));
+        }
+    };
+
+    let table_ident = crate::util::escape_ident(table);
+    let pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)
+        .or_else(|_| Err("failed to build primary key list"))?;
+    let (key, key_join) = tbl_info.key_of_row("v", "k");
+    let implicit = unsafe { (*ext_data).implicitColumnClocks != 0 };
+    let mut columns = tbl_info
+        .pks
+        .iter()
+        .chain(tbl_info.non_pks.iter())
+        .collect::<Vec<_>>();
+    columns.sort_by_key(|c| c.cid);
+    let column_list = columns
+        .iter()
+        .map(|c| format!("\"{}\"", crate::util::escape_ident(&c.name)))
+        .collect::<Vec<_>>()
+        .join(",");
+
+    // Stage the batch so the source select runs once and so we know exactly
+    // which rows were written.
+    // The CTE names the selected columns after the table's columns.
+    db.exec_safe(&format!(
+        "CREATE TEMP TABLE crsql_bulk_insert_rows AS
+          WITH src({column_list}) AS ({select_sql}) SELECT * FROM src"
+    ))
+    .or_else(|_| Err("failed to stage rows for bulk insert"))?;
+
+    // The clock rows are written below. Keep the insert trigger out of it.
+    unsafe {
+        (*ext_data)
+            .pSetSyncBitStmt
+            .step()
+            .and_then(|_| (*ext_data).pSetSyncBitStmt.reset())
+            .or_else(|_| Err("failed to set sync bit"))?;
+    }
+    let insert_rc = db.exec_safe(&format!(
+        "INSERT INTO \"{table_ident}\" ({column_list}) SELECT {column_list} FROM temp.crsql_bulk_insert_rows"
+    ));
+    let inserted = db.changes64();
+    unsafe {
+        (*ext_data)
+            .pClearSyncBitStmt
+            .step()
+            .and_then(|_| (*ext_data).pClearSyncBitStmt.reset())
+            .or_else(|_| Err("failed to clear sync bit"))?;
+    }
+    insert_rc.or_else(|_| Err(format!("failed to insert rows into {}", table)))?;
+
+    // The staged copy is untyped. Read the pks back from the table itself so
+    // they carry its column affinities ('1' vs 1) when matched against clocks.
+    let inserted_rows = format!(
+        "FROM \"{table_ident}\" AS v WHERE ({v_pk_list}) IN (SELECT {pk_list} FROM temp.crsql_bulk_insert_rows)",
+        v_pk_list = crate::util::as_identifier_list(&tbl_info.pks, Some("v."))
+            .or_else(|_| Err("failed to build primary key list"))?,
+    );
+    if !tbl_info.key_is_pk {
+        db.exec_safe(&format!(
+            "INSERT OR IGNORE INTO \"{table_ident}__crsql_pks\" ({pk_list}) SELECT {pk_list} {inserted_rows}"
+        ))
+        .or_else(|_| Err("failed to create lookaside keys for inserted rows"))?;
+    }
+
+    // `ord` spaces out the seqs of each row: one for the sentinel and one per column.
+    db.exec_safe(&format!(
+        "CREATE TEMP TABLE crsql_bulk_insert_keys AS
+          SELECT {key} AS key, row_number() OVER () - 1 AS ord
+          FROM (SELECT {pk_list} {inserted_rows}) AS v {key_join}"
+    ))
+    .or_else(|_| Err("failed to collect keys of inserted rows"))?;
+
+    let db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+    tbl_info.note_db_version(db_version);
+    let seq = unsafe { (*ext_data).seq };
+    let stride = 1 + tbl_info.non_pks.len() as i64;
+
+    // Same semantics as `mark_locally_created_stmt` for rows that need a sentinel.
+    // The sentinel is always needed for pk only tables and implicit clocks. Otherwise
+    // only rows that were previously deleted have one to move forward.
+    let sentinel_sql = if implicit || tbl_info.non_pks.len() == 0 {
+        format!(
+            "INSERT INTO \"{table_ident}__crsql_clock\" (key, col_id, col_version, db_version, seq, site_id)
+              SELECT key, {sentinel_id}, 1, ?1, ?2 + ord * ?3, 0 FROM temp.crsql_bulk_insert_keys WHERE true
+            ON CONFLICT DO UPDATE SET
+              col_version = CASE col_version % 2 WHEN 0 THEN col_version + 1 ELSE col_version + 2 END,
+              db_version = excluded.db_version,
+              seq = excluded.seq,
+              site_id = 0",
+            sentinel_id = crate::c::SENTINEL_COL_ID,
+        )
+    } else {
+        format!(
+            "UPDATE \"{table_ident}__crsql_clock\" SET
+              col_version = CASE col_version % 2 WHEN 0 THEN col_version + 1 ELSE col_version + 2 END,
+              db_version = ?1,
+              seq = ?2 + keys.ord * ?3,
+              site_id = 0
+            FROM temp.crsql_bulk_insert_keys AS keys
+            WHERE \"{table_ident}__crsql_clock\".key = keys.key AND col_id = {sentinel_id}",
+            sentinel_id = crate::c::SENTINEL_COL_ID,
+        )
+    };
+    let sentinel_stmt = db
+        .prepare_v2(&sentinel_sql)
+        .or_else(|_| Err("failed to prepare bulk insert sentinel statement"))?;
+    sentinel_stmt
+        .bind_int64(1, db_version)
+        .and_then(|_| sentinel_stmt.bind_int(2, seq))
+        .and_then(|_| sentinel_stmt.bind_int64(3, stride))
+        .and_then(|_| sentinel_stmt.step())
+        .or_else(|_| Err("failed to record sentinels of inserted rows"))?;
+
+    // Same semantics as `mark_locally_updated_stmt`, for every column of every row.
+    // Rows that got a fresh implicit sentinel above don't need column clocks.
+    if tbl_info.non_pks.len() > 0 {
+        let clock_stmt = db
+            .prepare_v2(&format!(
+                "INSERT INTO \"{table_ident}__crsql_clock\" (key, col_id, col_version, db_version, seq, site_id)
+                  SELECT keys.key, cols.id, 1, ?1, ?2 + keys.ord * ?3 + 1 + cols.idx, 0
+                  FROM temp.crsql_bulk_insert_keys AS keys, ({columns}) AS cols
+                  WHERE {implicit_filter}
+                ON CONFLICT DO UPDATE SET
+                  col_version = col_version + 1,
+                  db_version = excluded.db_version,
+                  seq = excluded.seq,
+                  site_id = 0",
+                columns = tbl_info.implicit_columns_query(),
+                implicit_filter = if implicit {
+                    format!(
+                        "NOT EXISTS (SELECT 1 FROM \"{table_ident}__crsql_clock\" AS s
+                          WHERE s.key = keys.key AND s.col_id = {sentinel_id} AND s.col_version = 1 AND s.site_id = 0)",
+                        sentinel_id = crate::c::SENTINEL_COL_ID,
+                    )
+                } else {
+                    String::from("true")
+                },
+            ))
+            .or_else(|_| Err("failed to prepare bulk insert clock statement"))?;
+        clock_stmt
+            .bind_int64(1, db_version)
+            .and_then(|_| clock_stmt.bind_int(2, seq))
+            .and_then(|_| clock_stmt.bind_int64(3, stride))
+            .and_then(|_| clock_stmt.step())
+            .or_else(|_| Err("failed to record clocks of inserted rows"))?;
+    }
+
+    let next_seq = stride
+        .checked_mul(inserted)
+        .and_then(|n| n.checked_add(seq as i64))
+        .and_then(|n| c_int::try_from(n).ok())
+        .ok_or_else(|| {
+            format!(
+                "crsql_bulk_insert: too many rows for one db_version in {}",
+                table
+            )
+        })?;
+    unsafe { (*ext_data).seq = next_seq };
+
+    db.exec_safe("DROP TABLE temp.crsql_bulk_insert_keys; DROP TABLE temp.crsql_bulk_insert_rows;")
+        .or_else(|_| Err("failed to drop bulk_insert temp tables"))?;
+
+    Ok(inserted)
+}
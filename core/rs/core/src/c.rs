@@ -9,6 +9,8 @@ use sqlite_nostd as sqlite;
 
 pub static INSERT_SENTINEL: &str = "-1";
 pub static DELETE_SENTINEL: &str = "-1";
+// The sentinel's id in `{table}__crsql_cols`. Clock rows are keyed by column id.
+pub static SENTINEL_COL_ID: i64 = -1;
 pub static DB_VERSION_SCHEMA_VERSION: c_int = 0;
 pub static TABLE_INFO_SCHEMA_VERSION: c_int = 1;
 
@@ -68,6 +70,14 @@ pub struct crsql_ExtData {
     pub pSelectSiteIdOrdinalStmt: *mut sqlite::stmt,
     pub pSelectClockTablesStmt: *mut sqlite::stmt,
     pub mergeEqualValues: ::core::ffi::c_int,
+    pub implicitColumnClocks: ::core::ffi::c_int,
+    pub checkedDataVersionThisTx: ::core::ffi::c_int,
+    pub pSetDbVersionStmt: *mut sqlite::stmt,
+    pub stmtCacheSize: ::core::ffi::c_int,
+    pub localChangesIndex: ::core::ffi::c_int,
+    pub totalChangesAtBeginAlter: sqlite::int64,
+    pub siteCount: sqlite::int64,
+    pub siteCountDbVersion: sqlite::int64,
 }
 
 #[repr(C)]
@@ -103,6 +113,14 @@ extern "C" {
         db: *mut sqlite::sqlite3,
         pExtData: *mut crsql_ExtData,
     ) -> c_int;
+    pub fn crsql_isInWriteTx(db: *mut sqlite::sqlite3) -> c_int;
+    pub fn crsql_lockSchemaCache();
+    pub fn crsql_unlockSchemaCache();
+    pub fn crsql_isLocalSiteIdConstraint(
+        pIdxInfo: *mut sqlite::index_info,
+        iCons: c_int,
+        pExtData: *mut crsql_ExtData,
+    ) -> c_int;
     pub fn crsql_newExtData(
         db: *mut sqlite::sqlite3,
         siteIdBuffer: *mut c_char,
@@ -263,7 +281,7 @@ fn bindgen_test_layout_crsql_ExtData() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::core::mem::size_of::<crsql_ExtData>(),
-        136usize,
+        184usize,
         concat!("Size of: ", stringify!(crsql_ExtData))
     );
     assert_eq!(
@@ -463,4 +481,84 @@ fn bindgen_test_layout_crsql_ExtData() {
             stringify!(mergeEqualValues)
         )
     );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).implicitColumnClocks) as usize - ptr as usize },
+        132usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(implicitColumnClocks)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).checkedDataVersionThisTx) as usize - ptr as usize },
+        136usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(checkedDataVersionThisTx)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).pSetDbVersionStmt) as usize - ptr as usize },
+        144usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(pSetDbVersionStmt)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).stmtCacheSize) as usize - ptr as usize },
+        152usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(stmtCacheSize)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).localChangesIndex) as usize - ptr as usize },
+        156usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(localChangesIndex)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).totalChangesAtBeginAlter) as usize - ptr as usize },
+        160usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(totalChangesAtBeginAlter)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).siteCount) as usize - ptr as usize },
+        168usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(siteCount)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).siteCountDbVersion) as usize - ptr as usize },
+        176usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(siteCountDbVersion)
+        )
+    );
 }
@@ -6,6 +6,7 @@ use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
 use alloc::boxed::Box;
 use alloc::format;
 use alloc::string::String;
+use alloc::vec;
 use alloc::vec::Vec;
 use core::ffi::{c_char, c_int, CStr};
 use core::mem::{self, forget};
@@ -19,11 +20,12 @@ use sqlite_nostd as sqlite;
 use sqlite_nostd::ResultCode;
 
 use crate::c::{
-    crsql_Changes_cursor, crsql_Changes_vtab, ChangeRowType, ClockUnionColumn, CrsqlChangesColumn,
+    crsql_Changes_cursor, crsql_Changes_vtab, crsql_ExtData, crsql_isLocalSiteIdConstraint,
+    ChangeRowType, ClockUnionColumn, CrsqlChangesColumn,
 };
 use crate::changes_vtab_read::changes_union_query;
 use crate::pack_columns::bind_package_to_stmt;
-use crate::pack_columns::unpack_columns;
+use crate::pack_columns::unpack_columns_ref;
 
 fn changes_crsr_finalize(crsr: *mut crsql_Changes_cursor) -> c_int {
     // Assign pointers to null after freeing
@@ -59,10 +61,18 @@ pub unsafe extern "C" fn crsql_changes_best_index(
 }
 
 fn changes_best_index(
-    _vtab: *mut sqlite::vtab,
+    vtab: *mut sqlite::vtab,
     index_info: *mut sqlite::index_info,
 ) -> Result<ResultCode, ResultCode> {
     let mut idx_num: i32 = 0;
+    // argv index of a `site_id = ?` constraint, if any. See `is_local_only`.
+    let mut site_id_arg: i32 = 0;
+    // whether that constraint is known, while planning, to ask for this site's changes
+    let mut site_id_local = false;
+    // argv index of a `db_vrsn > ?` or `db_vrsn >= ?` constraint, if any. See `db_version_lower_bound`.
+    let mut db_version_arg: i32 = 0;
+    let mut db_version_eq = false;
+    let mut db_version_bounds = 0;
 
     let mut first_constraint = true;
     let mut str = String::new();
@@ -91,14 +101,46 @@ fn changes_best_index(
                     constraint_usage[i].argvIndex = 0;
                     constraint_usage[i].omit = 1;
                 } else {
-                    str.push_str(&format!("{} {} ?", col_name, op_string));
+                    // numbered so the constraint can be repeated for each table. See `changes_union_query`.
+                    str.push_str(&format!("{} {} ?{}", col_name, op_string, arg_v_index));
                     constraint_usage[i].argvIndex = arg_v_index;
                     constraint_usage[i].omit = 1;
+                    if col == Some(CrsqlChangesColumn::SiteId)
+                        && constraint.op == sqlite::INDEX_CONSTRAINT_EQ as u8
+                    {
+                        site_id_arg = arg_v_index;
+                        site_id_local = unsafe {
+                            crsql_isLocalSiteIdConstraint(
+                                index_info,
+                                i as c_int,
+                                (*vtab.cast::<crsql_Changes_vtab>()).pExtData,
+                            ) != 0
+                        };
+                    }
+                    if col == Some(CrsqlChangesColumn::DbVrsn) && db_version_arg == 0 {
+                        if constraint.op == sqlite::INDEX_CONSTRAINT_GT as u8 {
+                            db_version_arg = arg_v_index;
+                        } else if constraint.op == sqlite::INDEX_CONSTRAINT_GE as u8 {
+                            db_version_arg = arg_v_index;
+                            idx_num |= 8;
+                        }
+                    }
                     arg_v_index += 1;
                 }
             }
         }
 
+        if col == Some(CrsqlChangesColumn::DbVrsn) {
+            match constraint.op as u32 {
+                sqlite::INDEX_CONSTRAINT_EQ => db_version_eq = true,
+                sqlite::INDEX_CONSTRAINT_GT
+                | sqlite::INDEX_CONSTRAINT_GE
+                | sqlite::INDEX_CONSTRAINT_LT
+                | sqlite::INDEX_CONSTRAINT_LE => db_version_bounds += 1,
+                _ => {}
+            }
+        }
+
         // idx bit mask
         match col {
             Some(CrsqlChangesColumn::DbVrsn) => idx_num |= 2,
@@ -107,76 +149,60 @@ fn changes_best_index(
         }
     }
 
-    let mut desc = 0;
     let order_bys = sqlite::args!((*index_info).nOrderBy, (*index_info).aOrderBy);
     let mut order_by_consumed = true;
-    if order_bys.len() > 0 {
-        str.push_str(" ORDER BY ");
-    } else {
-        // The user didn't provide an ordering? Tack on a default one that will
-        // retrieve changes in-order
-        str.push_str(" ORDER BY db_vrsn, seq ASC");
-    }
-    first_constraint = true;
+    let mut order_terms = vec![];
     for order_by in order_bys {
-        desc = order_by.desc;
         let col = CrsqlChangesColumn::from_i32(order_by.iColumn);
         if let Some(col_name) = get_clock_table_col_name(&col) {
-            if first_constraint {
-                first_constraint = false;
-            } else {
-                str.push_str(", ");
-            }
-            str.push_str(&col_name);
+            let dir = if order_by.desc != 0 { "DESC" } else { "ASC" };
+            order_terms.push(format!("{} {}", col_name, dir));
         } else {
             // TODO: test we're consuming
             order_by_consumed = false;
         }
     }
-
-    if order_bys.len() > 0 {
-        if desc != 0 {
-            str.push_str(" DESC");
-        } else {
-            str.push_str(" ASC");
-        }
+    if order_terms.len() == 0 {
+        // The user didn't provide an ordering? Tack on a default one that will
+        // retrieve changes in-order. The (db_version, seq) clock index provides it
+        // without a sort.
+        order_terms.push("db_vrsn ASC, seq ASC".to_string());
     }
+    str.push_str(" ORDER BY ");
+    str.push_str(&order_terms.join(", "));
 
     // manual null-term since we'll pass to C
     str.push('\0');
 
-    // TODO: update your order by py test to explain query plans to ensure correct indices are selected
-    // both constraints are present. Also to check that order by is consumed.
-    if idx_num & 6 == 6 {
-        unsafe {
-            (*index_info).estimatedCost = 1.0;
-            (*index_info).estimatedRows = 1;
-        }
-    }
-    // only the version constraint is present
-    else if idx_num & 2 == 2 {
-        unsafe {
-            (*index_info).estimatedCost = 10.0;
-            (*index_info).estimatedRows = 10;
-        }
-    }
-    // only the requestor constraint is present
-    else if idx_num & 4 == 4 {
-        unsafe {
-            (*index_info).estimatedCost = 2147483647.0;
-            (*index_info).estimatedRows = 2147483647;
-        }
-    }
-    // no constraints are present
-    else {
-        unsafe {
-            (*index_info).estimatedCost = 2147483647.0;
-            (*index_info).estimatedRows = 2147483647;
+    let estimate = unsafe {
+        estimate_changes(
+            vtab.cast::<crsql_Changes_vtab>(),
+            db_version_eq,
+            db_version_bounds,
+            site_id_arg > 0,
+            site_id_local,
+        )
+    };
+    let (cost, rows) = match estimate {
+        Ok(estimate) => estimate,
+        // No stats to go on. Prefer plans that constrain the version.
+        Err(_) => {
+            if idx_num & 6 == 6 {
+                (1.0, 1)
+            } else if idx_num & 2 == 2 {
+                (10.0, 10)
+            } else {
+                (2147483647.0, 2147483647)
+            }
         }
+    };
+    unsafe {
+        (*index_info).estimatedCost = cost;
+        (*index_info).estimatedRows = rows;
     }
 
     unsafe {
-        (*index_info).idxNum = idx_num;
+        (*index_info).idxNum = idx_num | (site_id_arg << 8) | (db_version_arg << 16);
         (*index_info).orderByConsumed = if order_by_consumed { 1 } else { 0 };
         // forget str
         let (ptr, _, _) = str.into_raw_parts();
@@ -189,6 +215,95 @@ fn changes_best_index(
     Ok(ResultCode::OK)
 }
 
+/**
+ * Estimates how many changes a query returns and what it costs to return them
+ * from the clock tables' stats. See `TableInfo::clock_stats`.
+ *
+ * SQLite doesn't give us the values of the constraints here. Like SQLite's own
+ * planner we assume each bound of a range on db_version keeps a quarter of the
+ * rows. An equality keeps the average number of rows per version.
+ *
+ * The local changes index only holds this site's clock rows so it can only
+ * serve a `site_id` equality known to be this site's id. Any other `site_id`
+ * equality still visits every clock row.
+ */
+unsafe fn estimate_changes(
+    tab: *mut crsql_Changes_vtab,
+    db_version_eq: bool,
+    db_version_bounds: i32,
+    site_id_eq: bool,
+    site_id_local: bool,
+) -> Result<(f64, i64), ResultCode> {
+    let db = (*tab).db;
+    let ext_data = (*tab).pExtData;
+    // Table infos may be stale when the statement is prepared outside of a transaction.
+    // That is fine for an estimate.
+    let tbl_infos =
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>));
+    if tbl_infos.len() == 0 {
+        return Err(ResultCode::ERROR);
+    }
+
+    let mut total_rows = 0.0;
+    let mut selected_rows = 0.0;
+    for tbl_info in tbl_infos.iter() {
+        let stats = tbl_info.clock_stats(db, (*ext_data).dbVersion)?;
+        total_rows += stats.rows;
+        selected_rows += if db_version_eq {
+            stats.rows_per_version
+        } else {
+            (0..db_version_bounds).fold(stats.rows, |rows, _| rows / 4.0)
+        };
+    }
+
+    if site_id_eq {
+        selected_rows /= core::cmp::max(site_count(db, ext_data)?, 1) as f64;
+    }
+
+    let index_usable = db_version_eq
+        || db_version_bounds > 0
+        || (site_id_local && (*ext_data).localChangesIndex != 0);
+    let cost = if index_usable {
+        // a seek into the index of each clock table, then only the selected rows
+        selected_rows + tbl_infos.len() as f64 * log2(total_rows)
+    } else {
+        // every clock row is visited
+        total_rows
+    };
+
+    Ok((cost.max(1.0), selected_rows.max(1.0) as i64))
+}
+
+/**
+ * Number of sites we've seen changes from, counted again whenever the
+ * db_version moved, like `TableInfo::clock_stats`. Merging changes from a new
+ * site always moves it.
+ */
+unsafe fn site_count(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<i64, ResultCode> {
+    if (*ext_data).siteCount >= 0 && (*ext_data).siteCountDbVersion == (*ext_data).dbVersion {
+        return Ok((*ext_data).siteCount);
+    }
+    let stmt = db.prepare_v2("SELECT count(*) FROM crsql_site_id")?;
+    stmt.step()?;
+    (*ext_data).siteCount = stmt.column_int64(0);
+    (*ext_data).siteCountDbVersion = (*ext_data).dbVersion;
+    Ok((*ext_data).siteCount)
+}
+
+// no_std has no f64::log2
+fn log2(x: f64) -> f64 {
+    let mut x = x;
+    let mut ret = 0.0;
+    while x > 1.0 {
+        x /= 2.0;
+        ret += 1.0;
+    }
+    ret
+}
+
 fn constraint_is_usable(constraint: &sqlite::index_constraint) -> bool {
     if constraint.usable == 0 {
         return false;
@@ -244,7 +359,7 @@ fn get_operator_string(op: u8) -> Option<String> {
 #[no_mangle]
 pub unsafe extern "C" fn crsql_changes_filter(
     cursor: *mut sqlite::vtab_cursor,
-    _idx_num: c_int,
+    idx_num: c_int,
     idx_str: *const c_char,
     argc: c_int,
     argv: *mut *mut sqlite::value,
@@ -253,15 +368,56 @@ pub unsafe extern "C" fn crsql_changes_filter(
     let cursor = cursor.cast::<crsql_Changes_cursor>();
     let idx_str = unsafe { CStr::from_ptr(idx_str).to_str() };
     match idx_str {
-        Ok(idx_str) => match changes_filter(cursor, idx_str, args) {
+        Ok(idx_str) => match changes_filter(cursor, idx_num, idx_str, args) {
             Err(rc) | Ok(rc) => rc as c_int,
         },
         Err(_) => ResultCode::FORMAT as c_int,
     }
 }
 
+/**
+ * Whether the query only asks for changes made by this site, i.e. it constrains
+ * `site_id = crsql_site_id()`. Those are the clock rows with site_id 0.
+ */
+pub unsafe fn is_local_only(
+    ext_data: *mut crsql_ExtData,
+    idx_num: c_int,
+    args: &[*mut sqlite::value],
+) -> bool {
+    let site_id_arg = ((idx_num >> 8) & 0xff) as usize;
+    if site_id_arg == 0 || site_id_arg > args.len() {
+        return false;
+    }
+    let arg = args[site_id_arg - 1];
+    arg.value_type() == ColumnType::Blob
+        && arg.blob()
+            == core::slice::from_raw_parts((*ext_data).siteId, crate::consts::SITE_ID_LEN as usize)
+}
+
+/**
+ * The query only wants changes with a db_version above the returned version, if
+ * it has a lower bound on db_vrsn. Tables whose max db_version is at or below
+ * it can be left out of the query entirely.
+ */
+pub unsafe fn db_version_lower_bound(idx_num: c_int, args: &[*mut sqlite::value]) -> Option<i64> {
+    let db_version_arg = ((idx_num >> 16) & 0xff) as usize;
+    if db_version_arg == 0 || db_version_arg > args.len() {
+        return None;
+    }
+    let arg = args[db_version_arg - 1];
+    if arg.value_type() != ColumnType::Integer {
+        return None;
+    }
+    if idx_num & 8 == 8 {
+        Some(arg.int64() - 1)
+    } else {
+        Some(arg.int64())
+    }
+}
+
 unsafe fn changes_filter(
     cursor: *mut crsql_Changes_cursor,
+    idx_num: c_int,
     idx_str: &str,
     args: &[*mut sqlite::value],
 ) -> Result<ResultCode, ResultCode> {
@@ -295,7 +451,30 @@ unsafe fn changes_filter(
         return Ok(ResultCode::OK);
     }
 
-    let sql = changes_union_query(&tbl_infos, idx_str)?;
+    // Table max db_versions are forgotten once another connection commits.
+    if let Err(msg) = crate::db_version::fill_db_version_if_needed(db, (*tab).pExtData) {
+        (*tab).base.zErrMsg = CString::new(msg)?.into_raw();
+        return Err(ResultCode::ERROR);
+    }
+    let mut changed_tbl_infos = vec![];
+    let lower_bound = db_version_lower_bound(idx_num, args);
+    for tbl_info in tbl_infos.iter() {
+        match lower_bound {
+            Some(version) if tbl_info.max_db_version(db)? <= version => {}
+            _ => changed_tbl_infos.push(tbl_info),
+        }
+    }
+    // nothing changed since the requested version
+    if changed_tbl_infos.len() == 0 {
+        return Ok(ResultCode::OK);
+    }
+
+    let sql = changes_union_query(
+        &changed_tbl_infos,
+        idx_str,
+        (*(*tab).pExtData).implicitColumnClocks != 0,
+        is_local_only((*tab).pExtData, idx_num, args),
+    )?;
 
     let stmt = db.prepare_v2(&sql)?;
     for (i, arg) in args.iter().enumerate() {
@@ -409,7 +588,7 @@ unsafe fn changes_next(
     let row_stmt = row_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
     let packed_pks = pks.blob();
-    let unpacked_pks = unpack_columns(packed_pks)?;
+    let unpacked_pks = unpack_columns_ref(packed_pks)?;
     bind_package_to_stmt(row_stmt.stmt, &unpacked_pks, 0)?;
 
     match row_stmt.step() {
@@ -8,14 +8,17 @@ use sqlite::ResultCode;
 
 use sqlite_nostd as sqlite;
 
-fn crsql_changes_query_for_table(table_info: &TableInfo) -> Result<String, ResultCode> {
+fn crsql_changes_query_for_table(
+    table_info: &TableInfo,
+    local_only: bool,
+) -> Result<String, ResultCode> {
     if table_info.pks.len() == 0 {
         // no primary keys? We can't get changes for a table w/o primary keys...
         // this should be an impossible case.
         return Err(ResultCode::ABORT);
     }
 
-    let pk_list = crate::util::as_identifier_list(&table_info.pks, Some("pk_tbl."))?;
+    let (pk_list, pk_join) = table_info.pks_of_key("t1.key", "pk_tbl")?;
     // TODO: we can remove the self join if we put causal length in the primary key table
 
     // We LEFT JOIN and COALESCE the causal length
@@ -27,7 +30,7 @@ fn crsql_changes_query_for_table(table_info: &TableInfo) -> Result<String, Resul
         "SELECT
           '{table_name_val}' as tbl,
           crsql_pack_columns({pk_list}) as pks,
-          t1.col_name as cid,
+          col_tbl.col_name as cid,
           t1.col_version as col_vrsn,
           t1.db_version as db_vrsn,
           site_tbl.site_id as site_id,
@@ -35,33 +38,96 @@ fn crsql_changes_query_for_table(table_info: &TableInfo) -> Result<String, Resul
           t1.seq as seq,
           COALESCE(t2.col_version, 1) as cl
       FROM \"{table_name_ident}__crsql_clock\" AS t1
-      JOIN \"{table_name_ident}__crsql_pks\" AS pk_tbl ON t1.key = pk_tbl.__crsql_key
+      {pk_join}
+      JOIN \"{table_name_ident}__crsql_cols\" AS col_tbl ON t1.col_id = col_tbl.col_id
       LEFT JOIN crsql_site_id AS site_tbl ON t1.site_id = site_tbl.ordinal
       LEFT JOIN \"{table_name_ident}__crsql_clock\" AS t2 ON
-      t1.key = t2.key AND t2.col_name = '{sentinel}'",
+      t1.key = t2.key AND t2.col_id = {sentinel_id}{local_where}",
+        table_name_val = crate::util::escape_ident_as_value(&table_info.tbl_name),
+        pk_list = pk_list,
+        table_name_ident = crate::util::escape_ident(&table_info.tbl_name),
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+        // Spelled out so the `site_id = 0` local changes index can be used.
+        local_where = if local_only {
+            " WHERE t1.site_id = 0"
+        } else {
+            ""
+        },
+    ))
+}
+
+// Expands implicit column clocks (see `TableInfo::implicit_columns_query`) into
+// a change per column. Columns which have since been written explicitly are
+// covered by the regular clock query.
+fn crsql_implicit_changes_query_for_table(table_info: &TableInfo) -> Result<String, ResultCode> {
+    let (pk_list, pk_join) = table_info.pks_of_key("t1.key", "pk_tbl")?;
+
+    Ok(format!(
+        "SELECT
+          '{table_name_val}' as tbl,
+          crsql_pack_columns({pk_list}) as pks,
+          cols.name as cid,
+          1 as col_vrsn,
+          t1.db_version as db_vrsn,
+          site_tbl.site_id as site_id,
+          t1.key,
+          t1.seq + 1 + cols.idx as seq,
+          1 as cl
+      FROM \"{table_name_ident}__crsql_clock\" AS t1
+      JOIN ({columns}) AS cols
+      {pk_join}
+      LEFT JOIN crsql_site_id AS site_tbl ON t1.site_id = site_tbl.ordinal
+      WHERE t1.col_id = {sentinel_id} AND t1.col_version = 1 AND t1.site_id = 0
+      AND NOT EXISTS (
+        SELECT 1 FROM \"{table_name_ident}__crsql_clock\" AS t3
+        WHERE t3.key = t1.key AND t3.col_id = cols.id
+      )",
         table_name_val = crate::util::escape_ident_as_value(&table_info.tbl_name),
         pk_list = pk_list,
+        columns = table_info.implicit_columns_query(),
         table_name_ident = crate::util::escape_ident(&table_info.tbl_name),
-        sentinel = crate::c::INSERT_SENTINEL
+        sentinel_id = crate::c::SENTINEL_COL_ID
     ))
 }
 
 pub fn changes_union_query(
-    table_infos: &Vec<TableInfo>,
+    table_infos: &Vec<&TableInfo>,
     idx_str: &str,
+    implicit_column_clocks: bool,
+    local_only: bool,
 ) -> Result<String, ResultCode> {
     let mut sub_queries = vec![];
 
     for table_info in table_infos {
-        let query_part = crsql_changes_query_for_table(&table_info)?;
+        let query_part = crsql_changes_query_for_table(&table_info, local_only)?;
         sub_queries.push(query_part);
+        if implicit_column_clocks && table_info.non_pks.len() > 0 {
+            sub_queries.push(crsql_implicit_changes_query_for_table(&table_info)?);
+        }
     }
 
+    // `changes_best_index` always ends idx_str with an ORDER BY.
+    // The constraints are applied to each table and the ordering to the compound
+    // select. SQLite then merges the per-table results rather than sorting all of
+    // them, and each table can read its clock rows in (db_version, seq) order off
+    // the clock index.
+    let (where_str, order_by_str) = match idx_str.find(" ORDER BY ") {
+        Some(i) => idx_str.split_at(i),
+        None => (idx_str, ""),
+    };
+    let sub_queries = sub_queries
+        .iter()
+        .map(|q| {
+            format!(
+                "SELECT tbl, pks, cid, col_vrsn, db_vrsn, site_id, key, seq, cl FROM ({q}) {where_str}"
+            )
+        })
+        .collect::<Vec<_>>();
+
     // Manually null-terminate the string so we don't have to copy it to create a CString.
     // We can just extract the raw bytes of the Rust string.
     return Ok(format!(
-      "SELECT tbl, pks, cid, col_vrsn, db_vrsn, site_id, key, seq, cl FROM ({unions}) {idx_str}\0",
-      unions = sub_queries.join(" UNION ALL "),
-      idx_str = idx_str,
+        "{unions}{order_by_str}\0",
+        unions = sub_queries.join(" UNION ALL "),
     ));
 }
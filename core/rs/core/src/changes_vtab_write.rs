@@ -12,7 +12,7 @@ use crate::c::crsql_ExtData;
 use crate::c::{crsql_Changes_vtab, CrsqlChangesColumn};
 use crate::compare_values::crsql_compare_sqlite_values;
 use crate::pack_columns::bind_package_to_stmt;
-use crate::pack_columns::{unpack_columns, ColumnValue};
+use crate::pack_columns::{unpack_columns_ref, ColumnValueRef};
 use crate::stmt_cache::reset_cached_stmt;
 use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
 use crate::util::slab_rowid;
@@ -30,7 +30,7 @@ fn did_cid_win(
     ext_data: *mut crsql_ExtData,
     insert_tbl: &str,
     tbl_info: &TableInfo,
-    unpacked_pks: &Vec<ColumnValue>,
+    unpacked_pks: &[ColumnValueRef],
     key: sqlite::int64,
     insert_val: *mut sqlite::value,
     insert_site_id: &[u8],
@@ -38,7 +38,9 @@ fn did_cid_win(
     col_version: sqlite::int64,
     errmsg: *mut *mut c_char,
 ) -> Result<bool, ResultCode> {
-    let col_vrsn_stmt_ref = tbl_info.get_col_version_stmt(db)?;
+    let implicit = unsafe { (*ext_data).implicitColumnClocks != 0 };
+    let col_id = tbl_info.get_col_id(col_name)?;
+    let col_vrsn_stmt_ref = tbl_info.get_col_version_stmt(db, implicit)?;
     let col_vrsn_stmt = col_vrsn_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
     let bind_result = col_vrsn_stmt.bind_int64(1, key);
@@ -46,7 +48,7 @@ fn did_cid_win(
         reset_cached_stmt(col_vrsn_stmt.stmt)?;
         return Err(rc);
     }
-    if let Err(rc) = col_vrsn_stmt.bind_text(2, col_name, sqlite::Destructor::STATIC) {
+    if let Err(rc) = col_vrsn_stmt.bind_int64(2, col_id) {
         reset_cached_stmt(col_vrsn_stmt.stmt)?;
         return Err(rc);
     }
@@ -95,7 +97,7 @@ fn did_cid_win(
             reset_cached_stmt(col_val_stmt.stmt)?;
             if ret == 0 && unsafe { (*ext_data).mergeEqualValues == 1 } {
                 // values are the same (ret == 0) and the option to tie break on site_id is true
-                let col_site_id_stmt_ref = tbl_info.get_col_site_id_stmt(db)?;
+                let col_site_id_stmt_ref = tbl_info.get_col_site_id_stmt(db, implicit)?;
                 let col_site_id_stmt = col_site_id_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
                 let bind_result = col_site_id_stmt.bind_int64(1, key);
@@ -103,8 +105,7 @@ fn did_cid_win(
                     reset_cached_stmt(col_site_id_stmt.stmt)?;
                     return Err(rc);
                 }
-                if let Err(rc) = col_site_id_stmt.bind_text(2, col_name, sqlite::Destructor::STATIC)
-                {
+                if let Err(rc) = col_site_id_stmt.bind_int64(2, col_id) {
                     reset_cached_stmt(col_site_id_stmt.stmt)?;
                     return Err(rc);
                 }
@@ -207,6 +208,7 @@ fn set_winner_clock(
         }
     };
 
+    let insert_col_id = tbl_info.get_col_id(insert_col_name)?;
     let set_stmt_ref = tbl_info.get_set_winner_clock_stmt(db)?;
     let set_stmt = set_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
@@ -216,7 +218,7 @@ fn set_winner_clock(
         return Err(rc);
     }
     let bind_result = set_stmt
-        .bind_text(2, insert_col_name, sqlite::Destructor::STATIC)
+        .bind_int64(2, insert_col_id)
         .and_then(|_| set_stmt.bind_int64(3, insert_col_vrsn))
         .and_then(|_| set_stmt.bind_int64(4, insert_db_vrsn))
         .and_then(|_| set_stmt.bind_int64(5, insert_seq))
@@ -234,6 +236,8 @@ fn set_winner_clock(
         Ok(ResultCode::ROW) => {
             let rowid = set_stmt.column_int64(0);
             reset_cached_stmt(set_stmt.stmt)?;
+            // `crsql_next_db_version` left the version the clock was written at pending
+            tbl_info.note_db_version(unsafe { (*ext_data).pendingDbVersion });
             Ok(rowid)
         }
         _ => {
@@ -247,7 +251,7 @@ fn merge_sentinel_only_insert(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
-    unpacked_pks: &Vec<ColumnValue>,
+    unpacked_pks: &[ColumnValueRef],
     key: sqlite::int64,
     remote_col_vrsn: sqlite::int64,
     remote_db_vsn: sqlite::int64,
@@ -326,7 +330,7 @@ unsafe fn merge_delete(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
-    unpacked_pks: &Vec<ColumnValue>,
+    unpacked_pks: &[ColumnValueRef],
     key: sqlite::int64,
     remote_col_vrsn: sqlite::int64,
     remote_db_vrsn: sqlite::int64,
@@ -503,7 +507,7 @@ unsafe fn merge_insert(
     let tbl_info_index = tbl_info_index.unwrap();
 
     let tbl_info = &tbl_infos[tbl_info_index];
-    let unpacked_pks = unpack_columns(insert_pks.blob())?;
+    let unpacked_pks = unpack_columns_ref(insert_pks.blob())?;
 
     // Get or create key as the first thing we do.
     // We'll need the key for all later operations.
@@ -0,0 +1,462 @@
+use core::ffi::c_int;
+
+use alloc::collections::BTreeMap;
+use alloc::format;
+use alloc::string::String;
+use alloc::vec::Vec;
+use sqlite::{sqlite3, ColumnType, Connection, Context, ResultCode, Value};
+use sqlite_nostd as sqlite;
+
+use crate::pack_columns::{bind_package_to_stmt, pack_value, unpack_value};
+
+/*
+ * Changeset format:
+ * [0x00, 0x63, version:u8, num_changes:varint,
+ *   tables:dict, cids:dict, sites:dict,
+ *   ...[section_len:varint, ...section:u8[]] for each crsql_changes column]
+ *
+ * A dict is `count:varint` followed by `count` entries of `len:varint, ...bytes`.
+ * Site ids are stored as `len + 1` so that a NULL site id can be stored as 0.
+ *
+ * Each column of crsql_changes is stored in its own section, in column order:
+ * - table: dict index per change.
+ * - pk: 0 when the change has the same pk as the previous change, else the
+ *   packed pk as `len + 1:varint, ...bytes`. Changes to a row come together.
+ * - cid: dict index per change.
+ * - val: the value packed as a single v1 column. See `pack_value`.
+ * - col_version: zigzag varint.
+ * - db_version: zigzag varint of the difference to the previous change.
+ * - site_id: runs of `run_len:varint, dict index:varint`.
+ * - cl: zigzag varint.
+ * - seq: zigzag varint of the difference to the previous change.
+ *
+ * Changes are read in (db_version, seq) order so the deltas stay small.
+ */
+const CHANGESET_HEADER: [u8; 3] = [0x00, 0x63, 0x01];
+const NUM_SECTIONS: usize = 9;
+
+/**
+ * crsql_changes_encode(since)
+ * crsql_changes_encode(since, site_id)
+ *
+ * Returns every change after db_version `since` as a single columnar blob.
+ * Table names, column names and site ids are written once, versions are
+ * delta encoded and consecutive changes to the same row share their pk.
+ * When `site_id` is given, changes that originated at that site are left out.
+ *
+ * The blob is applied on the other side with `crsql_changes_apply`.
+ */
+pub unsafe extern "C" fn x_crsql_changes_encode(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc < 1 || argc > 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_changes_encode. Provide the db_version to encode changes since and, optionally, a site_id to exclude.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let exclude_site = if argc > 1 && args[1].value_type() != ColumnType::Null {
+        Some(args[1].blob())
+    } else {
+        None
+    };
+    match encode(ctx.db_handle(), args[0].int64(), exclude_site) {
+        Ok(changeset) => {
+            // Allocated through sqlite3_malloc. SQLite takes the buffer as is.
+            let (ptr, len, _) = changeset.into_raw_parts();
+            sqlite::result_blob(
+                ctx,
+                ptr,
+                len as i32,
+                sqlite::Destructor::CUSTOM(crate::crsql_sqlite_free),
+            );
+        }
+        Err(msg) => ctx.result_error(&msg),
+    }
+}
+
+/**
+ * crsql_changes_apply(changeset)
+ *
+ * Merges a changeset produced by `crsql_changes_encode` as if each of its
+ * changes had been inserted into crsql_changes. Either all changes are
+ * applied or none are.
+ *
+ * Returns the number of changes in the changeset.
+ */
+pub unsafe extern "C" fn x_crsql_changes_apply(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 1 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_changes_apply. Provide the changeset.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let db = ctx.db_handle();
+    if let Err(_) = db.exec_safe("SAVEPOINT changes_apply") {
+        ctx.result_error("failed to start changes_apply savepoint");
+        return;
+    }
+
+    match apply(db, args[0].blob()) {
+        Ok(applied) => {
+            if let Err(_) = db.exec_safe("RELEASE changes_apply") {
+                ctx.result_error("failed to release changes_apply savepoint");
+                return;
+            }
+            ctx.result_int64(applied);
+        }
+        Err(msg) => {
+            let _ = db.exec_safe("ROLLBACK TO changes_apply; RELEASE changes_apply;");
+            ctx.result_error(&msg);
+        }
+    }
+}
+
+// Assigns each distinct entry an index in order of first use.
+struct Dict {
+    indices: BTreeMap<Vec<u8>, u64>,
+    null_index: Option<u64>,
+    // Lengths are stored off by one so that NULL can be stored. See the format description.
+    nullable: bool,
+    len: u64,
+    entries: Vec<u8>,
+}
+
+impl Dict {
+    fn new(nullable: bool) -> Self {
+        Dict {
+            indices: BTreeMap::new(),
+            null_index: None,
+            nullable,
+            len: 0,
+            entries: Vec::new(),
+        }
+    }
+
+    fn index_of(&mut self, entry: Option<&[u8]>) -> u64 {
+        let existing = match entry {
+            Some(bytes) => self.indices.get(bytes).copied(),
+            None => self.null_index,
+        };
+        if let Some(index) = existing {
+            return index;
+        }
+
+        let index = self.len;
+        self.len += 1;
+        match entry {
+            Some(bytes) => {
+                self.indices.insert(bytes.to_vec(), index);
+                put_varint(&mut self.entries, bytes.len() as u64 + self.nullable as u64);
+                self.entries.extend_from_slice(bytes);
+            }
+            None => {
+                self.null_index = Some(index);
+                put_varint(&mut self.entries, 0);
+            }
+        }
+        index
+    }
+
+    fn write_to(&self, buf: &mut Vec<u8>) {
+        put_varint(buf, self.len);
+        buf.extend_from_slice(&self.entries);
+    }
+}
+
+fn encode(db: *mut sqlite3, since: i64, exclude_site: Option<&[u8]>) -> Result<Vec<u8>, String> {
+    let sql = if exclude_site.is_some() {
+        "SELECT \"table\", pk, cid, val, col_version, db_version, site_id, cl, seq
+        FROM crsql_changes WHERE db_version > ? AND site_id IS NOT ?"
+    } else {
+        "SELECT \"table\", pk, cid, val, col_version, db_version, site_id, cl, seq
+        FROM crsql_changes WHERE db_version > ?"
+    };
+    let stmt = db
+        .prepare_v2(sql)
+        .or_else(|_| Err("failed to prepare crsql_changes query"))?;
+    stmt.bind_int64(1, since)
+        .or_else(|_| Err("failed to bind db_version"))?;
+    if let Some(site_id) = exclude_site {
+        stmt.bind_blob(2, site_id, sqlite::Destructor::STATIC)
+            .or_else(|_| Err("failed to bind site_id"))?;
+    }
+
+    let mut tables = Dict::new(false);
+    let mut cids = Dict::new(false);
+    let mut sites = Dict::new(true);
+    let mut sections: [Vec<u8>; NUM_SECTIONS] = Default::default();
+    let mut num_changes: u64 = 0;
+    let mut prev_pk: Vec<u8> = Vec::new();
+    let mut prev_db_version: i64 = 0;
+    let mut prev_seq: i64 = 0;
+    // (dict index, run length) of the site run being built.
+    let mut site_run: Option<(u64, u64)> = None;
+
+    loop {
+        match stmt.step() {
+            Ok(ResultCode::ROW) => {}
+            Ok(ResultCode::DONE) => break,
+            _ => return Err(String::from("failed to read crsql_changes")),
+        }
+
+        let table = stmt
+            .column_blob(0)
+            .or_else(|_| Err("failed to read table"))?;
+        put_varint(&mut sections[0], tables.index_of(Some(table)));
+
+        let pk = stmt.column_blob(1).or_else(|_| Err("failed to read pk"))?;
+        if num_changes > 0 && pk == &prev_pk[..] {
+            put_varint(&mut sections[1], 0);
+        } else {
+            put_varint(&mut sections[1], pk.len() as u64 + 1);
+            sections[1].extend_from_slice(pk);
+            prev_pk.clear();
+            prev_pk.extend_from_slice(pk);
+        }
+
+        let cid = stmt.column_blob(2).or_else(|_| Err("failed to read cid"))?;
+        put_varint(&mut sections[2], cids.index_of(Some(cid)));
+
+        let val = stmt
+            .column_value(3)
+            .or_else(|_| Err("failed to read val"))?;
+        pack_value(&mut sections[3], val);
+
+        put_zigzag(&mut sections[4], stmt.column_int64(4));
+
+        let db_version = stmt.column_int64(5);
+        put_zigzag(&mut sections[5], db_version.wrapping_sub(prev_db_version));
+        prev_db_version = db_version;
+
+        let site_id = match stmt.column_type(6) {
+            Ok(ColumnType::Null) => None,
+            _ => Some(
+                stmt.column_blob(6)
+                    .or_else(|_| Err("failed to read site_id"))?,
+            ),
+        };
+        let site = sites.index_of(site_id);
+        site_run = match site_run {
+            Some((run_site, run_len)) if run_site == site => Some((run_site, run_len + 1)),
+            Some((run_site, run_len)) => {
+                put_varint(&mut sections[6], run_len);
+                put_varint(&mut sections[6], run_site);
+                Some((site, 1))
+            }
+            None => Some((site, 1)),
+        };
+
+        put_zigzag(&mut sections[7], stmt.column_int64(7));
+
+        let seq = stmt.column_int64(8);
+        put_zigzag(&mut sections[8], seq.wrapping_sub(prev_seq));
+        prev_seq = seq;
+
+        num_changes += 1;
+    }
+    if let Some((run_site, run_len)) = site_run {
+        put_varint(&mut sections[6], run_len);
+        put_varint(&mut sections[6], run_site);
+    }
+
+    let mut buf = Vec::with_capacity(
+        CHANGESET_HEADER.len()
+            + 10 * (1 + NUM_SECTIONS)
+            + tables.entries.len()
+            + cids.entries.len()
+            + sites.entries.len()
+            + sections.iter().map(|s| s.len()).sum::<usize>(),
+    );
+    buf.extend_from_slice(&CHANGESET_HEADER);
+    put_varint(&mut buf, num_changes);
+    tables.write_to(&mut buf);
+    cids.write_to(&mut buf);
+    sites.write_to(&mut buf);
+    for section in sections.iter() {
+        put_varint(&mut buf, section.len() as u64);
+        buf.extend_from_slice(section);
+    }
+    Ok(buf)
+}
+
+fn apply(db: *mut sqlite3, changeset: &[u8]) -> Result<i64, String> {
+    let malformed = || String::from("crsql_changes_apply - malformed changeset");
+
+    let mut buf = match changeset.strip_prefix(&CHANGESET_HEADER[..]) {
+        Some(rest) => rest,
+        None => {
+            return Err(String::from(
+                "crsql_changes_apply - not a changeset or an unsupported changeset version",
+            ))
+        }
+    };
+    let num_changes = get_varint(&mut buf).ok_or_else(malformed)?;
+    let tables = read_dict(&mut buf, false).ok_or_else(malformed)?;
+    let cids = read_dict(&mut buf, false).ok_or_else(malformed)?;
+    let sites = read_dict(&mut buf, true).ok_or_else(malformed)?;
+    let mut sections: [&[u8]; NUM_SECTIONS] = [&[]; NUM_SECTIONS];
+    for section in sections.iter_mut() {
+        let len = get_varint(&mut buf).ok_or_else(malformed)? as usize;
+        *section = take(&mut buf, len).ok_or_else(malformed)?;
+    }
+    if !buf.is_empty() {
+        return Err(malformed());
+    }
+
+    // One statement is prepared for the whole changeset rather than the caller
+    // round tripping through its driver for every change.
+    let stmt = db
+        .prepare_v2(
+            "INSERT INTO crsql_changes
+            (\"table\", pk, cid, val, col_version, db_version, site_id, cl, seq)
+            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+        )
+        .or_else(|_| Err("failed to prepare crsql_changes insert"))?;
+
+    let mut pk: &[u8] = &[];
+    let mut db_version: i64 = 0;
+    let mut seq: i64 = 0;
+    let mut site_run_left: u64 = 0;
+    let mut site: Option<&[u8]> = None;
+    for i in 0..num_changes {
+        let table = get_entry(&mut sections[0], &tables).ok_or_else(malformed)?;
+
+        let pk_len = get_varint(&mut sections[1]).ok_or_else(malformed)?;
+        if pk_len > 0 {
+            pk = take(&mut sections[1], pk_len as usize - 1).ok_or_else(malformed)?;
+        } else if i == 0 {
+            return Err(malformed());
+        }
+
+        let cid = get_entry(&mut sections[2], &cids).ok_or_else(malformed)?;
+        let val = unpack_value(&mut sections[3]).or_else(|_| Err(malformed()))?;
+        let col_version = get_zigzag(&mut sections[4]).ok_or_else(malformed)?;
+        db_version = db_version.wrapping_add(get_zigzag(&mut sections[5]).ok_or_else(malformed)?);
+
+        if site_run_left == 0 {
+            site_run_left = get_varint(&mut sections[6]).ok_or_else(malformed)?;
+            site = get_entry(&mut sections[6], &sites).ok_or_else(malformed)?;
+            if site_run_left == 0 {
+                return Err(malformed());
+            }
+        }
+        site_run_left -= 1;
+
+        let cl = get_zigzag(&mut sections[7]).ok_or_else(malformed)?;
+        seq = seq.wrapping_add(get_zigzag(&mut sections[8]).ok_or_else(malformed)?);
+
+        // Table and column names are never NULL.
+        let table = table
+            .and_then(|t| core::str::from_utf8(t).ok())
+            .ok_or_else(malformed)?;
+        let cid = cid
+            .and_then(|c| core::str::from_utf8(c).ok())
+            .ok_or_else(malformed)?;
+        stmt.bind_text(1, table, sqlite::Destructor::STATIC)
+            .and_then(|_| stmt.bind_blob(2, pk, sqlite::Destructor::STATIC))
+            .and_then(|_| stmt.bind_text(3, cid, sqlite::Destructor::STATIC))
+            .and_then(|_| bind_package_to_stmt(stmt.stmt, &[val], 3))
+            .and_then(|_| stmt.bind_int64(5, col_version))
+            .and_then(|_| stmt.bind_int64(6, db_version))
+            .and_then(|_| match site {
+                Some(site_id) => stmt.bind_blob(7, site_id, sqlite::Destructor::STATIC),
+                None => stmt.bind_null(7),
+            })
+            .and_then(|_| stmt.bind_int64(8, cl))
+            .and_then(|_| stmt.bind_int64(9, seq))
+            .or_else(|_| Err("failed to bind change"))?;
+        stmt.step().or_else(|_| {
+            Err(format!(
+                "failed to apply change {} of the changeset: {}",
+                i,
+                db.errmsg().unwrap_or_default()
+            ))
+        })?;
+        stmt.reset()
+            .or_else(|_| Err("failed to reset crsql_changes insert"))?;
+    }
+
+    if sections.iter().any(|s| !s.is_empty()) {
+        return Err(malformed());
+    }
+
+    Ok(num_changes as i64)
+}
+
+fn read_dict<'a>(buf: &mut &'a [u8], nullable: bool) -> Option<Vec<Option<&'a [u8]>>> {
+    let count = get_varint(buf)?;
+    // Every entry takes at least a byte. Don't trust a bogus count to size the vec.
+    if count > buf.len() as u64 {
+        return None;
+    }
+    let mut entries = Vec::with_capacity(count as usize);
+    for _ in 0..count {
+        let len = get_varint(buf)?;
+        if nullable {
+            if len == 0 {
+                entries.push(None);
+            } else {
+                entries.push(Some(take(buf, len as usize - 1)?));
+            }
+        } else {
+            entries.push(Some(take(buf, len as usize)?));
+        }
+    }
+    Some(entries)
+}
+
+fn get_entry<'a>(buf: &mut &[u8], dict: &[Option<&'a [u8]>]) -> Option<Option<&'a [u8]>> {
+    let index = get_varint(buf)?;
+    dict.get(usize::try_from(index).ok()?).copied()
+}
+
+fn take<'a>(buf: &mut &'a [u8], len: usize) -> Option<&'a [u8]> {
+    if buf.len() < len {
+        return None;
+    }
+    let (bytes, rest) = buf.split_at(len);
+    *buf = rest;
+    Some(bytes)
+}
+
+fn put_varint(buf: &mut Vec<u8>, mut val: u64) {
+    while val >= 0x80 {
+        buf.push((val as u8) | 0x80);
+        val >>= 7;
+    }
+    buf.push(val as u8);
+}
+
+fn get_varint(buf: &mut &[u8]) -> Option<u64> {
+    let mut val: u64 = 0;
+    for shift in (0..64).step_by(7) {
+        let (byte, rest) = buf.split_first()?;
+        *buf = rest;
+        val |= ((byte & 0x7F) as u64) << shift;
+        if byte & 0x80 == 0 {
+            return Some(val);
+        }
+    }
+    None
+}
+
+// Maps signed ints to unsigned ones so that small negative numbers stay small.
+fn put_zigzag(buf: &mut Vec<u8>, val: i64) {
+    put_varint(buf, ((val << 1) ^ (val >> 63)) as u64);
+}
+
+fn get_zigzag(buf: &mut &[u8]) -> Option<i64> {
+    let val = get_varint(buf)?;
+    Some((val >> 1) as i64 ^ -((val & 1) as i64))
+}
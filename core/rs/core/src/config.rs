@@ -1,12 +1,21 @@
+use alloc::boxed::Box;
 use alloc::format;
+use alloc::vec::Vec;
+use core::mem::ManuallyDrop;
 
 use sqlite::{Connection, Context};
 use sqlite_nostd as sqlite;
 use sqlite_nostd::{ResultCode, Value};
 
+use crate::bootstrap::set_local_changes_index;
 use crate::c::crsql_ExtData;
+use crate::stmt_cache::crsql_clear_stmt_cache;
+use crate::tableinfo::TableInfo;
 
 pub const MERGE_EQUAL_VALUES: &str = "merge-equal-values";
+pub const IMPLICIT_COLUMN_CLOCKS: &str = "implicit-column-clocks";
+pub const STMT_CACHE_SIZE: &str = "stmt-cache-size";
+pub const LOCAL_CHANGES_INDEX: &str = "local-changes-index";
 
 pub extern "C" fn crsql_config_set(
     ctx: *mut sqlite::context,
@@ -24,6 +33,65 @@ pub extern "C" fn crsql_config_set(
             unsafe { (*ext_data).mergeEqualValues = value.int() };
             value
         }
+        IMPLICIT_COLUMN_CLOCKS => {
+            let value = args[1];
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            // Another connection may have enabled it since this one read its config.
+            let enabled = match persisted_implicit_column_clocks(ctx.db_handle()) {
+                Ok(enabled) => enabled,
+                Err(rc) => {
+                    ctx.result_error("Could not read implicit-column-clocks");
+                    ctx.result_error_code(rc);
+                    return;
+                }
+            };
+            // Rows written under implicit clocks have no per-column clock records.
+            // Turning the mode back off would silently drop the clocks of those columns.
+            if enabled && value.int() == 0 {
+                ctx.result_error("implicit-column-clocks cannot be disabled once enabled");
+                ctx.result_error_code(ResultCode::MISUSE);
+                return;
+            }
+            unsafe { (*ext_data).implicitColumnClocks = value.int() };
+            // cached statements are prepared for a specific clock mode
+            crsql_clear_stmt_cache(ext_data);
+            value
+        }
+        STMT_CACHE_SIZE => {
+            let value = args[1];
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            if value.int() < 0 {
+                ctx.result_error(
+                    "stmt-cache-size must be 0 (unbounded) or a positive number of statements",
+                );
+                ctx.result_error_code(ResultCode::MISUSE);
+                return;
+            }
+            unsafe { (*ext_data).stmtCacheSize = value.int() };
+            // all table infos of the connection share one budget
+            let tbl_infos = unsafe {
+                ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>))
+            };
+            if let Some(tbl_info) = tbl_infos.first() {
+                if let Err(rc) = tbl_info.set_stmt_cache_size(value.int() as usize) {
+                    ctx.result_error("Could not evict cached statements");
+                    ctx.result_error_code(rc);
+                    return;
+                }
+            }
+            value
+        }
+        LOCAL_CHANGES_INDEX => {
+            let value = args[1];
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            if let Err(rc) = set_local_changes_index(ctx.db_handle(), value.int() != 0) {
+                ctx.result_error("Could not update the local changes index of crrs");
+                ctx.result_error_code(rc);
+                return;
+            }
+            unsafe { (*ext_data).localChangesIndex = value.int() };
+            value
+        }
         _ => {
             ctx.result_error("Unknown setting name");
             ctx.result_error_code(ResultCode::ERROR);
@@ -76,6 +144,21 @@ pub extern "C" fn crsql_config_get(
             let ext_data = ctx.user_data() as *mut crsql_ExtData;
             ctx.result_int(unsafe { (*ext_data).mergeEqualValues });
         }
+        IMPLICIT_COLUMN_CLOCKS => match persisted_implicit_column_clocks(ctx.db_handle()) {
+            Ok(enabled) => ctx.result_int(enabled as i32),
+            Err(rc) => {
+                ctx.result_error("Could not read implicit-column-clocks");
+                ctx.result_error_code(rc);
+            }
+        },
+        STMT_CACHE_SIZE => {
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            ctx.result_int(unsafe { (*ext_data).stmtCacheSize });
+        }
+        LOCAL_CHANGES_INDEX => {
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            ctx.result_int(unsafe { (*ext_data).localChangesIndex });
+        }
         _ => {
             ctx.result_error("Unknown setting name");
             ctx.result_error_code(ResultCode::ERROR);
@@ -83,3 +166,35 @@ pub extern "C" fn crsql_config_get(
         }
     }
 }
+
+/**
+ * Whether `implicit-column-clocks` is enabled for the database. It decides how
+ * clocks are stored so it holds for every connection, not just the one that
+ * set it.
+ */
+pub fn persisted_implicit_column_clocks(db: *mut sqlite::sqlite3) -> Result<bool, ResultCode> {
+    let stmt = db
+        .prepare_v2("SELECT value FROM crsql_master WHERE key = 'config.implicit-column-clocks'")?;
+    match stmt.step()? {
+        ResultCode::ROW => Ok(stmt.column_int(0) != 0),
+        _ => Ok(false),
+    }
+}
+
+/**
+ * Picks up an `implicit-column-clocks` enabled by another connection.
+ */
+pub fn refresh_implicit_column_clocks(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<ResultCode, ResultCode> {
+    let implicit = persisted_implicit_column_clocks(db)? as i32;
+    unsafe {
+        if (*ext_data).implicitColumnClocks != implicit {
+            (*ext_data).implicitColumnClocks = implicit;
+            // cached statements are prepared for a specific clock mode
+            crsql_clear_stmt_cache(ext_data);
+        }
+    }
+    Ok(ResultCode::OK)
+}
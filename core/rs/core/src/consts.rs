@@ -11,9 +11,10 @@ pub const TBL_SCHEMA: &'static str = "crsql_master";
 // 00_05_01_00
 // and, if we ever need it, we can track individual builds of a patch release
 // 00_05_01_01
-pub const CRSQLITE_VERSION: i32 = 16_03_00;
-pub const CRSQLITE_VERSION_STR: &'static str = "0.16.3";
+pub const CRSQLITE_VERSION: i32 = 17_00_00;
+pub const CRSQLITE_VERSION_STR: &'static str = "0.17.0";
 pub const CRSQLITE_VERSION_0_15_0: i32 = 15_00_00;
+pub const CRSQLITE_VERSION_0_17_0: i32 = 17_00_00;
 
 pub const SITE_ID_LEN: i32 = 16;
 pub const ROWID_SLAB_SIZE: i64 = 10000000000000;
@@ -22,3 +23,8 @@ pub const ROWID_SLAB_SIZE: i64 = 10000000000000;
 // million entries per second for 3,000 centuries.
 pub const MIN_POSSIBLE_DB_VERSION: i64 = 0;
 pub const MAX_TBL_NAME_LEN: i32 = 2048;
+
+// `event` of the `crsql_tracked_peers` rows that record what we've sent a peer.
+pub const TRACKED_EVENT_SEND: i32 = 1;
+// Max number of tombstones `crsql_gc` removes in one call.
+pub const GC_DEFAULT_MAX_ROWS: i64 = 1000;
@@ -169,7 +169,7 @@ extern "C" fn destroy(vtab: *mut sqlite::vtab) -> c_int {
     let ret = tab.db.exec_safe(&format!(
         "DROP TABLE \"{db_name}\".\"{table_name}\";
         DROP TABLE \"{db_name}\".\"{table_name}__crsql_clock\";
-        DROP TABLE \"{db_name}\".\"{table_name}__crsql_pks\";",
+        DROP TABLE IF EXISTS \"{db_name}\".\"{table_name}__crsql_pks\";",
         table_name = crate::util::escape_ident(&tab.base_table_name),
         db_name = crate::util::escape_ident(&tab.db_name)
     ));
@@ -11,8 +11,7 @@ use sqlite_nostd as sqlite;
 
 use crate::c::crsql_ExtData;
 use crate::c::crsql_fetchPragmaDataVersion;
-use crate::c::crsql_fetchPragmaSchemaVersion;
-use crate::c::DB_VERSION_SCHEMA_VERSION;
+use crate::c::crsql_isInWriteTx;
 use crate::consts::MIN_POSSIBLE_DB_VERSION;
 use crate::ext_data::recreate_db_version_stmt;
 
@@ -48,16 +47,30 @@ pub extern "C" fn crsql_next_db_version(
 }
 
 /**
- * Given this needs to do a pragma check, invoke it as little as possible.
- * TODO: We could optimize to only do a pragma check once per transaction.
- * Need to save some bit that states we checked the pragma already and reset on tx commit or rollback.
+ * The pragma check is only done once per write transaction. No other connection
+ * can commit while we hold the write lock so `dbVersion` can't go stale until our
+ * own commit or rollback hook resets `checkedDataVersionThisTx`.
+ *
+ * Within a write transaction the returned version is also persisted to
+ * `crsql_master` so it commits (or rolls back) along with the clock rows that use it.
+ * The upsert compares against the stored row and only writes when the version
+ * moved, which also covers a rollback to a savepoint undoing an earlier write.
  */
 pub fn next_db_version(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
     merging_version: Option<i64>,
 ) -> Result<i64, String> {
-    fill_db_version_if_needed(db, ext_data)?;
+    let in_write_tx = unsafe { crsql_isInWriteTx(db) != 0 };
+    unsafe {
+        if (*ext_data).checkedDataVersionThisTx == 0 {
+            fill_db_version_if_needed(db, ext_data)?;
+            // Read transactions don't fire the hooks so can't skip the check.
+            if in_write_tx {
+                (*ext_data).checkedDataVersionThisTx = 1;
+            }
+        }
+    }
 
     let mut ret = unsafe { (*ext_data).dbVersion + 1 };
     if ret < unsafe { (*ext_data).pendingDbVersion } {
@@ -71,9 +84,24 @@ pub fn next_db_version(
     unsafe {
         (*ext_data).pendingDbVersion = ret;
     }
+    if in_write_tx {
+        persist_db_version(ext_data, ret)?;
+    }
     Ok(ret)
 }
 
+fn persist_db_version(ext_data: *mut crsql_ExtData, db_version: i64) -> Result<(), String> {
+    let set_db_version_stmt = unsafe { (*ext_data).pSetDbVersionStmt };
+    let rc = set_db_version_stmt
+        .bind_int64(1, db_version)
+        .and_then(|_| set_db_version_stmt.step());
+    set_db_version_stmt
+        .reset()
+        .or_else(|rc| Err(format!("failed to reset set db version stmt: {}", rc)))?;
+    rc.or_else(|rc| Err(format!("failed to persist db version: {}", rc)))?;
+    Ok(())
+}
+
 pub fn fill_db_version_if_needed(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
@@ -86,6 +114,12 @@ pub fn fill_db_version_if_needed(
         if (*ext_data).dbVersion != -1 && rc == 0 {
             return Ok(ResultCode::OK);
         }
+        if rc > 0 {
+            // another connection committed
+            crate::tableinfo::crsql_forget_max_db_versions(ext_data);
+            crate::config::refresh_implicit_column_clocks(db, ext_data)
+                .or_else(|_| Err("failed to read implicit-column-clocks"))?;
+        }
         fetch_db_version_from_storage(db, ext_data)
     }
 }
@@ -95,26 +129,11 @@ pub fn fetch_db_version_from_storage(
     ext_data: *mut crsql_ExtData,
 ) -> Result<ResultCode, String> {
     unsafe {
-        let schema_changed = if (*ext_data).pDbVersionStmt == ptr::null_mut() {
-            1 as c_int
-        } else {
-            crsql_fetchPragmaSchemaVersion(db, ext_data, DB_VERSION_SCHEMA_VERSION)
-        };
-
-        if schema_changed < 0 {
-            return Err("failed to fetch the pragma schema version".to_string());
-        }
-
-        if schema_changed > 0 {
-            match recreate_db_version_stmt(db, ext_data) {
-                Ok(ResultCode::DONE) => {
-                    // this means there are no clock tables / this is a clean db
-                    (*ext_data).dbVersion = 0;
-                    return Ok(ResultCode::OK);
-                }
-                Ok(_) => {}
-                Err(rc) => return Err(format!("failed to recreate db version stmt: {}", rc)),
-            }
+        // The db version lives in a single crsql_master row so the statement never needs
+        // to be rebuilt as clock tables come and go.
+        if (*ext_data).pDbVersionStmt == ptr::null_mut() {
+            recreate_db_version_stmt(db, ext_data)
+                .or_else(|rc| Err(format!("failed to recreate db version stmt: {}", rc)))?;
         }
 
         let db_version_stmt = (*ext_data).pDbVersionStmt;
@@ -0,0 +1,179 @@
+use core::ffi::{c_char, c_int};
+use core::mem::ManuallyDrop;
+
+use alloc::boxed::Box;
+use alloc::format;
+use alloc::string::String;
+use alloc::vec::Vec;
+use sqlite::{sqlite3, ColumnType, Connection, Context, ResultCode, Value};
+use sqlite_nostd as sqlite;
+
+use crate::c::crsql_ExtData;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+
+/**
+ * crsql_gc()
+ * crsql_gc(min_acked_version)
+ * crsql_gc(min_acked_version, max_rows)
+ *
+ * Removes delete tombstones, and the lookaside keys of those rows, that every
+ * peer has already seen. A tombstone is considered seen once its db_version is
+ * at or below `min_acked_version`. Without arguments the minimum version we've
+ * sent to any peer in `crsql_tracked_peers` is used.
+ *
+ * At most `max_rows` tombstones are removed per call so the write lock is never
+ * held for long. Call again, in a new transaction, until it returns 0.
+ *
+ * Note that a peer which has not seen a delete can resurrect the row once its
+ * tombstone is gone.
+ *
+ * Returns the number of tombstones removed.
+ */
+pub unsafe extern "C" fn x_crsql_gc(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc > 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_gc. Provide the minimum acknowledged db_version and, optionally, the max number of rows to remove.",
+        );
+        return;
+    }
+
+    let args = sqlite::args!(argc, argv);
+    let db = ctx.db_handle();
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+
+    let min_acked_version = if argc > 0 {
+        args[0].int64()
+    } else {
+        match min_version_sent_to_peers(db) {
+            Ok(Some(version)) => version,
+            // No peers to acknowledge anything. Nothing can be collected.
+            Ok(None) => {
+                ctx.result_int64(0);
+                return;
+            }
+            Err(_) => {
+                ctx.result_error("failed to read crsql_tracked_peers");
+                return;
+            }
+        }
+    };
+    let max_rows = if argc > 1 && args[1].value_type() != ColumnType::Null {
+        args[1].int64()
+    } else {
+        crate::consts::GC_DEFAULT_MAX_ROWS
+    };
+
+    if let Err(_) = db.exec_safe("SAVEPOINT gc") {
+        ctx.result_error("failed to start gc savepoint");
+        return;
+    }
+
+    match gc(db, ext_data, min_acked_version, max_rows) {
+        Ok(removed) => {
+            if let Err(_) = db.exec_safe("RELEASE gc") {
+                ctx.result_error("failed to release gc savepoint");
+                return;
+            }
+            ctx.result_int64(removed);
+        }
+        Err(msg) => {
+            let _ = db.exec_safe("ROLLBACK TO gc; RELEASE gc;");
+            ctx.result_error(&msg);
+        }
+    }
+}
+
+fn min_version_sent_to_peers(db: *mut sqlite3) -> Result<Option<i64>, ResultCode> {
+    let stmt = db.prepare_v2(&format!(
+        "SELECT min(version) FROM crsql_tracked_peers WHERE event = {}",
+        crate::consts::TRACKED_EVENT_SEND
+    ))?;
+    stmt.step()?;
+    if stmt.column_type(0)? == ColumnType::Null {
+        return Ok(None);
+    }
+    Ok(Some(stmt.column_int64(0)))
+}
+
+fn gc(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    min_acked_version: i64,
+    max_rows: i64,
+) -> Result<i64, String> {
+    let mut err: *mut c_char = core::ptr::null_mut();
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut err as *mut _);
+    if rc != ResultCode::OK as c_int {
+        return Err(format!(
+            "failed to ensure table infos are up to date: {}",
+            rc
+        ));
+    }
+
+    let table_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+
+    let mut removed = 0;
+    for tbl_info in table_infos.iter() {
+        if removed >= max_rows {
+            break;
+        }
+        removed += gc_table(db, tbl_info, min_acked_version, max_rows - removed)?;
+    }
+
+    Ok(removed)
+}
+
+fn gc_table(
+    db: *mut sqlite3,
+    tbl_info: &TableInfo,
+    min_acked_version: i64,
+    max_rows: i64,
+) -> Result<i64, String> {
+    let table_ident = crate::util::escape_ident(&tbl_info.tbl_name);
+
+    // An even causal length means the row is deleted. Once deleted, only the
+    // sentinel is left in the clock table for the row.
+    db.exec_safe(&format!(
+        "CREATE TEMP TABLE crsql_gc_keys AS
+          SELECT key FROM \"{table_ident}__crsql_clock\"
+          WHERE col_id = {sentinel_id} AND col_version % 2 = 0 AND db_version <= {min_acked_version}
+          LIMIT {max_rows}",
+        sentinel_id = crate::c::SENTINEL_COL_ID,
+    ))
+    .or_else(|_| {
+        Err(format!(
+            "failed to collect tombstones of {}",
+            tbl_info.tbl_name
+        ))
+    })?;
+
+    let removed = db
+        .prepare_v2("SELECT count(*) FROM temp.crsql_gc_keys")
+        .and_then(|stmt| {
+            stmt.step()?;
+            Ok(stmt.column_int64(0))
+        })
+        .or_else(|_| Err("failed to count tombstones"))?;
+
+    db.exec_safe(&format!(
+        "DELETE FROM \"{table_ident}__crsql_clock\" WHERE key IN (SELECT key FROM temp.crsql_gc_keys)"
+    ))
+    .or_else(|_| Err(format!("failed to remove tombstones of {}", tbl_info.tbl_name)))?;
+
+    if !tbl_info.key_is_pk {
+        db.exec_safe(&format!(
+            "DELETE FROM \"{table_ident}__crsql_pks\" WHERE __crsql_key IN (SELECT key FROM temp.crsql_gc_keys)"
+        ))
+        .or_else(|_| Err(format!("failed to remove lookaside keys of {}", tbl_info.tbl_name)))?;
+    }
+
+    db.exec_safe("DROP TABLE temp.crsql_gc_keys")
+        .or_else(|_| Err("failed to drop gc temp table"))?;
+
+    Ok(removed)
+}
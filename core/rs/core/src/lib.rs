@@ -10,6 +10,8 @@ mod backfill;
 pub mod bootstrap;
 #[cfg(not(feature = "test"))]
 mod bootstrap;
+mod bulk_delete;
+mod bulk_insert;
 #[cfg(feature = "test")]
 pub mod c;
 #[cfg(not(feature = "test"))]
@@ -17,6 +19,7 @@ mod c;
 mod changes_vtab;
 mod changes_vtab_read;
 mod changes_vtab_write;
+mod changeset;
 mod compare_values;
 mod config;
 mod consts;
@@ -27,12 +30,15 @@ pub mod db_version;
 #[cfg(not(feature = "test"))]
 mod db_version;
 mod ext_data;
+mod gc;
 mod is_crr;
 mod local_writes;
 #[cfg(feature = "test")]
 pub mod pack_columns;
 #[cfg(not(feature = "test"))]
 mod pack_columns;
+mod row_changes_vtab;
+mod schema_cache;
 mod sha;
 mod stmt_cache;
 #[cfg(feature = "test")]
@@ -53,11 +59,15 @@ extern crate alloc;
 use alter::crsql_compact_post_alter;
 use automigrate::*;
 use backfill::*;
+use bulk_delete::x_crsql_delete_where;
+use bulk_insert::x_crsql_bulk_insert;
 use c::{crsql_freeExtData, crsql_newExtData};
+use changeset::{x_crsql_changes_apply, x_crsql_changes_encode};
 use config::{crsql_config_get, crsql_config_set};
 use core::ffi::{c_int, c_void, CStr};
 use create_crr::create_crr;
 use db_version::{crsql_fill_db_version_if_needed, crsql_next_db_version};
+use gc::x_crsql_gc;
 use is_crr::*;
 use local_writes::after_delete::x_crsql_after_delete;
 use local_writes::after_insert::x_crsql_after_insert;
@@ -65,6 +75,7 @@ use local_writes::after_update::x_crsql_after_update;
 use sqlite::{Destructor, ResultCode};
 use sqlite_nostd as sqlite;
 use sqlite_nostd::{Connection, Context, Value};
+use stmt_cache::x_crsql_warmup;
 use tableinfo::{crsql_ensure_table_infos_are_up_to_date, is_table_compatible, pull_table_info};
 use teardown::*;
 use triggers::create_triggers;
@@ -141,6 +152,22 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    let rc = db
+        .create_function_v2(
+            "crsql_pack_columns_v2",
+            -1,
+            sqlite::UTF8,
+            None,
+            Some(pack_columns::crsql_pack_columns_v2),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(sqlite::ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_as_table",
@@ -219,6 +246,12 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    let rc = row_changes_vtab::create_module(db, ext_data).unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_site_id",
@@ -321,6 +354,24 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    // crsql_increment_and_get_seq(n) reserves n seqs for set based writes. See `backfill_table`.
+    let rc = db
+        .create_function_v2(
+            "crsql_increment_and_get_seq",
+            1,
+            sqlite::UTF8 | sqlite::INNOCUOUS,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_increment_and_get_seq),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_get_seq",
@@ -360,7 +411,7 @@ pub extern "C" fn sqlite3_crsqlcore_init(
             "crsql_begin_alter",
             -1,
             sqlite::UTF8 | sqlite::DIRECTONLY,
-            None,
+            Some(ext_data as *mut c_void),
             Some(x_crsql_begin_alter),
             None,
             None,
@@ -389,6 +440,125 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    let rc = db
+        .create_function_v2(
+            "crsql_delete_where",
+            2,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_delete_where),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_bulk_insert",
+            2,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_bulk_insert),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_changes_encode",
+            -1,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            None,
+            Some(x_crsql_changes_encode),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_changes_apply",
+            1,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            None,
+            Some(x_crsql_changes_apply),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_backfill_step",
+            2,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_backfill_step),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_gc",
+            -1,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_gc),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_warmup",
+            -1,
+            sqlite::UTF8 | sqlite::DIRECTONLY,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_warmup),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_finalize",
@@ -635,6 +805,18 @@ unsafe extern "C" fn x_crsql_begin_alter(
         let _ = db.exec_safe("ROLLBACK");
         return;
     }
+    // Rows written from here on go untracked. See `commit_column_alter`.
+    let ext_data = ctx.user_data() as *mut c::crsql_ExtData;
+    if (*ext_data).totalChangesAtBeginAlter < 0 {
+        match alter::total_changes(db) {
+            Ok(total_changes) => (*ext_data).totalChangesAtBeginAlter = total_changes,
+            Err(rc) => {
+                sqlite::result_error_code(ctx, rc as c_int);
+                let _ = db.exec_safe("ROLLBACK");
+                return;
+            }
+        }
+    }
     ctx.result_text_static("OK");
 }
 
@@ -664,6 +846,14 @@ unsafe extern "C" fn x_crsql_commit_alter(
     let mut err_msg = null_mut();
     let db = ctx.db_handle();
 
+    // Columns added by the alter need ids before the table's schema is pulled again.
+    if let Err(rc) = crate::bootstrap::register_clock_columns(db, table_name) {
+        ctx.result_error("failed to assign ids to the columns of the altered table");
+        sqlite::result_error_code(ctx, rc as c_int);
+        let _ = db.exec_safe("ROLLBACK");
+        return;
+    }
+
     let rc = if non_destructive {
         match pull_table_info(db, table_name, &mut err_msg as *mut _) {
             Ok(table_info) => {
@@ -682,24 +872,30 @@ unsafe extern "C" fn x_crsql_commit_alter(
             Err(rc) => rc as c_int,
         }
     } else {
-        let rc = crsql_compact_post_alter(
-            db,
-            table_name.as_ptr() as *const c_char,
-            ext_data,
-            &mut err_msg as *mut _,
-        );
-
-        if rc == ResultCode::OK as c_int {
-            crsql_create_crr(
-                db,
-                schema_name.as_ptr() as *const c_char,
-                table_name.as_ptr() as *const c_char,
-                1,
-                0,
-                &mut err_msg as *mut _,
-            )
-        } else {
-            rc
+        match alter::commit_column_alter(db, table_name, ext_data, &mut err_msg as *mut _) {
+            Ok(true) => ResultCode::OK as c_int,
+            Ok(false) => {
+                let rc = crsql_compact_post_alter(
+                    db,
+                    table_name.as_ptr() as *const c_char,
+                    ext_data,
+                    &mut err_msg as *mut _,
+                );
+
+                if rc == ResultCode::OK as c_int {
+                    crsql_create_crr(
+                        db,
+                        schema_name.as_ptr() as *const c_char,
+                        table_name.as_ptr() as *const c_char,
+                        1,
+                        0,
+                        &mut err_msg as *mut _,
+                    )
+                } else {
+                    rc
+                }
+            }
+            Err(rc) => rc as c_int,
         }
     };
 
@@ -728,12 +924,17 @@ unsafe extern "C" fn x_crsql_get_seq(
 
 unsafe extern "C" fn x_crsql_increment_and_get_seq(
     ctx: *mut sqlite::context,
-    _argc: i32,
-    _argv: *mut *mut sqlite::value,
+    argc: i32,
+    argv: *mut *mut sqlite::value,
 ) {
     let ext_data = ctx.user_data() as *mut c::crsql_ExtData;
     ctx.result_int((*ext_data).seq);
-    (*ext_data).seq += 1;
+    if argc == 1 {
+        let args = sqlite::args!(argc, argv);
+        (*ext_data).seq += args[0].int();
+    } else {
+        (*ext_data).seq += 1;
+    }
 }
 
 /**
@@ -40,6 +40,7 @@ fn after_delete(
     pks_old: &[*mut value],
 ) -> Result<ResultCode, String> {
     let db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+    tbl_info.note_db_version(db_version);
     let seq = bump_seq(ext_data);
     let key = tbl_info
         .get_or_create_key_via_raw_values(db, pks_old)
@@ -40,6 +40,7 @@ fn after_insert(
     pks_new: &[*mut value],
 ) -> Result<ResultCode, String> {
     let db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+    tbl_info.note_db_version(db_version);
     let (create_record_existed, key_new) = tbl_info
         .get_or_create_key_for_insert(db, pks_new)
         .or_else(|_| Err("failed geteting or creating lookaside key"))?;
@@ -47,29 +48,38 @@ fn after_insert(
         let seq = bump_seq(ext_data);
         // just a sentinel record
         return super::mark_new_pk_row_created(db, tbl_info, key_new, db_version, seq);
+    } else if !create_record_existed && super::implicit_column_clocks(ext_data) {
+        // A brand new row. The sentinel stands in for every column's clock.
+        let seq = bump_seq(ext_data);
+        super::mark_new_pk_row_created(db, tbl_info, key_new, db_version, seq)?;
+        // reserve a seq for each implicit column so the changes read out of
+        // this row don't collide with later writes in the same transaction.
+        unsafe { (*ext_data).seq += tbl_info.non_pks.len() as c_int };
+        return Ok(ResultCode::OK);
     } else if create_record_existed {
         // update the create record since it already exists.
         let seq = bump_seq(ext_data);
-        update_create_record(db, tbl_info, key_new, db_version, seq)?;
+        update_create_record(db, ext_data, tbl_info, key_new, db_version, seq)?;
     }
 
     // now for each non-pk column, create or update the column record
     for col in tbl_info.non_pks.iter() {
         let seq = bump_seq(ext_data);
-        super::mark_locally_updated(db, tbl_info, key_new, col, db_version, seq)?;
+        super::mark_locally_updated(db, ext_data, tbl_info, key_new, col, db_version, seq)?;
     }
     Ok(ResultCode::OK)
 }
 
 fn update_create_record(
     db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
     new_key: sqlite::int64,
     db_version: sqlite::int64,
     seq: i32,
 ) -> Result<ResultCode, String> {
     let update_create_record_stmt_ref = tbl_info
-        .get_maybe_mark_locally_reinserted_stmt(db)
+        .get_maybe_mark_locally_reinserted_stmt(db, super::implicit_column_clocks(ext_data))
         .or_else(|_e| Err("failed to get update_create_record_stmt"))?;
     let update_create_record_stmt = update_create_record_stmt_ref
         .as_ref()
@@ -79,13 +89,7 @@ fn update_create_record(
         .bind_int64(1, db_version)
         .and_then(|_| update_create_record_stmt.bind_int(2, seq))
         .and_then(|_| update_create_record_stmt.bind_int64(3, new_key))
-        .and_then(|_| {
-            update_create_record_stmt.bind_text(
-                4,
-                crate::c::INSERT_SENTINEL,
-                sqlite::Destructor::STATIC,
-            )
-        })
+        .and_then(|_| update_create_record_stmt.bind_int64(4, crate::c::SENTINEL_COL_ID))
         .or_else(|_e| Err("failed binding to update_create_record_stmt"))?;
 
     super::step_trigger_stmt(update_create_record_stmt)
@@ -72,6 +72,7 @@ fn after_update(
     non_pks_old: &[*mut value],
 ) -> Result<ResultCode, String> {
     let next_db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+    tbl_info.note_db_version(next_db_version);
     let new_key = tbl_info
         .get_or_create_key_via_raw_values(db, pks_new)
         .or_else(|_| Err("failed geteting or creating lookaside key"))?;
@@ -82,6 +83,11 @@ fn after_update(
         let old_key = tbl_info
             .get_or_create_key_via_raw_values(db, pks_old)
             .or_else(|_| Err("failed geteting or creating lookaside key"))?;
+        if super::implicit_column_clocks(ext_data) {
+            // Column clocks that are implicit on the old row would be lost once its
+            // sentinel is marked deleted. Write them out so they can be moved.
+            after_update__materialize_implicit_clocks(db, tbl_info, old_key)?;
+        }
         let next_seq = super::bump_seq(ext_data);
         // Record the delete of the row identified by the old primary keys
         after_update__mark_old_pk_row_deleted(db, tbl_info, old_key, next_db_version, next_seq)?;
@@ -94,6 +100,10 @@ fn after_update(
         // so we can get to this when CL is stored in the lookaside.
         let next_seq = super::bump_seq(ext_data);
         super::mark_new_pk_row_created(db, tbl_info, new_key, next_db_version, next_seq)?;
+        if super::implicit_column_clocks(ext_data) {
+            // the new row's sentinel may be implicit for columns that weren't moved.
+            unsafe { (*ext_data).seq += tbl_info.non_pks.len() as c_int };
+        }
         // }
     }
 
@@ -110,6 +120,7 @@ fn after_update(
             // we need to track crdt metadata
             super::mark_locally_updated(
                 db,
+                ext_data,
                 tbl_info,
                 new_key,
                 col_info,
@@ -146,6 +157,25 @@ fn after_update__mark_old_pk_row_deleted(
     super::step_trigger_stmt(mark_locally_deleted_stmt)
 }
 
+#[allow(non_snake_case)]
+fn after_update__materialize_implicit_clocks(
+    db: *mut sqlite3,
+    tbl_info: &TableInfo,
+    old_key: sqlite::int64,
+) -> Result<ResultCode, String> {
+    let materialize_stmt_ref = tbl_info
+        .get_materialize_implicit_clocks_stmt(db)
+        .or_else(|_| Err("failed to get materialize_implicit_clocks_stmt"))?;
+    let materialize_stmt = materialize_stmt_ref
+        .as_ref()
+        .ok_or("Failed to deref materialize_implicit_clocks_stmt")?;
+
+    materialize_stmt
+        .bind_int64(1, old_key)
+        .or_else(|_| Err("failed to bind key to materialize_implicit_clocks_stmt"))?;
+    super::step_trigger_stmt(materialize_stmt)
+}
+
 // TODO: in the future we can keep sentinel information in the lookaside
 #[allow(non_snake_case)]
 fn after_update__move_non_sentinels(
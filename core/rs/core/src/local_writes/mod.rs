@@ -107,9 +107,14 @@ fn bump_seq(ext_data: *mut crsql_ExtData) -> c_int {
     }
 }
 
+fn implicit_column_clocks(ext_data: *mut crsql_ExtData) -> bool {
+    unsafe { (*ext_data).implicitColumnClocks != 0 }
+}
+
 #[allow(non_snake_case)]
 fn mark_locally_updated(
     db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
     new_key: sqlite::int64,
     col_info: &ColumnInfo,
@@ -117,7 +122,7 @@ fn mark_locally_updated(
     seq: i32,
 ) -> Result<ResultCode, String> {
     let mark_locally_updated_stmt_ref = tbl_info
-        .get_mark_locally_updated_stmt(db)
+        .get_mark_locally_updated_stmt(db, implicit_column_clocks(ext_data))
         .or_else(|_e| Err("failed to get mark_locally_updated_stmt"))?;
     let mark_locally_updated_stmt = mark_locally_updated_stmt_ref
         .as_ref()
@@ -125,9 +130,7 @@ fn mark_locally_updated(
 
     mark_locally_updated_stmt
         .bind_int64(1, new_key)
-        .and_then(|_| {
-            mark_locally_updated_stmt.bind_text(2, &col_info.name, sqlite::Destructor::STATIC)
-        })
+        .and_then(|_| mark_locally_updated_stmt.bind_int64(2, col_info.col_id))
         .and_then(|_| mark_locally_updated_stmt.bind_int64(3, db_version))
         .and_then(|_| mark_locally_updated_stmt.bind_int(4, seq))
         .and_then(|_| mark_locally_updated_stmt.bind_int64(5, db_version))
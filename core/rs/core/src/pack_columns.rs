@@ -1,5 +1,6 @@
 extern crate alloc;
 
+use alloc::borrow::Cow;
 use alloc::string::String;
 use alloc::vec;
 use alloc::vec::Vec;
@@ -15,21 +16,44 @@ pub extern "C" fn crsql_pack_columns(
     argv: *mut *mut sqlite::value,
 ) {
     let args = sqlite::args!(argc, argv);
+    result_package(ctx, pack_columns(args));
+}
+
+/**
+ * Packs columns in the v2 format. Unlike v1, packages of the same number of columns
+ * compare with memcmp the way SQLite orders the packed values.
+ */
+pub extern "C" fn crsql_pack_columns_v2(
+    ctx: *mut sqlite::context,
+    argc: i32,
+    argv: *mut *mut sqlite::value,
+) {
+    let args = sqlite::args!(argc, argv);
+    result_package(ctx, pack_columns_v2(args));
+}
 
-    match pack_columns(args) {
+fn result_package(ctx: *mut sqlite::context, package: Result<Vec<u8>, ResultCode>) {
+    match package {
         Err(code) => {
             ctx.result_error("Failed to pack columns");
             ctx.result_error_code(code);
         }
         Ok(blob) => {
-            // TODO: pass a destructor so we don't have to copy the blob
-            ctx.result_blob_owned(blob);
+            // The bundle allocates through sqlite3_malloc so SQLite can take the buffer as is
+            // and free it when done with it.
+            let (ptr, len, _) = blob.into_raw_parts();
+            sqlite::result_blob(
+                ctx,
+                ptr,
+                len as i32,
+                sqlite::Destructor::CUSTOM(crate::crsql_sqlite_free),
+            );
         }
     }
 }
 
 fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
-    let mut buf = vec![];
+    let mut buf = Vec::with_capacity(packed_size(args));
     /*
      * Format:
      * [num_columns:u8,...[(type(0-3),num_bytes?(3-7)):u8, length?:i32, ...bytes:u8[]]]
@@ -46,38 +70,7 @@ fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
     if let Ok(len) = len_result {
         buf.put_u8(len);
         for value in args {
-            match value.value_type() {
-                ColumnType::Blob => {
-                    let len = value.bytes();
-                    let num_bytes_for_len = num_bytes_needed_i32(len);
-                    let type_byte = num_bytes_for_len << 3 | (ColumnType::Blob as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(len as i64, num_bytes_for_len as usize);
-                    buf.put_slice(value.blob());
-                }
-                ColumnType::Null => {
-                    buf.put_u8(ColumnType::Null as u8);
-                }
-                ColumnType::Float => {
-                    buf.put_u8(ColumnType::Float as u8);
-                    buf.put_f64(value.double());
-                }
-                ColumnType::Integer => {
-                    let val = value.int64();
-                    let num_bytes_for_int = num_bytes_needed_i64(val);
-                    let type_byte = num_bytes_for_int << 3 | (ColumnType::Integer as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(val, num_bytes_for_int as usize);
-                }
-                ColumnType::Text => {
-                    let len = value.bytes();
-                    let num_bytes_for_len = num_bytes_needed_i32(len);
-                    let type_byte = num_bytes_for_len << 3 | (ColumnType::Text as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(len as i64, num_bytes_for_len as usize);
-                    buf.put_slice(value.blob());
-                }
-            }
+            pack_value(&mut buf, *value);
         }
         Ok(buf)
     } else {
@@ -85,6 +78,279 @@ fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
     }
 }
 
+/**
+ * Appends `value` to `buf` as a single v1 column: the type byte then its bytes.
+ */
+pub fn pack_value(buf: &mut Vec<u8>, value: *mut sqlite::value) {
+    match value.value_type() {
+        ColumnType::Blob => {
+            let len = value.bytes();
+            let num_bytes_for_len = num_bytes_needed_i32(len);
+            let type_byte = num_bytes_for_len << 3 | (ColumnType::Blob as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(len as i64, num_bytes_for_len as usize);
+            buf.put_slice(value.blob());
+        }
+        ColumnType::Null => {
+            buf.put_u8(ColumnType::Null as u8);
+        }
+        ColumnType::Float => {
+            buf.put_u8(ColumnType::Float as u8);
+            buf.put_f64(value.double());
+        }
+        ColumnType::Integer => {
+            let val = value.int64();
+            let num_bytes_for_int = num_bytes_needed_i64(val);
+            let type_byte = num_bytes_for_int << 3 | (ColumnType::Integer as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(val, num_bytes_for_int as usize);
+        }
+        ColumnType::Text => {
+            let len = value.bytes();
+            let num_bytes_for_len = num_bytes_needed_i32(len);
+            let type_byte = num_bytes_for_len << 3 | (ColumnType::Text as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(len as i64, num_bytes_for_len as usize);
+            buf.put_slice(value.blob());
+        }
+    }
+}
+
+/*
+ * v2 Format:
+ * [0x00, 0x02, ...[tag:u8, ...payload]]
+ *
+ * A v1 package starts with its column count. The only v1 package starting with 0 is
+ * the empty one, which is a single byte, so the two byte header is unambiguous.
+ *
+ * Every column is self delimiting and the bytes of each column sort the way SQLite
+ * sorts values: NULL, then numbers, then text, then blobs.
+ * - NULL: tag only.
+ * - numbers: ints and reals compare with one another by value so they share a tag.
+ *   The payload is the value as an order preserving f64, then a subtype byte.
+ *   Reals and ints that an f64 holds exactly stop there. Larger ints round when
+ *   converted so the subtype records the sign of the rounding error and is
+ *   followed by the error itself as an order preserving i64.
+ * - text & blobs: the bytes with every 0x00 escaped as 0x00 0xFF, then 0x00 0x00.
+ *   The terminator sorts before any byte so shorter prefixes sort first.
+ *
+ * Text is compared bytewise which matches the BINARY collation.
+ */
+const V2_HEADER: [u8; 2] = [0x00, 0x02];
+
+const V2_NULL: u8 = 0x05;
+const V2_NUMBER: u8 = 0x15;
+const V2_TEXT: u8 = 0x25;
+const V2_BLOB: u8 = 0x35;
+
+const V2_INT_ROUNDED_UP: u8 = 0x00;
+const V2_REAL: u8 = 0x01;
+const V2_INT: u8 = 0x02;
+const V2_INT_ROUNDED_DOWN: u8 = 0x03;
+
+fn pack_columns_v2(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
+    let mut buf = Vec::with_capacity(packed_size_v2(args));
+    buf.put_slice(&V2_HEADER);
+    for value in args {
+        match value.value_type() {
+            ColumnType::Null => {
+                buf.put_u8(V2_NULL);
+            }
+            ColumnType::Integer => {
+                buf.put_u8(V2_NUMBER);
+                put_v2_integer(&mut buf, value.int64());
+            }
+            ColumnType::Float => {
+                buf.put_u8(V2_NUMBER);
+                put_ordered_f64(&mut buf, value.double());
+                buf.put_u8(V2_REAL);
+            }
+            ColumnType::Text => {
+                buf.put_u8(V2_TEXT);
+                put_escaped(&mut buf, value.blob());
+            }
+            ColumnType::Blob => {
+                buf.put_u8(V2_BLOB);
+                put_escaped(&mut buf, value.blob());
+            }
+        }
+    }
+    Ok(buf)
+}
+
+fn put_v2_integer(buf: &mut Vec<u8>, val: i64) {
+    let approx = val as f64;
+    // Exact. Every integer an f64 rounds to fits in an i128.
+    let error = val as i128 - approx as i128;
+    put_ordered_f64(buf, approx);
+    if error == 0 {
+        buf.put_u8(V2_INT);
+    } else {
+        // The value is below `approx` when it was rounded up and above it when rounded down.
+        buf.put_u8(if error < 0 {
+            V2_INT_ROUNDED_UP
+        } else {
+            V2_INT_ROUNDED_DOWN
+        });
+        buf.put_u64(error as i64 as u64 ^ (1 << 63));
+    }
+}
+
+fn put_ordered_f64(buf: &mut Vec<u8>, val: f64) {
+    // -0.0 == 0.0 in SQLite
+    let bits = if val == 0.0 { 0 } else { val.to_bits() };
+    // Flip negatives entirely so larger magnitudes sort first. Set the sign bit of
+    // positives so they sort after all negatives.
+    buf.put_u64(if bits >> 63 == 1 {
+        !bits
+    } else {
+        bits | (1 << 63)
+    });
+}
+
+fn get_ordered_f64(buf: &mut &[u8]) -> f64 {
+    let key = buf.get_u64();
+    f64::from_bits(if key >> 63 == 1 {
+        key & !(1 << 63)
+    } else {
+        !key
+    })
+}
+
+fn put_escaped(buf: &mut Vec<u8>, bytes: &[u8]) {
+    for b in bytes {
+        buf.put_u8(*b);
+        if *b == 0 {
+            buf.put_u8(0xFF);
+        }
+    }
+    buf.put_u8(0x00);
+    buf.put_u8(0x00);
+}
+
+/**
+ * Takes an escaped run of bytes, and its terminator, off the front of `buf`.
+ * Only allocates if the bytes contained an escaped 0x00.
+ */
+fn take_escaped<'a>(buf: &mut &'a [u8]) -> Result<Cow<'a, [u8]>, ResultCode> {
+    let data: &'a [u8] = buf;
+    let mut unescaped: Option<Vec<u8>> = None;
+    let mut i = 0;
+    loop {
+        if i >= data.len() {
+            return Err(ResultCode::ABORT);
+        }
+        if data[i] != 0 {
+            if let Some(unescaped) = unescaped.as_mut() {
+                unescaped.push(data[i]);
+            }
+            i += 1;
+            continue;
+        }
+        if i + 1 >= data.len() {
+            return Err(ResultCode::ABORT);
+        }
+        match data[i + 1] {
+            0x00 => {
+                *buf = &data[i + 2..];
+                return Ok(match unescaped {
+                    Some(unescaped) => Cow::Owned(unescaped),
+                    None => Cow::Borrowed(&data[..i]),
+                });
+            }
+            0xFF => {
+                unescaped
+                    .get_or_insert_with(|| data[..i].to_vec())
+                    .push(0x00);
+                i += 2;
+            }
+            _ => return Err(ResultCode::ABORT),
+        }
+    }
+}
+
+fn unpack_columns_v2<'a>(data: &'a [u8], ret: &mut ColumnValueRefs<'a>) -> Result<(), ResultCode> {
+    let mut buf = &data[V2_HEADER.len()..];
+    while buf.has_remaining() {
+        match buf.get_u8() {
+            V2_NULL => ret.push(ColumnValueRef::Null),
+            V2_NUMBER => {
+                if buf.remaining() < 9 {
+                    return Err(ResultCode::ABORT);
+                }
+                let approx = get_ordered_f64(&mut buf);
+                let subtype = buf.get_u8();
+                let value = match subtype {
+                    V2_REAL => ColumnValueRef::Float(approx),
+                    V2_INT => ColumnValueRef::Integer(approx as i128 as i64),
+                    V2_INT_ROUNDED_UP | V2_INT_ROUNDED_DOWN => {
+                        if buf.remaining() < 8 {
+                            return Err(ResultCode::ABORT);
+                        }
+                        let error = (buf.get_u64() ^ (1 << 63)) as i64;
+                        ColumnValueRef::Integer((approx as i128 + error as i128) as i64)
+                    }
+                    _ => return Err(ResultCode::MISUSE),
+                };
+                ret.push(value);
+            }
+            V2_TEXT => {
+                let bytes = take_escaped(&mut buf)?;
+                ret.push(ColumnValueRef::Text(match bytes {
+                    Cow::Borrowed(b) => Cow::Borrowed(unsafe { core::str::from_utf8_unchecked(b) }),
+                    Cow::Owned(b) => Cow::Owned(unsafe { String::from_utf8_unchecked(b) }),
+                }));
+            }
+            V2_BLOB => {
+                let bytes = take_escaped(&mut buf)?;
+                ret.push(ColumnValueRef::Blob(bytes));
+            }
+            _ => return Err(ResultCode::MISUSE),
+        }
+    }
+    Ok(())
+}
+
+// Exact size of the v1 package of `args` so the buffer is allocated once.
+fn packed_size(args: &[*mut sqlite::value]) -> usize {
+    1 + args
+        .iter()
+        .map(|value| match value.value_type() {
+            ColumnType::Blob | ColumnType::Text => {
+                let len = value.bytes();
+                1 + num_bytes_needed_i32(len) as usize + len as usize
+            }
+            ColumnType::Null => 1,
+            ColumnType::Float => 9,
+            ColumnType::Integer => 1 + num_bytes_needed_i64(value.int64()) as usize,
+        })
+        .sum::<usize>()
+}
+
+// Exact size of the v2 package of `args` so the buffer is allocated once.
+fn packed_size_v2(args: &[*mut sqlite::value]) -> usize {
+    V2_HEADER.len()
+        + args
+            .iter()
+            .map(|value| match value.value_type() {
+                ColumnType::Blob | ColumnType::Text => {
+                    let bytes = value.blob();
+                    1 + bytes.len() + bytes.iter().filter(|b| **b == 0).count() + 2
+                }
+                ColumnType::Null => 1,
+                ColumnType::Float => 10,
+                ColumnType::Integer => {
+                    let val = value.int64();
+                    if val as f64 as i128 == val as i128 {
+                        10
+                    } else {
+                        18
+                    }
+                }
+            })
+            .sum::<usize>()
+}
+
 fn num_bytes_needed_i32(val: i32) -> u8 {
     if val & 0xFF000000u32 as i32 != 0 {
         return 4;
@@ -121,70 +387,190 @@ pub enum ColumnValue {
     Text(String),
 }
 
+/**
+ * A column value that borrows its bytes from the packed buffer it was decoded from.
+ * Decoding and binding these never copies blob and text pks. The only exception is
+ * a v2 package whose text or blob contains an escaped 0x00, which is unescaped into
+ * an owned copy.
+ */
+#[derive(Clone)]
+pub enum ColumnValueRef<'a> {
+    Blob(Cow<'a, [u8]>),
+    Float(f64),
+    Integer(i64),
+    Null,
+    Text(Cow<'a, str>),
+}
+
+const NULL_REF: ColumnValueRef<'static> = ColumnValueRef::Null;
+
+impl<'a> ColumnValueRef<'a> {
+    pub fn to_owned(&self) -> ColumnValue {
+        match self {
+            ColumnValueRef::Blob(b) => ColumnValue::Blob(b.to_vec()),
+            ColumnValueRef::Float(f) => ColumnValue::Float(*f),
+            ColumnValueRef::Integer(i) => ColumnValue::Integer(*i),
+            ColumnValueRef::Null => ColumnValue::Null,
+            ColumnValueRef::Text(t) => ColumnValue::Text(String::from(t.as_ref())),
+        }
+    }
+}
+
+// Most primary keys have only a handful of columns. Those are kept inline.
+const INLINE_COLUMNS: usize = 4;
+
+/**
+ * Small vector of unpacked columns. Up to `INLINE_COLUMNS` values are held
+ * inline so decoding a typical pk does not touch the heap at all.
+ * Can be `clear`ed and refilled to reuse any spilled allocation.
+ */
+pub struct ColumnValueRefs<'a> {
+    inline: [ColumnValueRef<'a>; INLINE_COLUMNS],
+    len: usize,
+    spilled: Vec<ColumnValueRef<'a>>,
+}
+
+impl<'a> ColumnValueRefs<'a> {
+    pub fn new() -> Self {
+        ColumnValueRefs {
+            inline: [NULL_REF; INLINE_COLUMNS],
+            len: 0,
+            spilled: vec![],
+        }
+    }
+
+    pub fn clear(&mut self) {
+        for value in self.inline.iter_mut().take(self.len) {
+            *value = NULL_REF;
+        }
+        self.len = 0;
+        self.spilled.clear();
+    }
+
+    pub fn push(&mut self, value: ColumnValueRef<'a>) {
+        if self.len < INLINE_COLUMNS {
+            self.inline[self.len] = value;
+        } else {
+            if self.len == INLINE_COLUMNS {
+                self.spilled.extend(
+                    self.inline
+                        .iter_mut()
+                        .map(|v| core::mem::replace(v, NULL_REF)),
+                );
+            }
+            self.spilled.push(value);
+        }
+        self.len += 1;
+    }
+}
+
+impl<'a> core::ops::Deref for ColumnValueRefs<'a> {
+    type Target = [ColumnValueRef<'a>];
+
+    fn deref(&self) -> &Self::Target {
+        if self.len <= INLINE_COLUMNS {
+            &self.inline[..self.len]
+        } else {
+            &self.spilled
+        }
+    }
+}
+
 // TODO: make a table valued function that can be used to extract a row per packed column?
 pub fn unpack_columns(data: &[u8]) -> Result<Vec<ColumnValue>, ResultCode> {
-    let mut ret = vec![];
+    let unpacked = unpack_columns_ref(data)?;
+    Ok(unpacked.iter().map(|v| v.to_owned()).collect())
+}
+
+/**
+ * Decodes `data` without copying. The returned values borrow from `data`.
+ */
+pub fn unpack_columns_ref<'a>(data: &'a [u8]) -> Result<ColumnValueRefs<'a>, ResultCode> {
+    let mut ret = ColumnValueRefs::new();
+    unpack_columns_into(data, &mut ret)?;
+    Ok(ret)
+}
+
+pub fn unpack_columns_into<'a>(
+    data: &'a [u8],
+    ret: &mut ColumnValueRefs<'a>,
+) -> Result<(), ResultCode> {
+    ret.clear();
+    if data.starts_with(&V2_HEADER) {
+        return unpack_columns_v2(data, ret);
+    }
     let mut buf = data;
+    if !buf.has_remaining() {
+        return Err(ResultCode::ABORT);
+    }
     let num_columns = buf.get_u8();
 
     for _i in 0..num_columns {
-        if !buf.has_remaining() {
-            return Err(ResultCode::ABORT);
-        }
-        let column_type_and_maybe_intlen = buf.get_u8();
-        let column_type = ColumnType::from_u8(column_type_and_maybe_intlen & 0x07);
-        let intlen = (column_type_and_maybe_intlen >> 3 & 0xFF) as usize;
+        ret.push(unpack_value(&mut buf)?);
+    }
 
-        match column_type {
-            Some(ColumnType::Blob) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                let len = buf.get_int(intlen) as usize;
-                if buf.remaining() < len {
-                    return Err(ResultCode::ABORT);
-                }
-                let bytes = buf.copy_to_bytes(len);
-                ret.push(ColumnValue::Blob(bytes.to_vec()));
-            }
-            Some(ColumnType::Float) => {
-                if buf.remaining() < 8 {
-                    return Err(ResultCode::ABORT);
-                }
-                ret.push(ColumnValue::Float(buf.get_f64()));
-            }
-            Some(ColumnType::Integer) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                ret.push(ColumnValue::Integer(buf.get_int(intlen)));
-            }
-            Some(ColumnType::Null) => {
-                ret.push(ColumnValue::Null);
-            }
-            Some(ColumnType::Text) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                let len = buf.get_int(intlen) as usize;
-                if buf.remaining() < len {
-                    return Err(ResultCode::ABORT);
-                }
-                let bytes = buf.copy_to_bytes(len);
-                ret.push(ColumnValue::Text(unsafe {
-                    String::from_utf8_unchecked(bytes.to_vec())
-                }))
+    Ok(())
+}
+
+/**
+ * Decodes a single v1 column from the front of `buf`, advancing past it.
+ * The value borrows from `buf`.
+ */
+pub fn unpack_value<'a>(buf: &mut &'a [u8]) -> Result<ColumnValueRef<'a>, ResultCode> {
+    if !buf.has_remaining() {
+        return Err(ResultCode::ABORT);
+    }
+    let column_type_and_maybe_intlen = buf.get_u8();
+    let column_type = ColumnType::from_u8(column_type_and_maybe_intlen & 0x07);
+    let intlen = (column_type_and_maybe_intlen >> 3 & 0xFF) as usize;
+
+    match column_type {
+        Some(ColumnType::Blob) => {
+            let bytes = take_sized(buf, intlen)?;
+            Ok(ColumnValueRef::Blob(Cow::Borrowed(bytes)))
+        }
+        Some(ColumnType::Float) => {
+            if buf.remaining() < 8 {
+                return Err(ResultCode::ABORT);
             }
-            None => return Err(ResultCode::MISUSE),
+            Ok(ColumnValueRef::Float(buf.get_f64()))
         }
+        // Negative ints are always packed in 8 bytes so there is nothing to sign extend.
+        Some(ColumnType::Integer) => Ok(ColumnValueRef::Integer(take_uint(buf, intlen)? as i64)),
+        Some(ColumnType::Null) => Ok(ColumnValueRef::Null),
+        Some(ColumnType::Text) => {
+            let bytes = take_sized(buf, intlen)?;
+            Ok(ColumnValueRef::Text(Cow::Borrowed(unsafe {
+                core::str::from_utf8_unchecked(bytes)
+            })))
+        }
+        None => Err(ResultCode::MISUSE),
+    }
+}
+
+// Reads a length prefixed run of bytes, returning a slice of the input rather than a copy.
+fn take_sized<'a>(buf: &mut &'a [u8], intlen: usize) -> Result<&'a [u8], ResultCode> {
+    let len = usize::try_from(take_uint(buf, intlen)?).or(Err(ResultCode::ABORT))?;
+    if buf.remaining() < len {
+        return Err(ResultCode::ABORT);
     }
+    let (bytes, rest) = buf.split_at(len);
+    *buf = rest;
+    Ok(bytes)
+}
 
-    Ok(ret)
+// Reads the `intlen` byte big endian integer following a type byte.
+// The type byte has room for lengths up to 31 but packing never writes more than 8.
+fn take_uint(buf: &mut &[u8], intlen: usize) -> Result<u64, ResultCode> {
+    if intlen > 8 || buf.remaining() < intlen {
+        return Err(ResultCode::ABORT);
+    }
+    Ok(buf.get_uint(intlen))
 }
 
 pub fn bind_package_to_stmt(
     stmt: *mut sqlite::stmt,
-    values: &Vec<ColumnValue>,
+    values: &[ColumnValueRef],
     offset: usize,
 ) -> Result<ResultCode, ResultCode> {
     for (i, val) in values.iter().enumerate() {
@@ -195,14 +581,26 @@ pub fn bind_package_to_stmt(
 
 fn bind_slot(
     slot_num: usize,
-    val: &ColumnValue,
+    val: &ColumnValueRef,
     stmt: *mut sqlite::stmt,
 ) -> Result<ResultCode, ResultCode> {
+    // Borrowed values are bound without a copy. The packed pks must outlive the statement's use
+    // of the binding. Owned values are dropped with `val` so SQLite takes its own copy.
     match val {
-        ColumnValue::Blob(b) => stmt.bind_blob(slot_num as i32, b, sqlite::Destructor::STATIC),
-        ColumnValue::Float(f) => stmt.bind_double(slot_num as i32, *f),
-        ColumnValue::Integer(i) => stmt.bind_int64(slot_num as i32, *i),
-        ColumnValue::Null => stmt.bind_null(slot_num as i32),
-        ColumnValue::Text(t) => stmt.bind_text(slot_num as i32, t, sqlite::Destructor::STATIC),
+        ColumnValueRef::Blob(Cow::Borrowed(b)) => {
+            stmt.bind_blob(slot_num as i32, b, sqlite::Destructor::STATIC)
+        }
+        ColumnValueRef::Blob(Cow::Owned(b)) => {
+            stmt.bind_blob(slot_num as i32, b, sqlite::Destructor::TRANSIENT)
+        }
+        ColumnValueRef::Float(f) => stmt.bind_double(slot_num as i32, *f),
+        ColumnValueRef::Integer(i) => stmt.bind_int64(slot_num as i32, *i),
+        ColumnValueRef::Null => stmt.bind_null(slot_num as i32),
+        ColumnValueRef::Text(Cow::Borrowed(t)) => {
+            stmt.bind_text(slot_num as i32, t, sqlite::Destructor::STATIC)
+        }
+        ColumnValueRef::Text(Cow::Owned(t)) => {
+            stmt.bind_text(slot_num as i32, t, sqlite::Destructor::TRANSIENT)
+        }
     }
 }
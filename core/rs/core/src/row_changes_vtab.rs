@@ -0,0 +1,582 @@
+extern crate alloc;
+
+use core::ffi::{c_char, c_int, c_void, CStr};
+use core::mem;
+
+use alloc::boxed::Box;
+use alloc::ffi::CString;
+use alloc::format;
+use alloc::string::String;
+use alloc::vec;
+use alloc::vec::Vec;
+use num_derive::FromPrimitive;
+#[cfg(not(feature = "std"))]
+use num_traits::FromPrimitive;
+use sqlite::{sqlite3, ColumnType, Connection, Context, ManagedStmt, Stmt};
+use sqlite_nostd as sqlite;
+use sqlite_nostd::ResultCode;
+
+use crate::c::{crsql_ExtData, ClockUnionColumn};
+use crate::changes_vtab::{db_version_lower_bound, is_local_only};
+use crate::changes_vtab_read::changes_union_query;
+use crate::pack_columns::{bind_package_to_stmt, pack_value, unpack_columns_ref};
+use crate::stmt_cache::reset_cached_stmt;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+
+#[derive(FromPrimitive, PartialEq, Debug)]
+enum Columns {
+    Tbl = 0,
+    Pk = 1,
+    Cids = 2,
+    Vals = 3,
+    ColVersions = 4,
+    DbVersion = 5,
+    SiteId = 6,
+    Cl = 7,
+    Seq = 8,
+}
+
+// The changes of a row are read together, in the order they were made.
+const ROW_ORDER: &str = " ORDER BY db_vrsn ASC, tbl ASC, key ASC, site_id ASC, seq ASC";
+
+#[repr(C)]
+struct RowChangesTab {
+    base: sqlite::vtab,
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+}
+
+/**
+ * The row currently under the cursor. The packed columns are v1 packages. See
+ * `pack_columns`.
+ */
+struct Row {
+    tbl_info_idx: usize,
+    key: i64,
+    pk: Vec<u8>,
+    db_version: i64,
+    site_id: Option<Vec<u8>>,
+    cl: i64,
+    seq: i64,
+    cids: Vec<u8>,
+    vals: Vec<u8>,
+    col_versions: Vec<u8>,
+    // Positions in `non_pks` of the changed columns.
+    col_indices: Vec<usize>,
+}
+
+#[repr(C)]
+struct Cursor {
+    base: sqlite::vtab_cursor,
+    changes_stmt: Option<ManagedStmt>,
+    // `changes_stmt` is on the first change of the next row.
+    pending: bool,
+    // `changes_stmt` has returned all of its changes.
+    exhausted: bool,
+    eof: bool,
+    rowid: i64,
+    row: Row,
+}
+
+extern "C" fn connect(
+    db: *mut sqlite::sqlite3,
+    aux: *mut c_void,
+    _argc: c_int,
+    _argv: *const *const c_char,
+    vtab: *mut *mut sqlite::vtab,
+    _err: *mut *mut c_char,
+) -> c_int {
+    if let Err(rc) = sqlite::declare_vtab(
+        db,
+        "CREATE TABLE x([table] TEXT NOT NULL, [pk] BLOB NOT NULL, [cids] BLOB NOT NULL, [vals] BLOB NOT NULL, [col_versions] BLOB NOT NULL, [db_version] INTEGER NOT NULL, [site_id] BLOB, [cl] INTEGER NOT NULL, [seq] INTEGER NOT NULL);",
+    ) {
+        return rc as c_int;
+    }
+
+    unsafe {
+        *vtab = Box::into_raw(Box::new(RowChangesTab {
+            base: sqlite::vtab {
+                nRef: 0,
+                pModule: core::ptr::null(),
+                zErrMsg: core::ptr::null_mut(),
+                #[cfg(feature = "libsql")]
+                pLibsqlModule: core::ptr::null_mut(),
+            },
+            db,
+            ext_data: aux as *mut crsql_ExtData,
+        }))
+        .cast::<sqlite::vtab>();
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn disconnect(vtab: *mut sqlite::vtab) -> c_int {
+    unsafe {
+        drop(Box::from_raw(vtab.cast::<RowChangesTab>()));
+    }
+    ResultCode::OK as c_int
+}
+
+fn operator_string(op: u8) -> Option<&'static str> {
+    match op as u32 {
+        sqlite::INDEX_CONSTRAINT_EQ => Some("="),
+        sqlite::INDEX_CONSTRAINT_GT => Some(">"),
+        sqlite::INDEX_CONSTRAINT_LE => Some("<="),
+        sqlite::INDEX_CONSTRAINT_LT => Some("<"),
+        sqlite::INDEX_CONSTRAINT_GE => Some(">="),
+        sqlite::INDEX_CONSTRAINT_NE => Some("!="),
+        sqlite::INDEX_CONSTRAINT_ISNOT => Some("IS NOT"),
+        sqlite::INDEX_CONSTRAINT_IS => Some("IS"),
+        _ => None,
+    }
+}
+
+/**
+ * Constraints on db_version and site_id are pushed down to the clock scan,
+ * everything else is left to SQLite. idx_num uses the layout of
+ * `changes_best_index` so the crsql_changes helpers can read it.
+ */
+extern "C" fn best_index(_vtab: *mut sqlite::vtab, index_info: *mut sqlite::index_info) -> c_int {
+    unsafe { best_index_impl(index_info) }
+}
+
+unsafe fn best_index_impl(index_info: *mut sqlite::index_info) -> c_int {
+    let constraints = sqlite::args!((*index_info).nConstraint, (*index_info).aConstraint);
+    let constraint_usage =
+        sqlite::args_mut!((*index_info).nConstraint, (*index_info).aConstraintUsage);
+
+    let mut idx_num: i32 = 0;
+    let mut terms = vec![];
+    let mut arg_v_index = 1;
+    for (i, constraint) in constraints.iter().enumerate() {
+        if constraint.usable == 0 {
+            continue;
+        }
+        let col_name = match Columns::from_i32(constraint.iColumn) {
+            Some(Columns::DbVersion) => "db_vrsn",
+            Some(Columns::SiteId) => "site_id",
+            _ => continue,
+        };
+        let op = match operator_string(constraint.op) {
+            Some(op) => op,
+            None => continue,
+        };
+        terms.push(format!("{} {} ?{}", col_name, op, arg_v_index));
+        constraint_usage[i].argvIndex = arg_v_index;
+        constraint_usage[i].omit = 1;
+
+        if col_name == "site_id" && constraint.op == sqlite::INDEX_CONSTRAINT_EQ as u8 {
+            idx_num |= arg_v_index << 8;
+        }
+        if col_name == "db_vrsn" && idx_num & (0xff << 16) == 0 {
+            if constraint.op == sqlite::INDEX_CONSTRAINT_GT as u8 {
+                idx_num |= arg_v_index << 16;
+            } else if constraint.op == sqlite::INDEX_CONSTRAINT_GE as u8 {
+                idx_num |= arg_v_index << 16 | 8;
+            }
+        }
+        arg_v_index += 1;
+    }
+
+    let mut idx_str = if terms.len() > 0 {
+        format!("WHERE {}", terms.join(" AND "))
+    } else {
+        String::new()
+    };
+    idx_str.push_str(ROW_ORDER);
+    // manual null-term since we'll pass to C
+    idx_str.push('\0');
+
+    let order_bys = sqlite::args!((*index_info).nOrderBy, (*index_info).aOrderBy);
+    let order_by_consumed = order_bys.len() == 1
+        && order_bys[0].iColumn == Columns::DbVersion as i32
+        && order_bys[0].desc == 0;
+
+    // Prefer plans that constrain the version.
+    let (cost, rows) = if idx_num & (0xff << 16) != 0 {
+        (10.0, 10)
+    } else {
+        (2147483647.0, 2147483647)
+    };
+    (*index_info).estimatedCost = cost;
+    (*index_info).estimatedRows = rows;
+    (*index_info).idxNum = idx_num;
+    (*index_info).orderByConsumed = if order_by_consumed { 1 } else { 0 };
+    // sqlite frees the string for us.
+    let (ptr, _, _) = idx_str.into_raw_parts();
+    (*index_info).idxStr = ptr as *mut c_char;
+    (*index_info).needToFreeIdxStr = 1;
+
+    ResultCode::OK as c_int
+}
+
+extern "C" fn open(_vtab: *mut sqlite::vtab, cursor: *mut *mut sqlite::vtab_cursor) -> c_int {
+    unsafe {
+        let boxed = Box::new(Cursor {
+            base: sqlite::vtab_cursor {
+                pVtab: core::ptr::null_mut(),
+            },
+            changes_stmt: None,
+            pending: false,
+            exhausted: true,
+            eof: true,
+            rowid: 0,
+            row: Row {
+                tbl_info_idx: 0,
+                key: 0,
+                pk: vec![],
+                db_version: 0,
+                site_id: None,
+                cl: 0,
+                seq: 0,
+                cids: vec![],
+                vals: vec![],
+                col_versions: vec![],
+                col_indices: vec![],
+            },
+        });
+        *cursor = Box::into_raw(boxed).cast::<sqlite::vtab_cursor>();
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn close(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    unsafe {
+        drop(Box::from_raw(cursor.cast::<Cursor>()));
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn filter(
+    cursor: *mut sqlite::vtab_cursor,
+    idx_num: c_int,
+    idx_str: *const c_char,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) -> c_int {
+    let args = sqlite::args!(argc, argv);
+    let crsr = cursor.cast::<Cursor>();
+    let tab = unsafe { (*cursor).pVtab.cast::<RowChangesTab>() };
+    let idx_str = match unsafe { CStr::from_ptr(idx_str).to_str() } {
+        Ok(idx_str) => idx_str,
+        Err(_) => return ResultCode::FORMAT as c_int,
+    };
+    let rc = unsafe { filter_impl(tab, crsr, idx_num, idx_str, args) }
+        .and_then(|_| unsafe { next_impl(tab, crsr) });
+    match rc {
+        Ok(rc) | Err(rc) => rc as c_int,
+    }
+}
+
+unsafe fn filter_impl(
+    tab: *mut RowChangesTab,
+    crsr: *mut Cursor,
+    idx_num: c_int,
+    idx_str: &str,
+    args: &[*mut sqlite::value],
+) -> Result<ResultCode, ResultCode> {
+    let db = (*tab).db;
+    let ext_data = (*tab).ext_data;
+    (*crsr).changes_stmt = None;
+    (*crsr).pending = false;
+    (*crsr).exhausted = true;
+    (*crsr).eof = true;
+    (*crsr).rowid = 0;
+
+    let c_rc =
+        crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut (*tab).base.zErrMsg as *mut _);
+    if c_rc != ResultCode::OK as c_int {
+        return Err(ResultCode::from_i32(c_rc).unwrap_or(ResultCode::ERROR));
+    }
+
+    let tbl_infos =
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>));
+    if let Err(msg) = crate::db_version::fill_db_version_if_needed(db, ext_data) {
+        (*tab).base.zErrMsg = CString::new(msg)?.into_raw();
+        return Err(ResultCode::ERROR);
+    }
+    let lower_bound = db_version_lower_bound(idx_num, args);
+    let mut changed_tbl_infos = vec![];
+    for tbl_info in tbl_infos.iter() {
+        match lower_bound {
+            Some(version) if tbl_info.max_db_version(db)? <= version => {}
+            _ => changed_tbl_infos.push(tbl_info),
+        }
+    }
+    // nothing changed since the requested version, or no crrs at all.
+    if changed_tbl_infos.len() == 0 {
+        return Ok(ResultCode::OK);
+    }
+
+    let sql = changes_union_query(
+        &changed_tbl_infos,
+        idx_str,
+        (*ext_data).implicitColumnClocks != 0,
+        is_local_only(ext_data, idx_num, args),
+    )?;
+    let stmt = db.prepare_v2(&sql)?;
+    for (i, arg) in args.iter().enumerate() {
+        stmt.bind_value(i as i32 + 1, *arg)?;
+    }
+    (*crsr).changes_stmt = Some(stmt);
+    (*crsr).exhausted = false;
+    Ok(ResultCode::OK)
+}
+
+extern "C" fn next(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    let tab = unsafe { (*cursor).pVtab.cast::<RowChangesTab>() };
+    match unsafe { next_impl(tab, crsr) } {
+        Ok(rc) | Err(rc) => rc as c_int,
+    }
+}
+
+/**
+ * Reads all changes of the next row then looks up the current values of the
+ * changed columns with a single select of the row.
+ */
+unsafe fn next_impl(tab: *mut RowChangesTab, crsr: *mut Cursor) -> Result<ResultCode, ResultCode> {
+    if (*crsr).exhausted {
+        (*crsr).changes_stmt = None;
+        (*crsr).eof = true;
+        return Ok(ResultCode::OK);
+    }
+    let stmt = match &(*crsr).changes_stmt {
+        Some(stmt) => stmt.stmt,
+        None => return Err(ResultCode::MISUSE),
+    };
+    if !(*crsr).pending && stmt.step()? == ResultCode::DONE {
+        (*crsr).exhausted = true;
+        (*crsr).changes_stmt = None;
+        (*crsr).eof = true;
+        return Ok(ResultCode::OK);
+    }
+
+    let db = (*tab).db;
+    let tbl_infos = mem::ManuallyDrop::new(Box::from_raw(
+        (*(*tab).ext_data).tableInfos as *mut Vec<TableInfo>,
+    ));
+    let tbl = stmt.column_text(ClockUnionColumn::Tbl as i32);
+    let tbl_info_idx = match tbl_infos.iter().position(|x| x.tbl_name == tbl) {
+        Some(idx) => idx,
+        None => {
+            (*tab).base.zErrMsg =
+                CString::new(format!("could not find schema for table {}", tbl))?.into_raw();
+            return Err(ResultCode::ERROR);
+        }
+    };
+    let tbl_info = &tbl_infos[tbl_info_idx];
+
+    let row = &mut (*crsr).row;
+    row.tbl_info_idx = tbl_info_idx;
+    row.key = stmt.column_int64(ClockUnionColumn::RowId as i32);
+    row.db_version = stmt.column_int64(ClockUnionColumn::DbVrsn as i32);
+    row.seq = stmt.column_int64(ClockUnionColumn::Seq as i32);
+    row.cl = stmt.column_int64(ClockUnionColumn::Cl as i32);
+    row.pk.clear();
+    row.pk
+        .extend_from_slice(stmt.column_blob(ClockUnionColumn::Pks as i32));
+    row.site_id = match stmt.column_type(ClockUnionColumn::SiteId as i32) {
+        ColumnType::Null => None,
+        _ => Some(stmt.column_blob(ClockUnionColumn::SiteId as i32).to_vec()),
+    };
+    row.cids.clear();
+    row.vals.clear();
+    row.col_versions.clear();
+    row.col_indices.clear();
+    // column counts are filled in once known
+    row.cids.push(0);
+    row.col_versions.push(0);
+
+    loop {
+        let cid = stmt.column_text(ClockUnionColumn::Cid as i32);
+        if cid != crate::c::INSERT_SENTINEL {
+            if let Some(idx) = tbl_info.non_pk_index(cid) {
+                row.col_indices.push(idx);
+                pack_value(
+                    &mut row.cids,
+                    stmt.column_value(ClockUnionColumn::Cid as i32),
+                );
+                pack_value(
+                    &mut row.col_versions,
+                    stmt.column_value(ClockUnionColumn::ColVrsn as i32),
+                );
+            }
+        }
+
+        if stmt.step()? == ResultCode::DONE {
+            (*crsr).pending = false;
+            (*crsr).exhausted = true;
+            break;
+        }
+        let same_row = stmt.column_text(ClockUnionColumn::Tbl as i32) == tbl_info.tbl_name
+            && stmt.column_int64(ClockUnionColumn::RowId as i32) == row.key
+            && stmt.column_int64(ClockUnionColumn::DbVrsn as i32) == row.db_version
+            && match stmt.column_type(ClockUnionColumn::SiteId as i32) {
+                ColumnType::Null => row.site_id.is_none(),
+                _ => {
+                    row.site_id.as_deref()
+                        == Some(stmt.column_blob(ClockUnionColumn::SiteId as i32))
+                }
+            };
+        if !same_row {
+            (*crsr).pending = true;
+            break;
+        }
+    }
+
+    let num_cols = row.col_indices.len();
+    if num_cols > u8::MAX as usize {
+        (*tab).base.zErrMsg = CString::new(format!(
+            "crsql_row_changes - a row of {} changed more than {} columns at once",
+            tbl_info.tbl_name,
+            u8::MAX
+        ))?
+        .into_raw();
+        return Err(ResultCode::ABORT);
+    }
+
+    row.vals.push(num_cols as u8);
+    if num_cols > 0 {
+        let row_stmt_ref = tbl_info.get_row_data_stmt(db)?;
+        let row_stmt = row_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+        let unpacked_pks = unpack_columns_ref(&row.pk)?;
+        if let Err(rc) = bind_package_to_stmt(row_stmt.stmt, &unpacked_pks, 0) {
+            reset_cached_stmt(row_stmt.stmt)?;
+            return Err(rc);
+        }
+        match row_stmt.step() {
+            Ok(ResultCode::ROW) => {
+                for idx in row.col_indices.iter() {
+                    pack_value(&mut row.vals, row_stmt.column_value(*idx as i32)?);
+                }
+            }
+            Ok(_) => {
+                // The row was deleted after these changes were read. Like crsql_changes,
+                // there are no values to report.
+                row.cids.truncate(1);
+                row.col_versions.truncate(1);
+                row.col_indices.clear();
+                row.vals[0] = 0;
+            }
+            Err(rc) => {
+                reset_cached_stmt(row_stmt.stmt)?;
+                return Err(rc);
+            }
+        }
+        reset_cached_stmt(row_stmt.stmt)?;
+    }
+    row.cids[0] = row.col_indices.len() as u8;
+    row.col_versions[0] = row.col_indices.len() as u8;
+
+    (*crsr).eof = false;
+    (*crsr).rowid += 1;
+    Ok(ResultCode::OK)
+}
+
+extern "C" fn eof(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe { (*crsr).eof as c_int }
+}
+
+extern "C" fn column(
+    cursor: *mut sqlite::vtab_cursor,
+    ctx: *mut sqlite::context,
+    col_num: c_int,
+) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    let tab = unsafe { (*cursor).pVtab.cast::<RowChangesTab>() };
+    let row = unsafe { &(*crsr).row };
+    match Columns::from_i32(col_num) {
+        Some(Columns::Tbl) => unsafe {
+            let tbl_infos = mem::ManuallyDrop::new(Box::from_raw(
+                (*(*tab).ext_data).tableInfos as *mut Vec<TableInfo>,
+            ));
+            ctx.result_text_transient(&tbl_infos[row.tbl_info_idx].tbl_name);
+        },
+        Some(Columns::Pk) => result_blob_transient(ctx, &row.pk),
+        Some(Columns::Cids) => result_blob_transient(ctx, &row.cids),
+        Some(Columns::Vals) => result_blob_transient(ctx, &row.vals),
+        Some(Columns::ColVersions) => result_blob_transient(ctx, &row.col_versions),
+        Some(Columns::DbVersion) => ctx.result_int64(row.db_version),
+        Some(Columns::SiteId) => match &row.site_id {
+            Some(site_id) => result_blob_transient(ctx, site_id),
+            None => ctx.result_null(),
+        },
+        Some(Columns::Cl) => ctx.result_int64(row.cl),
+        Some(Columns::Seq) => ctx.result_int64(row.seq),
+        None => return ResultCode::MISUSE as c_int,
+    }
+    ResultCode::OK as c_int
+}
+
+// The row's buffers are rewritten by the next call to `next` while SQLite may
+// still hold on to the value, e.g. in an aggregate. SQLite has to copy them.
+fn result_blob_transient(ctx: *mut sqlite::context, blob: &[u8]) {
+    sqlite::result_blob(
+        ctx,
+        blob.as_ptr(),
+        blob.len() as i32,
+        sqlite::Destructor::TRANSIENT,
+    );
+}
+
+extern "C" fn rowid(cursor: *mut sqlite::vtab_cursor, row_id: *mut sqlite::int64) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe { *row_id = (*crsr).rowid }
+    ResultCode::OK as c_int
+}
+
+static MODULE: sqlite_nostd::module = sqlite_nostd::module {
+    iVersion: 0,
+    xCreate: None,
+    xConnect: Some(connect),
+    xBestIndex: Some(best_index),
+    xDisconnect: Some(disconnect),
+    xDestroy: None,
+    xOpen: Some(open),
+    xClose: Some(close),
+    xFilter: Some(filter),
+    xNext: Some(next),
+    xEof: Some(eof),
+    xColumn: Some(column),
+    xRowid: Some(rowid),
+    xUpdate: None,
+    xBegin: None,
+    xSync: None,
+    xCommit: None,
+    xRollback: None,
+    xFindFunction: None,
+    xRename: None,
+    xSavepoint: None,
+    xRelease: None,
+    xRollbackTo: None,
+    xShadowName: None,
+    xIntegrity: None,
+};
+
+/**
+ * CREATE TABLE [x] (table, pk, cids, vals, col_versions, db_version, site_id, cl, seq);
+ * SELECT * FROM crsql_row_changes WHERE db_version > ___;
+ *
+ * Read only view of crsql_changes with a row per changed row rather than per
+ * changed cell. All changes to a row at a db_version, from the same site, are
+ * returned as one row. `cids`, `vals` and `col_versions` hold the changed columns,
+ * their current values and their versions as packed columns. Unpack them with
+ * `crsql_unpack_columns`. Deletes and pk only inserts have no changed columns.
+ *
+ * `seq` is the seq of the row's first change.
+ */
+pub fn create_module(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<ResultCode, ResultCode> {
+    db.create_module_v2(
+        "crsql_row_changes",
+        &MODULE,
+        Some(ext_data as *mut c_void),
+        None,
+    )?;
+
+    Ok(ResultCode::OK)
+}
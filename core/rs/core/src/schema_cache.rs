@@ -0,0 +1,93 @@
+use alloc::string::String;
+use alloc::sync::{Arc, Weak};
+use alloc::vec::Vec;
+
+use crate::c::{crsql_lockSchemaCache, crsql_unlockSchemaCache};
+use crate::tableinfo::TableSchema;
+
+/**
+ * Process wide cache of the schema half of table infos.
+ *
+ * Every connection to a database file pulls the same table infos. Connections
+ * look schemas up here, by database file, table name and schema fingerprint,
+ * before running the pragma queries that build them. The cache only holds weak
+ * references. A schema is freed once no connection uses it.
+ *
+ * In-memory and temporary databases have no file to key on and are never shared.
+ */
+struct CachedSchema {
+    db_file: String,
+    schema: Weak<TableSchema>,
+}
+
+static mut SCHEMAS: Vec<CachedSchema> = Vec::new();
+
+// Holds SQLite's app mutex so the cache is only as thread safe as SQLite was
+// configured to be. See `crsql_lockSchemaCache`.
+struct SchemasGuard;
+
+impl SchemasGuard {
+    fn lock() -> SchemasGuard {
+        unsafe { crsql_lockSchemaCache() };
+        SchemasGuard
+    }
+
+    fn schemas(&mut self) -> &mut Vec<CachedSchema> {
+        unsafe { &mut *core::ptr::addr_of_mut!(SCHEMAS) }
+    }
+}
+
+impl Drop for SchemasGuard {
+    fn drop(&mut self) {
+        unsafe { crsql_unlockSchemaCache() };
+    }
+}
+
+fn find(
+    schemas: &Vec<CachedSchema>,
+    db_file: &str,
+    table: &str,
+    fingerprint: &str,
+) -> Option<Arc<TableSchema>> {
+    schemas
+        .iter()
+        .filter(|c| c.db_file == db_file)
+        .filter_map(|c| c.schema.upgrade())
+        .find(|s| s.tbl_name == table && s.schema_fingerprint == fingerprint)
+}
+
+pub fn get(db_file: &str, table: &str, fingerprint: &str) -> Option<Arc<TableSchema>> {
+    if db_file.is_empty() {
+        return None;
+    }
+    let mut guard = SchemasGuard::lock();
+    find(guard.schemas(), db_file, table, fingerprint)
+}
+
+/**
+ * Shares `schema` with other connections to `db_file`. If another connection
+ * cached the same schema first, that one is returned instead.
+ */
+pub fn insert(db_file: &str, schema: TableSchema) -> Arc<TableSchema> {
+    if db_file.is_empty() {
+        return Arc::new(schema);
+    }
+    let mut guard = SchemasGuard::lock();
+    let schemas = guard.schemas();
+    if let Some(existing) = find(
+        schemas,
+        db_file,
+        &schema.tbl_name,
+        &schema.schema_fingerprint,
+    ) {
+        return existing;
+    }
+
+    schemas.retain(|c| c.schema.strong_count() > 0);
+    let schema = Arc::new(schema);
+    schemas.push(CachedSchema {
+        db_file: String::from(db_file),
+        schema: Arc::downgrade(&schema),
+    });
+    schema
+}
@@ -1,14 +1,19 @@
 extern crate alloc;
+use alloc::format;
+use alloc::rc::{Rc, Weak};
+use alloc::string::String;
 use alloc::vec::Vec;
+use core::cell::{BorrowError, Cell, Ref, RefCell};
+use core::ffi::{c_char, c_int};
 use core::mem::ManuallyDrop;
 
 use alloc::boxed::Box;
-use sqlite::Stmt;
+use sqlite::{Context, ManagedStmt, Stmt, Value};
 use sqlite_nostd as sqlite;
 use sqlite_nostd::ResultCode;
 
 use crate::c::crsql_ExtData;
-use crate::tableinfo::TableInfo;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
 
 // Finalize prepared statements attached to table infos.
 // Do not drop the table infos.
@@ -24,6 +29,177 @@ pub extern "C" fn crsql_clear_stmt_cache(ext_data: *mut crsql_ExtData) {
     }
 }
 
+/**
+ * A lazily prepared statement owned by a `TableInfo`.
+ * While it holds a statement it is linked into its budget's LRU list, so the
+ * budget can evict the least recently used statements of a connection.
+ */
+pub struct CachedStmt {
+    stmt: RefCell<Option<ManagedStmt>>,
+    budget: Rc<StmtBudget>,
+    me: Weak<CachedStmt>,
+    // neighbours in the budget's list, towards the least and most recently used ends
+    prev: Cell<Weak<CachedStmt>>,
+    next: Cell<Weak<CachedStmt>>,
+    linked: Cell<bool>,
+}
+
+impl CachedStmt {
+    pub fn new(budget: &Rc<StmtBudget>) -> Rc<CachedStmt> {
+        Rc::new_cyclic(|me| CachedStmt {
+            stmt: RefCell::new(None),
+            budget: budget.clone(),
+            me: me.clone(),
+            prev: Cell::new(Weak::new()),
+            next: Cell::new(Weak::new()),
+            linked: Cell::new(false),
+        })
+    }
+
+    pub fn try_borrow(&self) -> Result<Ref<Option<ManagedStmt>>, BorrowError> {
+        if self.linked.get() {
+            self.budget.unlink(self);
+            self.budget.push_mru(self);
+        }
+        self.stmt.try_borrow()
+    }
+
+    /**
+     * Finalizes the statement, if any. It is prepared again on its next use.
+     */
+    pub fn clear(&self) -> Result<ResultCode, ResultCode> {
+        self.stmt.try_borrow_mut()?.take();
+        self.budget.unlink(self);
+        Ok(ResultCode::OK)
+    }
+}
+
+impl Drop for CachedStmt {
+    fn drop(&mut self) {
+        self.budget.unlink(self);
+    }
+}
+
+// Clones the weak ref held by `cell`.
+fn peek(cell: &Cell<Weak<CachedStmt>>) -> Weak<CachedStmt> {
+    let weak = cell.take();
+    cell.set(weak.clone());
+    weak
+}
+
+/**
+ * Bounds the number of statements a connection keeps prepared across all of
+ * its table infos. Shared by every `TableInfo` of a connection.
+ *
+ * Once over the limit, the least recently used statements that aren't in use
+ * are finalized. They are prepared again on their next use.
+ * A limit of 0 means no limit.
+ *
+ * Cached statements form a doubly linked list ordered by last use. The list
+ * only holds weak refs so dropping a `TableInfo` still finalizes its
+ * statements.
+ */
+pub struct StmtBudget {
+    limit: Cell<usize>,
+    len: Cell<usize>,
+    lru: Cell<Weak<CachedStmt>>,
+    mru: Cell<Weak<CachedStmt>>,
+}
+
+impl StmtBudget {
+    pub fn new(limit: usize) -> Rc<StmtBudget> {
+        Rc::new(StmtBudget {
+            limit: Cell::new(limit),
+            len: Cell::new(0),
+            lru: Cell::new(Weak::new()),
+            mru: Cell::new(Weak::new()),
+        })
+    }
+
+    pub fn set_limit(&self, limit: usize) -> Result<ResultCode, ResultCode> {
+        self.limit.set(limit);
+        self.evict_over_limit(None)
+    }
+
+    /**
+     * Stores a freshly prepared statement in `slot`, evicting others if this
+     * puts the connection over its budget.
+     */
+    pub fn cache(
+        &self,
+        slot: &Rc<CachedStmt>,
+        stmt: ManagedStmt,
+    ) -> Result<ResultCode, ResultCode> {
+        *slot.stmt.try_borrow_mut()? = Some(stmt);
+        self.unlink(slot);
+        self.push_mru(slot);
+        self.evict_over_limit(Some(slot))
+    }
+
+    fn push_mru(&self, slot: &CachedStmt) {
+        let mru = self.mru.replace(slot.me.clone());
+        match mru.upgrade() {
+            Some(last) => last.next.set(slot.me.clone()),
+            None => self.lru.set(slot.me.clone()),
+        }
+        slot.prev.set(mru);
+        slot.linked.set(true);
+        self.len.set(self.len.get() + 1);
+    }
+
+    fn unlink(&self, slot: &CachedStmt) {
+        if !slot.linked.replace(false) {
+            return;
+        }
+        let prev = slot.prev.take();
+        let next = slot.next.take();
+        match prev.upgrade() {
+            Some(p) => p.next.set(next.clone()),
+            None => self.lru.set(next.clone()),
+        }
+        match next.upgrade() {
+            Some(n) => n.prev.set(prev),
+            None => self.mru.set(prev),
+        }
+        self.len.set(self.len.get() - 1);
+    }
+
+    fn evict_over_limit(&self, keep: Option<&Rc<CachedStmt>>) -> Result<ResultCode, ResultCode> {
+        let limit = self.limit.get();
+        if limit == 0 {
+            return Ok(ResultCode::OK);
+        }
+
+        // Walk from the least recently used end. Only statements that are in
+        // use, at most a handful, are ever skipped.
+        let mut candidate = peek(&self.lru).upgrade();
+        while self.len.get() > limit {
+            let slot = match candidate {
+                Some(slot) => slot,
+                // everything left is in use
+                None => break,
+            };
+            candidate = peek(&slot.next).upgrade();
+            if keep.map_or(false, |k| Rc::ptr_eq(k, &slot)) {
+                continue;
+            }
+            // statements currently in use can't be finalized
+            let evicted = match slot.stmt.try_borrow_mut() {
+                Ok(mut stmt) => {
+                    stmt.take();
+                    true
+                }
+                Err(_) => false,
+            };
+            if evicted {
+                self.unlink(&slot);
+            }
+        }
+
+        Ok(ResultCode::OK)
+    }
+}
+
 pub fn reset_cached_stmt(stmt: *mut sqlite::stmt) -> Result<ResultCode, ResultCode> {
     if stmt.is_null() {
         return Ok(ResultCode::OK);
@@ -31,3 +207,72 @@ pub fn reset_cached_stmt(stmt: *mut sqlite::stmt) -> Result<ResultCode, ResultCo
     stmt.clear_bindings()?;
     stmt.reset()
 }
+
+/**
+ * crsql_warmup()
+ * crsql_warmup("table", ...)
+ *
+ * Pulls table infos and prepares the statements of the given crrs, or of all
+ * crrs when none are given, so the first write, merge or read on the connection
+ * does not pay for it. Meant to be run on a pooled connection before it is
+ * handed out.
+ *
+ * Returns the number of crrs warmed.
+ */
+pub unsafe extern "C" fn x_crsql_warmup(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    let args = sqlite::args!(argc, argv);
+    let tables = args.iter().map(|a| a.text()).collect::<Vec<_>>();
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+
+    match warmup(ctx.db_handle(), ext_data, &tables) {
+        Ok(warmed) => ctx.result_int64(warmed),
+        Err(msg) => ctx.result_error(&msg),
+    }
+}
+
+fn warmup(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tables: &Vec<&str>,
+) -> Result<i64, String> {
+    crate::db_version::fill_db_version_if_needed(db, ext_data)?;
+
+    let mut err: *mut c_char = core::ptr::null_mut();
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, &mut err as *mut _);
+    if rc != ResultCode::OK as c_int {
+        return Err(format!(
+            "failed to ensure table infos are up to date: {}",
+            rc
+        ));
+    }
+
+    let tbl_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+    let implicit = unsafe { (*ext_data).implicitColumnClocks != 0 };
+
+    for table in tables {
+        if !tbl_infos.iter().any(|t| t.tbl_name == *table) {
+            return Err(format!("crsql_warmup: {} is not a crr", table));
+        }
+    }
+
+    let mut warmed = 0;
+    for tbl_info in tbl_infos
+        .iter()
+        .filter(|t| tables.len() == 0 || tables.contains(&t.tbl_name.as_str()))
+    {
+        tbl_info.prepare_stmts(db, implicit).or_else(|_| {
+            Err(format!(
+                "failed to prepare statements for {}",
+                tbl_info.tbl_name
+            ))
+        })?;
+        warmed += 1;
+    }
+
+    Ok(warmed)
+}
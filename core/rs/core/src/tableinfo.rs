@@ -3,20 +3,23 @@ use crate::c::crsql_ExtData;
 use crate::c::crsql_fetchPragmaSchemaVersion;
 use crate::c::TABLE_INFO_SCHEMA_VERSION;
 use crate::pack_columns::bind_package_to_stmt;
-use crate::pack_columns::ColumnValue;
+use crate::pack_columns::ColumnValueRef;
 use crate::stmt_cache::reset_cached_stmt;
+use crate::stmt_cache::{CachedStmt, StmtBudget};
 use crate::util::Countable;
 use alloc::boxed::Box;
 use alloc::format;
+use alloc::rc::Rc;
 use alloc::string::String;
+use alloc::sync::Arc;
 use alloc::vec;
 use alloc::vec::Vec;
-use core::cell::Ref;
-use core::cell::RefCell;
+use core::cell::{Cell, Ref};
 use core::ffi::c_char;
 use core::ffi::c_int;
 use core::ffi::c_void;
-use core::mem::forget;
+use core::mem::{forget, ManuallyDrop};
+use core::ops::Deref;
 use num_traits::ToPrimitive;
 use sqlite::sqlite3;
 use sqlite::value;
@@ -26,60 +29,344 @@ use sqlite_nostd::ManagedStmt;
 use sqlite_nostd::ResultCode;
 use sqlite_nostd::Stmt;
 use sqlite_nostd::StrRef;
+use sqlite_nostd::Value;
 
-pub struct TableInfo {
+/**
+ * The part of a `TableInfo` that only depends on the table's schema.
+ * Never modified once pulled so connections to the same database file can
+ * share it. See `schema_cache`.
+ */
+pub struct TableSchema {
     pub tbl_name: String,
     pub pks: Vec<ColumnInfo>,
     pub non_pks: Vec<ColumnInfo>,
+    // See `schema_fingerprint`. Lets a schema change keep the table infos,
+    // and their prepared statements, of tables it did not touch.
+    pub schema_fingerprint: String,
+    // Clock rows are keyed by the pk itself rather than by a `__crsql_pks` lookaside key.
+    // See `pk_is_rowid_alias`.
+    pub key_is_pk: bool,
+}
+
+impl TableSchema {
+    /**
+     * SQL for the clock key of a row and the join it needs, if any.
+     * `row` aliases a table or select that has the pk columns. The lookaside
+     * is joined as `lookaside`.
+     */
+    pub fn key_of_row(&self, row: &str, lookaside: &str) -> (String, String) {
+        if self.key_is_pk {
+            return (
+                format!("{row}.\"{}\"", crate::util::escape_ident(&self.pks[0].name)),
+                String::new(),
+            );
+        }
+        (
+            format!("{lookaside}.__crsql_key"),
+            format!(
+                "JOIN \"{table_ident}__crsql_pks\" AS {lookaside} ON {on}",
+                table_ident = crate::util::escape_ident(&self.tbl_name),
+                on = self
+                    .pks
+                    .iter()
+                    .map(|c| format!(
+                        "{lookaside}.\"{col}\" = {row}.\"{col}\"",
+                        col = crate::util::escape_ident(&c.name)
+                    ))
+                    .collect::<Vec<_>>()
+                    .join(" AND "),
+            ),
+        )
+    }
+
+    /**
+     * SQL for the pk columns of the row a clock `key` belongs to and the join
+     * they need, if any. The lookaside is joined as `lookaside`.
+     */
+    pub fn pks_of_key(&self, key: &str, lookaside: &str) -> Result<(String, String), ResultCode> {
+        if self.key_is_pk {
+            return Ok((String::from(key), String::new()));
+        }
+        Ok((
+            crate::util::as_identifier_list(&self.pks, Some(&format!("{lookaside}.")))?,
+            format!(
+                "JOIN \"{table_ident}__crsql_pks\" AS {lookaside} ON {key} = {lookaside}.__crsql_key",
+                table_ident = crate::util::escape_ident(&self.tbl_name),
+            ),
+        ))
+    }
+
+    // The key of a `key_is_pk` row. Rowid aliases coerce integral reals, like SQLite would.
+    fn pk_as_key(&self, pks: &[ColumnValueRef]) -> Result<sqlite::int64, ResultCode> {
+        match pks {
+            [ColumnValueRef::Integer(i)] => Ok(*i),
+            [ColumnValueRef::Float(f)] if *f == (*f as i64) as f64 => Ok(*f as i64),
+            _ => Err(ResultCode::MISMATCH),
+        }
+    }
+}
+
+/**
+ * A `TableSchema` and the statements a connection prepared for it.
+ * Derefs to the schema.
+ */
+pub struct TableInfo {
+    schema: Arc<TableSchema>,
+    // Shared by all table infos of a connection. See `StmtBudget`.
+    stmt_budget: Rc<StmtBudget>,
 
     // Lookaside --
     // insert returning?
     // select?
     // insert or ignore returning followed by select?
     // or selecet first?
-    select_key_stmt: RefCell<Option<ManagedStmt>>,
-    insert_key_stmt: RefCell<Option<ManagedStmt>>,
-    insert_or_ignore_returning_key_stmt: RefCell<Option<ManagedStmt>>,
+    select_key_stmt: Rc<CachedStmt>,
+    insert_key_stmt: Rc<CachedStmt>,
+    insert_or_ignore_returning_key_stmt: Rc<CachedStmt>,
 
     // For merges --
-    set_winner_clock_stmt: RefCell<Option<ManagedStmt>>,
-    local_cl_stmt: RefCell<Option<ManagedStmt>>,
-    col_version_stmt: RefCell<Option<ManagedStmt>>,
-    col_site_id_stmt: RefCell<Option<ManagedStmt>>,
-    merge_pk_only_insert_stmt: RefCell<Option<ManagedStmt>>,
-    merge_delete_stmt: RefCell<Option<ManagedStmt>>,
-    merge_delete_drop_clocks_stmt: RefCell<Option<ManagedStmt>>,
+    set_winner_clock_stmt: Rc<CachedStmt>,
+    local_cl_stmt: Rc<CachedStmt>,
+    col_version_stmt: Rc<CachedStmt>,
+    col_site_id_stmt: Rc<CachedStmt>,
+    merge_pk_only_insert_stmt: Rc<CachedStmt>,
+    merge_delete_stmt: Rc<CachedStmt>,
+    merge_delete_drop_clocks_stmt: Rc<CachedStmt>,
     // We zero clocks, rather than going to 1, because
     // the current values should be totally ignored at all sites.
     // This is because the current values would not exist had the current node
     // processed the intervening delete.
     // This also means that col_version is not always >= 1. A resurrected column,
     // which missed a delete event, will have a 0 version.
-    zero_clocks_on_resurrect_stmt: RefCell<Option<ManagedStmt>>,
+    zero_clocks_on_resurrect_stmt: Rc<CachedStmt>,
 
     // For local writes --
-    mark_locally_deleted_stmt: RefCell<Option<ManagedStmt>>,
-    move_non_sentinels_stmt: RefCell<Option<ManagedStmt>>,
-    mark_locally_created_stmt: RefCell<Option<ManagedStmt>>,
-    mark_locally_updated_stmt: RefCell<Option<ManagedStmt>>,
-    maybe_mark_locally_reinserted_stmt: RefCell<Option<ManagedStmt>>,
+    mark_locally_deleted_stmt: Rc<CachedStmt>,
+    move_non_sentinels_stmt: Rc<CachedStmt>,
+    mark_locally_created_stmt: Rc<CachedStmt>,
+    mark_locally_updated_stmt: Rc<CachedStmt>,
+    maybe_mark_locally_reinserted_stmt: Rc<CachedStmt>,
+    // Only used when implicit column clocks are enabled --
+    materialize_implicit_clocks_stmt: Rc<CachedStmt>,
+
+    // For reads --
+    row_data_stmt: Rc<CachedStmt>,
+
+    // Statements of each of `non_pks`, in the same order.
+    col_stmts: Vec<ColumnStmts>,
+
+    // See `clock_stats`.
+    clock_stats: Cell<Option<ClockStats>>,
+    // See `max_db_version`.
+    max_db_version: Cell<Option<i64>>,
+}
+
+// See `TableInfo::clock_stats`.
+const UNKNOWN_CLOCK_ROWS: f64 = 2147483647.0;
+const UNKNOWN_CLOCK_ROWS_PER_VERSION: f64 = 10.0;
+
+/**
+ * Rough size and version spread of a clock table, for query planning.
+ */
+#[derive(Clone, Copy)]
+pub struct ClockStats {
+    // the db_version the stats were taken at
+    pub db_version: i64,
+    pub rows: f64,
+    // average number of clock rows per db_version
+    pub rows_per_version: f64,
+}
+
+impl Deref for TableInfo {
+    type Target = TableSchema;
+
+    fn deref(&self) -> &TableSchema {
+        &self.schema
+    }
 }
 
 impl TableInfo {
-    fn find_non_pk_col(&self, col_name: &str) -> Result<&ColumnInfo, ResultCode> {
-        for col in &self.non_pks {
+    fn new(schema: Arc<TableSchema>, stmt_budget: Rc<StmtBudget>) -> TableInfo {
+        let col_stmts = schema
+            .non_pks
+            .iter()
+            .map(|_| ColumnStmts {
+                curr_value_stmt: CachedStmt::new(&stmt_budget),
+                merge_insert_stmt: CachedStmt::new(&stmt_budget),
+                row_patch_data_stmt: CachedStmt::new(&stmt_budget),
+            })
+            .collect();
+        TableInfo {
+            schema,
+            set_winner_clock_stmt: CachedStmt::new(&stmt_budget),
+            local_cl_stmt: CachedStmt::new(&stmt_budget),
+            col_version_stmt: CachedStmt::new(&stmt_budget),
+            col_site_id_stmt: CachedStmt::new(&stmt_budget),
+
+            select_key_stmt: CachedStmt::new(&stmt_budget),
+            insert_key_stmt: CachedStmt::new(&stmt_budget),
+            insert_or_ignore_returning_key_stmt: CachedStmt::new(&stmt_budget),
+
+            merge_pk_only_insert_stmt: CachedStmt::new(&stmt_budget),
+            merge_delete_stmt: CachedStmt::new(&stmt_budget),
+            merge_delete_drop_clocks_stmt: CachedStmt::new(&stmt_budget),
+            zero_clocks_on_resurrect_stmt: CachedStmt::new(&stmt_budget),
+
+            mark_locally_deleted_stmt: CachedStmt::new(&stmt_budget),
+            move_non_sentinels_stmt: CachedStmt::new(&stmt_budget),
+            mark_locally_created_stmt: CachedStmt::new(&stmt_budget),
+            mark_locally_updated_stmt: CachedStmt::new(&stmt_budget),
+            maybe_mark_locally_reinserted_stmt: CachedStmt::new(&stmt_budget),
+            materialize_implicit_clocks_stmt: CachedStmt::new(&stmt_budget),
+
+            row_data_stmt: CachedStmt::new(&stmt_budget),
+
+            stmt_budget,
+            col_stmts,
+            clock_stats: Cell::new(None),
+            max_db_version: Cell::new(None),
+        }
+    }
+
+    /**
+     * The highest db_version of any clock row of the table. Read from the
+     * db_version index the first time and then raised by every local write
+     * and merge this connection makes. See `note_db_version`.
+     *
+     * May over-estimate, e.g. after a rollback, but never under-estimates.
+     * Forgotten whenever another connection commits or the schema changes.
+     * See `crsql_forget_max_db_versions`.
+     */
+    pub fn max_db_version(&self, db: *mut sqlite3) -> Result<i64, ResultCode> {
+        if let Some(version) = self.max_db_version.get() {
+            return Ok(version);
+        }
+        let stmt = db.prepare_v2(&format!(
+            "SELECT coalesce(max(db_version), 0) FROM \"{table_name}__crsql_clock\"",
+            table_name = crate::util::escape_ident(&self.tbl_name),
+        ))?;
+        stmt.step()?;
+        let version = stmt.column_int64(0);
+        self.max_db_version.set(Some(version));
+        Ok(version)
+    }
+
+    /**
+     * Records that a clock row of the table was written at `db_version`.
+     */
+    pub fn note_db_version(&self, db_version: i64) {
+        if let Some(version) = self.max_db_version.get() {
+            if db_version > version {
+                self.max_db_version.set(Some(db_version));
+            }
+        }
+    }
+
+    /**
+     * Stats of the clock table, refreshed whenever the db_version moved since
+     * they were taken.
+     *
+     * Uses `sqlite_stat1` for the db_version index when the database has been
+     * analyzed. Otherwise the row count is extrapolated from the number of
+     * lookaside keys and the version spread from min/max probes of the index.
+     * Tables keyed by their pk have no key count to go on. Their keys may be
+     * arbitrarily sparse so they fall back to the same fixed guesses
+     * `changes_best_index` used before it looked at any stats.
+     */
+    pub fn clock_stats(&self, db: *mut sqlite3, db_version: i64) -> Result<ClockStats, ResultCode> {
+        if let Some(stats) = self.clock_stats.get() {
+            if stats.db_version == db_version {
+                return Ok(stats);
+            }
+        }
+
+        let table_ident = crate::util::escape_ident(&self.tbl_name);
+        let mut analyzed = None;
+        // sqlite_stat1 only exists once ANALYZE has run
+        if let Ok(stmt) = db.prepare_v2("SELECT stat FROM sqlite_stat1 WHERE idx = ?") {
+            stmt.bind_text(
+                1,
+                &format!("{}__crsql_clock_dbv_idx", self.tbl_name),
+                sqlite::Destructor::TRANSIENT,
+            )?;
+            if stmt.step()? == ResultCode::ROW {
+                // "rows rows_per_db_version rows_per_(db_version, seq)"
+                let stat = stmt.column_text(0)?;
+                let mut nums = stat.split(' ').map_while(|n| n.parse::<f64>().ok());
+                if let (Some(rows), Some(per_version)) = (nums.next(), nums.next()) {
+                    analyzed = Some((rows, per_version));
+                }
+            }
+        }
+
+        let (rows, rows_per_version) = match analyzed {
+            Some(stats) => stats,
+            None if self.key_is_pk => (UNKNOWN_CLOCK_ROWS, UNKNOWN_CLOCK_ROWS_PER_VERSION),
+            None => {
+                // min and max in separate selects so each is a single probe of the index
+                // Lookaside keys are dense.
+                let stmt = db.prepare_v2(&format!(
+                    "SELECT
+                      (SELECT coalesce(max(__crsql_key), 0) FROM \"{table_ident}__crsql_pks\"),
+                      coalesce(
+                        (SELECT max(db_version) FROM \"{table_ident}__crsql_clock\") -
+                        (SELECT min(db_version) FROM \"{table_ident}__crsql_clock\") + 1,
+                        1
+                      )"
+                ))?;
+                stmt.step()?;
+                let rows =
+                    stmt.column_int64(0) as f64 * core::cmp::max(self.non_pks.len(), 1) as f64;
+                let versions = core::cmp::max(stmt.column_int64(1), 1) as f64;
+                (rows, rows / versions)
+            }
+        };
+
+        let stats = ClockStats {
+            db_version,
+            rows,
+            rows_per_version,
+        };
+        self.clock_stats.set(Some(stats));
+        Ok(stats)
+    }
+
+    /**
+     * Whether this table info and `other` were built from the same schema
+     * object, e.g. because their connections share it.
+     */
+    #[cfg(feature = "test")]
+    pub fn shares_schema_with(&self, other: &TableInfo) -> bool {
+        Arc::ptr_eq(&self.schema, &other.schema)
+    }
+
+    fn find_non_pk_col(&self, col_name: &str) -> Result<(&ColumnInfo, &ColumnStmts), ResultCode> {
+        for (col, stmts) in self.non_pks.iter().zip(self.col_stmts.iter()) {
             if col.name == col_name {
-                return Ok(col);
+                return Ok((col, stmts));
             }
         }
         Err(ResultCode::ERROR)
     }
 
+    /**
+     * The id that clock rows of this table use for the given column name.
+     */
+    pub fn get_col_id(&self, col_name: &str) -> Result<i64, ResultCode> {
+        if col_name == crate::c::INSERT_SENTINEL {
+            return Ok(crate::c::SENTINEL_COL_ID);
+        }
+        Ok(self.find_non_pk_col(col_name)?.0.col_id)
+    }
+
     pub fn get_or_create_key(
         &self,
         db: *mut sqlite3,
-        pks: &Vec<ColumnValue>,
+        pks: &[ColumnValueRef],
     ) -> Result<sqlite::int64, ResultCode> {
+        if self.key_is_pk {
+            return self.pk_as_key(pks);
+        }
         let stmt_ref = self.get_select_key_stmt(db)?;
         let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
         bind_package_to_stmt(stmt.stmt, pks, 0)?;
@@ -108,6 +395,10 @@ impl TableInfo {
         db: *mut sqlite3,
         pks: &[*mut value],
     ) -> Result<sqlite::int64, ResultCode> {
+        if self.key_is_pk {
+            // rowid aliases are always integers
+            return Ok(pks[0].int64());
+        }
         let stmt_ref = self.get_select_key_stmt(db)?;
         let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
         for (i, pk) in pks.iter().enumerate() {
@@ -138,6 +429,15 @@ impl TableInfo {
         db: *mut sqlite3,
         pks: &[*mut value],
     ) -> Result<(bool, sqlite::int64), ResultCode> {
+        if self.key_is_pk {
+            // The key existed if the row has clocks.
+            let key = pks[0].int64();
+            let stmt_ref = self.get_select_key_stmt(db)?;
+            let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+            let ret = stmt.bind_int64(1, key).and_then(|_| stmt.step());
+            reset_cached_stmt(stmt.stmt)?;
+            return Ok((ret? == ResultCode::ROW, key));
+        }
         let stmt_ref = self.get_insert_or_ignore_returning_key_stmt(db)?;
         let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
         for (i, pk) in pks.iter().enumerate() {
@@ -181,7 +481,7 @@ impl TableInfo {
     fn create_key(
         &self,
         db: *mut sqlite3,
-        pks: &Vec<ColumnValue>,
+        pks: &[ColumnValueRef],
     ) -> Result<sqlite::int64, ResultCode> {
         let stmt_ref = self.get_insert_key_stmt(db)?;
         let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
@@ -230,13 +530,21 @@ impl TableInfo {
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.select_key_stmt.try_borrow()?.is_none() {
-            let sql = format!(
-                "SELECT __crsql_key FROM \"{table_name}__crsql_pks\" WHERE {pk_where_list}",
-                table_name = crate::util::escape_ident(&self.tbl_name),
-                pk_where_list = crate::util::where_list(&self.pks, None)?,
-            );
+            let sql = if self.key_is_pk {
+                // There's no lookaside to select from. Finds whether the key is in use.
+                format!(
+                    "SELECT key FROM \"{table_name}__crsql_clock\" WHERE key = ? LIMIT 1",
+                    table_name = crate::util::escape_ident(&self.tbl_name),
+                )
+            } else {
+                format!(
+                    "SELECT __crsql_key FROM \"{table_name}__crsql_pks\" WHERE {pk_where_list}",
+                    table_name = crate::util::escape_ident(&self.tbl_name),
+                    pk_where_list = crate::util::where_list(&self.pks, None)?,
+                )
+            };
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.select_key_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.select_key_stmt, ret)?;
         }
         Ok(self.select_key_stmt.try_borrow()?)
     }
@@ -253,7 +561,7 @@ impl TableInfo {
                 pk_bindings = crate::util::binding_list(self.pks.len()),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.insert_key_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.insert_key_stmt, ret)?;
         }
         Ok(self.insert_key_stmt.try_borrow()?)
     }
@@ -274,7 +582,8 @@ impl TableInfo {
                 pk_bindings = crate::util::binding_list(self.pks.len()),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.insert_or_ignore_returning_key_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.insert_or_ignore_returning_key_stmt, ret)?;
         }
         Ok(self.insert_or_ignore_returning_key_stmt.try_borrow()?)
     }
@@ -286,7 +595,7 @@ impl TableInfo {
         if self.set_winner_clock_stmt.try_borrow()?.is_none() {
             let sql = format!(
                 "INSERT OR REPLACE INTO \"{table_name}__crsql_clock\"
-              (key, col_name, col_version, db_version, seq, site_id)
+              (key, col_id, col_version, db_version, seq, site_id)
               VALUES (
                 ?,
                 ?,
@@ -298,7 +607,7 @@ impl TableInfo {
                 table_name = crate::util::escape_ident(&self.tbl_name),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.set_winner_clock_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.set_winner_clock_stmt, ret)?;
         }
         Ok(self.set_winner_clock_stmt.try_borrow()?)
     }
@@ -311,29 +620,79 @@ impl TableInfo {
             // prepare it
             let sql = format!(
               "SELECT COALESCE(
-                (SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_name = '{delete_sentinel}'),
+                (SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_id = {sentinel_id}),
                 (SELECT 1 FROM \"{table_name}__crsql_clock\" WHERE key = ?)
               )",
               table_name = crate::util::escape_ident(&self.tbl_name),
-              delete_sentinel = crate::c::DELETE_SENTINEL,
+              sentinel_id = crate::c::SENTINEL_COL_ID,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.local_cl_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.local_cl_stmt, ret)?;
         }
         Ok(self.local_cl_stmt.try_borrow()?)
     }
 
+    /**
+     * A clock is implicit for a column when the row was created locally under
+     * implicit column clocks (sentinel at version 1 written by this site) and
+     * the column has not been written since. Such columns inherit the sentinel's
+     * clock: version 1, the sentinel's db_version and site.
+     *
+     * Expects the row key bound to ?1.
+     */
+    fn implicit_sentinel_where(&self) -> String {
+        format!(
+            "key = ?1 AND col_id = {sentinel_id} AND col_version = 1 AND site_id = 0",
+            sentinel_id = crate::c::SENTINEL_COL_ID
+        )
+    }
+
+    /**
+     * The non-pk columns as a table of (id, name, idx) so implicit clocks can be
+     * expanded into one row per column. `idx` offsets the column's seq from the
+     * sentinel's seq.
+     */
+    pub fn implicit_columns_query(&self) -> String {
+        self.non_pks
+            .iter()
+            .enumerate()
+            .map(|(i, c)| {
+                format!(
+                    "SELECT {id} AS id, '{name}' AS name, {i} AS idx",
+                    id = c.col_id,
+                    name = crate::util::escape_ident_as_value(&c.name),
+                    i = i
+                )
+            })
+            .collect::<Vec<_>>()
+            .join(" UNION ALL ")
+    }
+
     pub fn get_col_version_stmt(
         &self,
         db: *mut sqlite3,
+        implicit: bool,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.col_version_stmt.try_borrow()?.is_none() {
-            let sql = format!(
-              "SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_name = ?",
-              table_name = crate::util::escape_ident(&self.tbl_name),
-            );
+            let sql = if implicit {
+                // the outer select filters the NULL coalesce so callers still see
+                // `DONE` when there is no clock at all.
+                format!(
+                  "SELECT v FROM (SELECT COALESCE(
+                    (SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ?1 AND col_id = ?2),
+                    (SELECT 1 FROM \"{table_name}__crsql_clock\" WHERE {implicit_where})
+                  ) AS v) WHERE v IS NOT NULL",
+                  table_name = crate::util::escape_ident(&self.tbl_name),
+                  implicit_where = self.implicit_sentinel_where(),
+                )
+            } else {
+                format!(
+                  "SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_id = ?",
+                  table_name = crate::util::escape_ident(&self.tbl_name),
+                )
+            };
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.col_version_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.col_version_stmt, ret)?;
         }
         Ok(self.col_version_stmt.try_borrow()?)
     }
@@ -341,14 +700,26 @@ impl TableInfo {
     pub fn get_col_site_id_stmt(
         &self,
         db: *mut sqlite3,
+        implicit: bool,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.col_site_id_stmt.try_borrow()?.is_none() {
-            let sql = format!(
-              "SELECT site_id FROM crsql_site_id WHERE ordinal = (SELECT site_id FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_name = ?)",
-              table_name = crate::util::escape_ident(&self.tbl_name),
-            );
+            let sql = if implicit {
+                format!(
+                  "SELECT site_id FROM crsql_site_id WHERE ordinal = COALESCE(
+                    (SELECT site_id FROM \"{table_name}__crsql_clock\" WHERE key = ?1 AND col_id = ?2),
+                    (SELECT site_id FROM \"{table_name}__crsql_clock\" WHERE {implicit_where})
+                  )",
+                  table_name = crate::util::escape_ident(&self.tbl_name),
+                  implicit_where = self.implicit_sentinel_where(),
+                )
+            } else {
+                format!(
+                  "SELECT site_id FROM crsql_site_id WHERE ordinal = (SELECT site_id FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_id = ?)",
+                  table_name = crate::util::escape_ident(&self.tbl_name),
+                )
+            };
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.col_site_id_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.col_site_id_stmt, ret)?;
         }
         Ok(self.col_site_id_stmt.try_borrow()?)
     }
@@ -365,7 +736,8 @@ impl TableInfo {
                 pk_bindings = crate::util::binding_list(self.pks.len()),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.merge_pk_only_insert_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.merge_pk_only_insert_stmt, ret)?;
         }
         Ok(self.merge_pk_only_insert_stmt.try_borrow()?)
     }
@@ -381,7 +753,7 @@ impl TableInfo {
                 pk_where_list = crate::util::where_list(&self.pks, None)?,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.merge_delete_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.merge_delete_stmt, ret)?;
         }
         Ok(self.merge_delete_stmt.try_borrow()?)
     }
@@ -392,12 +764,13 @@ impl TableInfo {
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.merge_delete_drop_clocks_stmt.try_borrow()?.is_none() {
             let sql = format!(
-              "DELETE FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_name IS NOT '{sentinel}'",
+              "DELETE FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_id != {sentinel_id}",
               table_name = crate::util::escape_ident(&self.tbl_name),
-              sentinel = crate::c::DELETE_SENTINEL
+              sentinel_id = crate::c::SENTINEL_COL_ID
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.merge_delete_drop_clocks_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.merge_delete_drop_clocks_stmt, ret)?;
         }
         Ok(self.merge_delete_drop_clocks_stmt.try_borrow()?)
     }
@@ -408,12 +781,13 @@ impl TableInfo {
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.zero_clocks_on_resurrect_stmt.try_borrow()?.is_none() {
             let sql = format!(
-              "UPDATE \"{table_name}__crsql_clock\" SET col_version = 0, db_version = crsql_next_db_version(?) WHERE key = ? AND col_name IS NOT '{sentinel}'",
+              "UPDATE \"{table_name}__crsql_clock\" SET col_version = 0, db_version = crsql_next_db_version(?) WHERE key = ? AND col_id != {sentinel_id}",
               table_name = crate::util::escape_ident(&self.tbl_name),
-              sentinel = crate::c::INSERT_SENTINEL
+              sentinel_id = crate::c::SENTINEL_COL_ID
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.zero_clocks_on_resurrect_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.zero_clocks_on_resurrect_stmt, ret)?;
         }
         Ok(self.zero_clocks_on_resurrect_stmt.try_borrow()?)
     }
@@ -426,14 +800,14 @@ impl TableInfo {
             let sql = format!(
                 "INSERT INTO \"{table_name}__crsql_clock\" (
             key,
-            col_name,
+            col_id,
             col_version,
             db_version,
             seq,
             site_id
           ) SELECT
             ?,
-            '{sentinel}',
+            {sentinel_id},
             2,
             ?,
             ?,
@@ -444,10 +818,11 @@ impl TableInfo {
             seq = ?,
             site_id = 0",
                 table_name = crate::util::escape_ident(&self.tbl_name),
-                sentinel = crate::c::DELETE_SENTINEL,
+                sentinel_id = crate::c::SENTINEL_COL_ID,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.mark_locally_deleted_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.mark_locally_deleted_stmt, ret)?;
         }
         Ok(self.mark_locally_deleted_stmt.try_borrow()?)
     }
@@ -458,12 +833,12 @@ impl TableInfo {
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.move_non_sentinels_stmt.try_borrow()?.is_none() {
             let sql = format!(
-              "UPDATE OR REPLACE \"{table_name}__crsql_clock\" SET key = ? WHERE key = ? AND col_name != '{sentinel}'",
+              "UPDATE OR REPLACE \"{table_name}__crsql_clock\" SET key = ? WHERE key = ? AND col_id != {sentinel_id}",
               table_name = crate::util::escape_ident(&self.tbl_name),
-              sentinel = crate::c::DELETE_SENTINEL,
+              sentinel_id = crate::c::SENTINEL_COL_ID,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.move_non_sentinels_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget.cache(&self.move_non_sentinels_stmt, ret)?;
         }
         Ok(self.move_non_sentinels_stmt.try_borrow()?)
     }
@@ -476,14 +851,14 @@ impl TableInfo {
             let sql = format!(
               "INSERT INTO \"{table_name}__crsql_clock\" (
                 key,
-                col_name,
+                col_id,
                 col_version,
                 db_version,
                 seq,
                 site_id
               ) SELECT
                 ?,
-                '{sentinel}',
+                {sentinel_id},
                 1,
                 ?,
                 ?,
@@ -494,10 +869,11 @@ impl TableInfo {
                   seq = ?,
                   site_id = 0",
               table_name = crate::util::escape_ident(&self.tbl_name),
-              sentinel = crate::c::INSERT_SENTINEL,
+              sentinel_id = crate::c::SENTINEL_COL_ID,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.mark_locally_created_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.mark_locally_created_stmt, ret)?;
         }
         Ok(self.mark_locally_created_stmt.try_borrow()?)
     }
@@ -505,12 +881,40 @@ impl TableInfo {
     pub fn get_mark_locally_updated_stmt(
         &self,
         db: *mut sqlite3,
+        implicit: bool,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.mark_locally_updated_stmt.try_borrow()?.is_none() {
-            let sql = format!(
-                "INSERT INTO \"{table_name}__crsql_clock\" (
+            let sql = if implicit {
+                // The first explicit write to a column that still holds an implicit
+                // clock must move past the implicit version of 1.
+                format!(
+                    "INSERT INTO \"{table_name}__crsql_clock\" (
+              key,
+              col_id,
+              col_version,
+              db_version,
+              seq,
+              site_id
+            ) SELECT
+              ?1,
+              ?2,
+              1 + EXISTS (SELECT 1 FROM \"{table_name}__crsql_clock\" WHERE {implicit_where}),
+              ?3,
+              ?4,
+              0 WHERE true
+            ON CONFLICT DO UPDATE SET
+              col_version = col_version + 1,
+              db_version = ?5,
+              seq = ?6,
+              site_id = 0;",
+                    table_name = crate::util::escape_ident(&self.tbl_name),
+                    implicit_where = self.implicit_sentinel_where(),
+                )
+            } else {
+                format!(
+                    "INSERT INTO \"{table_name}__crsql_clock\" (
               key,
-              col_name,
+              col_id,
               col_version,
               db_version,
               seq,
@@ -527,10 +931,12 @@ impl TableInfo {
               db_version = ?,
               seq = ?,
               site_id = 0;",
-                table_name = crate::util::escape_ident(&self.tbl_name),
-            );
+                    table_name = crate::util::escape_ident(&self.tbl_name),
+                )
+            };
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.mark_locally_updated_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.mark_locally_updated_stmt, ret)?;
         }
         Ok(self.mark_locally_updated_stmt.try_borrow()?)
     }
@@ -538,6 +944,7 @@ impl TableInfo {
     pub fn get_maybe_mark_locally_reinserted_stmt(
         &self,
         db: *mut sqlite3,
+        implicit: bool,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self
             .maybe_mark_locally_reinserted_stmt
@@ -550,22 +957,60 @@ impl TableInfo {
                 db_version = ?,
                 seq = ?,
                 site_id = 0
-              WHERE key = ? AND col_name = ?",
+              WHERE key = ? AND col_id = ?{skip_implicit}",
               table_name = crate::util::escape_ident(&self.tbl_name),
+              // An implicit sentinel is what a live row looks like under implicit
+              // clocks. It is equivalent to the absent sentinel of explicit mode.
+              skip_implicit = if implicit {
+                  " AND NOT (col_version = 1 AND site_id = 0)"
+              } else {
+                  ""
+              },
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.maybe_mark_locally_reinserted_stmt.try_borrow_mut()? = Some(ret);
+            self.stmt_budget
+                .cache(&self.maybe_mark_locally_reinserted_stmt, ret)?;
         }
         Ok(self.maybe_mark_locally_reinserted_stmt.try_borrow()?)
     }
 
+    /**
+     * Writes out the implicit clocks of a row as explicit clock records.
+     * Needed before the row's sentinel moves off of its implicit version
+     * while the row's column clocks must survive, e.g. a primary key change.
+     */
+    pub fn get_materialize_implicit_clocks_stmt(
+        &self,
+        db: *mut sqlite3,
+    ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
+        if self
+            .materialize_implicit_clocks_stmt
+            .try_borrow()?
+            .is_none()
+        {
+            let sql = format!(
+              "INSERT OR IGNORE INTO \"{table_name}__crsql_clock\" (key, col_id, col_version, db_version, seq, site_id)
+                SELECT s.key, c.id, 1, s.db_version, s.seq + 1 + c.idx, s.site_id
+                FROM \"{table_name}__crsql_clock\" AS s, ({columns}) AS c
+                WHERE {implicit_where}",
+              table_name = crate::util::escape_ident(&self.tbl_name),
+              columns = self.implicit_columns_query(),
+              implicit_where = self.implicit_sentinel_where(),
+            );
+            let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+            self.stmt_budget
+                .cache(&self.materialize_implicit_clocks_stmt, ret)?;
+        }
+        Ok(self.materialize_implicit_clocks_stmt.try_borrow()?)
+    }
+
     pub fn get_col_value_stmt(
         &self,
         db: *mut sqlite3,
         col_name: &str,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
-        let col_info = self.find_non_pk_col(col_name)?;
-        col_info.get_curr_value_stmt(self, db)
+        let (col_info, stmts) = self.find_non_pk_col(col_name)?;
+        stmts.get_curr_value_stmt(col_info, self, db)
     }
 
     pub fn get_merge_insert_stmt(
@@ -573,8 +1018,8 @@ impl TableInfo {
         db: *mut sqlite3,
         col_name: &str,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
-        let col_info = self.find_non_pk_col(col_name)?;
-        col_info.get_merge_insert_stmt(self, db)
+        let (col_info, stmts) = self.find_non_pk_col(col_name)?;
+        stmts.get_merge_insert_stmt(col_info, self, db)
     }
 
     pub fn get_row_patch_data_stmt(
@@ -582,46 +1027,108 @@ impl TableInfo {
         db: *mut sqlite3,
         col_name: &str,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
-        let col_info = self.find_non_pk_col(col_name)?;
-        col_info.get_row_patch_data_stmt(self, db)
+        let (col_info, stmts) = self.find_non_pk_col(col_name)?;
+        stmts.get_row_patch_data_stmt(col_info, self, db)
+    }
+
+    /**
+     * Selects all of `non_pks`, in order, of the row with the bound pks.
+     * Only valid for tables with non pk columns.
+     */
+    pub fn get_row_data_stmt(
+        &self,
+        db: *mut sqlite3,
+    ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
+        if self.row_data_stmt.try_borrow()?.is_none() {
+            let sql = format!(
+                "SELECT {col_list} FROM \"{table_name}\" WHERE {where_list}",
+                col_list = crate::util::as_identifier_list(&self.non_pks, None)?,
+                table_name = crate::util::escape_ident(&self.tbl_name),
+                where_list = crate::util::where_list(&self.pks, None)?
+            );
+            let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+            self.stmt_budget.cache(&self.row_data_stmt, ret)?;
+        }
+        Ok(self.row_data_stmt.try_borrow()?)
+    }
+
+    /**
+     * Position of the non pk column `col_name` in `non_pks`.
+     */
+    pub fn non_pk_index(&self, col_name: &str) -> Option<usize> {
+        self.non_pks.iter().position(|c| c.name == col_name)
+    }
+
+    /**
+     * Prepares every statement the table uses for local writes and merges so
+     * the first write or merge does not pay for it. See `crsql_warmup`.
+     */
+    pub fn prepare_stmts(
+        &self,
+        db: *mut sqlite3,
+        implicit: bool,
+    ) -> Result<ResultCode, ResultCode> {
+        self.get_select_key_stmt(db)?;
+        if !self.key_is_pk {
+            self.get_insert_key_stmt(db)?;
+            self.get_insert_or_ignore_returning_key_stmt(db)?;
+        }
+
+        self.get_set_winner_clock_stmt(db)?;
+        self.get_local_cl_stmt(db)?;
+        self.get_col_version_stmt(db, implicit)?;
+        self.get_col_site_id_stmt(db, implicit)?;
+        self.get_merge_pk_only_insert_stmt(db)?;
+        self.get_merge_delete_stmt(db)?;
+        self.get_merge_delete_drop_clocks_stmt(db)?;
+        self.get_zero_clocks_on_resurrect_stmt(db)?;
+
+        self.get_mark_locally_deleted_stmt(db)?;
+        self.get_move_non_sentinels_stmt(db)?;
+        self.get_mark_locally_created_stmt(db)?;
+        self.get_mark_locally_updated_stmt(db, implicit)?;
+        self.get_maybe_mark_locally_reinserted_stmt(db, implicit)?;
+        if implicit && self.non_pks.len() > 0 {
+            self.get_materialize_implicit_clocks_stmt(db)?;
+        }
+
+        for (col, stmts) in self.non_pks.iter().zip(self.col_stmts.iter()) {
+            stmts.get_curr_value_stmt(col, self, db)?;
+            stmts.get_merge_insert_stmt(col, self, db)?;
+            stmts.get_row_patch_data_stmt(col, self, db)?;
+        }
+
+        Ok(ResultCode::OK)
+    }
+
+    pub fn set_stmt_cache_size(&self, size: usize) -> Result<ResultCode, ResultCode> {
+        self.stmt_budget.set_limit(size)
     }
 
     pub fn clear_stmts(&self) -> Result<ResultCode, ResultCode> {
         // finalize all stmts
-        let mut stmt = self.set_winner_clock_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.local_cl_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.col_version_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.merge_pk_only_insert_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.merge_delete_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.merge_delete_drop_clocks_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.zero_clocks_on_resurrect_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.mark_locally_deleted_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.move_non_sentinels_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.mark_locally_created_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.mark_locally_updated_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.maybe_mark_locally_reinserted_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.insert_key_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.insert_or_ignore_returning_key_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.select_key_stmt.try_borrow_mut()?;
-        stmt.take();
+        self.set_winner_clock_stmt.clear()?;
+        self.local_cl_stmt.clear()?;
+        self.col_version_stmt.clear()?;
+        self.col_site_id_stmt.clear()?;
+        self.merge_pk_only_insert_stmt.clear()?;
+        self.merge_delete_stmt.clear()?;
+        self.merge_delete_drop_clocks_stmt.clear()?;
+        self.zero_clocks_on_resurrect_stmt.clear()?;
+        self.mark_locally_deleted_stmt.clear()?;
+        self.move_non_sentinels_stmt.clear()?;
+        self.mark_locally_created_stmt.clear()?;
+        self.mark_locally_updated_stmt.clear()?;
+        self.maybe_mark_locally_reinserted_stmt.clear()?;
+        self.materialize_implicit_clocks_stmt.clear()?;
+        self.insert_key_stmt.clear()?;
+        self.insert_or_ignore_returning_key_stmt.clear()?;
+        self.select_key_stmt.clear()?;
+        self.row_data_stmt.clear()?;
 
         // primary key columns shouldn't have statements? right?
-        for col in &self.non_pks {
-            col.clear_stmts()?;
+        for stmts in &self.col_stmts {
+            stmts.clear_stmts()?;
         }
 
         Ok(ResultCode::OK)
@@ -638,6 +1145,8 @@ impl Drop for TableInfo {
 pub struct ColumnInfo {
     pub cid: i32,
     pub name: String,
+    // id of the column in `{table}__crsql_cols`. Clock rows reference columns by this id.
+    pub col_id: i64,
     // > 0 if it is a primary key columns
     // the value refers to the position in the `PRIMARY KEY (cols...)` statement
     pub pk: i32,
@@ -648,32 +1157,37 @@ pub struct ColumnInfo {
     // If we track that "we've seen this restored node since the backup point with the old site_id"
     // then site_id comparisons could change merge results after restore for nodes that
     // have different "seen since" records for the old site_id.
-    curr_value_stmt: RefCell<Option<ManagedStmt>>,
-    merge_insert_stmt: RefCell<Option<ManagedStmt>>,
-    row_patch_data_stmt: RefCell<Option<ManagedStmt>>,
 }
 
-impl ColumnInfo {
+struct ColumnStmts {
+    curr_value_stmt: Rc<CachedStmt>,
+    merge_insert_stmt: Rc<CachedStmt>,
+    row_patch_data_stmt: Rc<CachedStmt>,
+}
+
+impl ColumnStmts {
     fn get_curr_value_stmt(
         &self,
+        col: &ColumnInfo,
         tbl_info: &TableInfo,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.curr_value_stmt.try_borrow()?.is_none() {
             let sql = format!(
                 "SELECT \"{col_name}\" FROM \"{table_name}\" WHERE {pk_where_list}",
-                col_name = crate::util::escape_ident(&self.name),
+                col_name = crate::util::escape_ident(&col.name),
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
                 pk_where_list = crate::util::where_list(&tbl_info.pks, None)?,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.curr_value_stmt.try_borrow_mut()? = Some(ret);
+            tbl_info.stmt_budget.cache(&self.curr_value_stmt, ret)?;
         }
         Ok(self.curr_value_stmt.try_borrow()?)
     }
 
     fn get_merge_insert_stmt(
         &self,
+        col: &ColumnInfo,
         tbl_info: &TableInfo,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
@@ -685,46 +1199,44 @@ impl ColumnInfo {
                 SET \"{col_name}\" = ?",
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
                 pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)?,
-                col_name = crate::util::escape_ident(&self.name),
+                col_name = crate::util::escape_ident(&col.name),
                 pk_bind_list = crate::util::binding_list(tbl_info.pks.len()),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.merge_insert_stmt.try_borrow_mut()? = Some(ret);
+            tbl_info.stmt_budget.cache(&self.merge_insert_stmt, ret)?;
         }
         Ok(self.merge_insert_stmt.try_borrow()?)
     }
 
     fn get_row_patch_data_stmt(
         &self,
+        col: &ColumnInfo,
         tbl_info: &TableInfo,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.row_patch_data_stmt.try_borrow()?.is_none() {
             let sql = format!(
                 "SELECT \"{col_name}\" FROM \"{table_name}\" WHERE {where_list}\0",
-                col_name = crate::util::escape_ident(&self.name),
+                col_name = crate::util::escape_ident(&col.name),
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
                 where_list = crate::util::where_list(&tbl_info.pks, None)?
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.row_patch_data_stmt.try_borrow_mut()? = Some(ret);
+            tbl_info.stmt_budget.cache(&self.row_patch_data_stmt, ret)?;
         }
         Ok(self.row_patch_data_stmt.try_borrow()?)
     }
 
     pub fn clear_stmts(&self) -> Result<ResultCode, ResultCode> {
-        let mut stmt = self.curr_value_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.merge_insert_stmt.try_borrow_mut()?;
-        stmt.take();
-        let mut stmt = self.row_patch_data_stmt.try_borrow_mut()?;
-        stmt.take();
+        self.curr_value_stmt.clear()?;
+        self.merge_insert_stmt.clear()?;
+        self.row_patch_data_stmt.clear()?;
 
         Ok(ResultCode::OK)
     }
 }
 
-impl Drop for ColumnInfo {
+impl Drop for ColumnStmts {
     fn drop(&mut self) {
         // we'll leak rather than panic
         let _ = self.clear_stmts();
@@ -744,6 +1256,18 @@ pub extern "C" fn crsql_drop_table_info_vec(ext_data: *mut crsql_ExtData) {
     }
 }
 
+/**
+ * Clock tables may have been written by someone else. Their max db_versions are
+ * read again on next use.
+ */
+pub fn crsql_forget_max_db_versions(ext_data: *mut crsql_ExtData) {
+    let table_infos =
+        unsafe { ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>)) };
+    for tbl_info in table_infos.iter() {
+        tbl_info.max_db_version.set(None);
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn crsql_ensure_table_infos_are_up_to_date(
     db: *mut sqlite::sqlite3,
@@ -755,6 +1279,10 @@ pub extern "C" fn crsql_ensure_table_infos_are_up_to_date(
         return ResultCode::OK as c_int;
     }
 
+    if let Err(rc) = crate::config::refresh_implicit_column_clocks(db, ext_data) {
+        return rc as c_int;
+    }
+
     let schema_changed =
         unsafe { crsql_fetchPragmaSchemaVersion(db, ext_data, TABLE_INFO_SCHEMA_VERSION) };
 
@@ -764,8 +1292,17 @@ pub extern "C" fn crsql_ensure_table_infos_are_up_to_date(
 
     let mut table_infos = unsafe { Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>) };
 
+    if schema_changed > 0 {
+        // e.g. crsql_commit_alter backfills clock rows from plain SQL
+        for tbl_info in table_infos.iter() {
+            tbl_info.max_db_version.set(None);
+        }
+    }
+
     if schema_changed > 0 || table_infos.len() == 0 {
-        match pull_all_table_infos(db, ext_data, err) {
+        // On error the table infos are left empty and get pulled from scratch next time.
+        let prev_table_infos = core::mem::take(&mut *table_infos);
+        match pull_all_table_infos(db, ext_data, prev_table_infos, err) {
             Ok(new_table_infos) => {
                 *table_infos = new_table_infos;
                 forget(table_infos);
@@ -788,9 +1325,14 @@ pub extern "C" fn crsql_ensure_table_infos_are_up_to_date(
     return ResultCode::OK as c_int;
 }
 
+/**
+ * Re-uses the table infos in `prev_table_infos` whose table definition did not
+ * change so their cached statements stay warm. All others are pulled again.
+ */
 fn pull_all_table_infos(
     db: *mut sqlite::sqlite3,
     ext_data: *mut crsql_ExtData,
+    mut prev_table_infos: Vec<TableInfo>,
     err: *mut *mut c_char,
 ) -> Result<Vec<TableInfo>, ResultCode> {
     let mut clock_table_names = vec![];
@@ -811,18 +1353,92 @@ fn pull_all_table_infos(
         }
     }
 
+    let stmt_budget = match prev_table_infos.first() {
+        Some(t) => t.stmt_budget.clone(),
+        None => StmtBudget::new(0),
+    };
+    stmt_budget.set_limit(unsafe { (*ext_data).stmtCacheSize } as usize)?;
+
+    let mut db_file: Option<String> = None;
     let mut ret = vec![];
     for name in clock_table_names {
-        ret.push(pull_table_info(
-            db,
-            &name[0..(name.len() - "__crsql_clock".len())],
-            err,
-        )?)
+        let table = &name[0..(name.len() - "__crsql_clock".len())];
+        let fingerprint = schema_fingerprint(db, table)?;
+        if let Some(i) = prev_table_infos
+            .iter()
+            .position(|t| t.tbl_name == table && t.schema_fingerprint == fingerprint)
+        {
+            ret.push(prev_table_infos.swap_remove(i));
+            continue;
+        }
+
+        let db_file = match db_file {
+            Some(ref f) => f,
+            None => db_file.insert(main_db_file(db)?),
+        };
+        // Another connection to the same file may have pulled this schema already.
+        let schema = match crate::schema_cache::get(db_file, table, &fingerprint) {
+            Some(schema) => schema,
+            None => crate::schema_cache::insert(db_file, pull_table_schema(db, table, err)?),
+        };
+        ret.push(TableInfo::new(schema, stmt_budget.clone()));
     }
 
     Ok(ret)
 }
 
+/**
+ * The file backing the main database. Empty for in-memory and temporary databases.
+ */
+fn main_db_file(db: *mut sqlite::sqlite3) -> Result<String, ResultCode> {
+    let stmt =
+        db.prepare_v2("SELECT coalesce(file, '') FROM pragma_database_list WHERE name = 'main'")?;
+    if stmt.step()? == ResultCode::ROW {
+        Ok(stmt.column_text(0)?.to_string())
+    } else {
+        Ok(String::new())
+    }
+}
+
+/**
+ * Everything a `TableInfo` is derived from: the table's definition, the ids
+ * of its columns in the clock table and whether it has a lookaside.
+ */
+fn schema_fingerprint(db: *mut sqlite::sqlite3, table: &str) -> Result<String, ResultCode> {
+    let stmt = db.prepare_v2(
+        "SELECT name, coalesce(sql, '') FROM sqlite_master WHERE type = 'table' AND name IN (?1, ?1 || '__crsql_cols', ?1 || '__crsql_pks') ORDER BY name",
+    )?;
+    stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
+    let mut fingerprint = String::new();
+    let mut has_col_ids = false;
+    let mut has_lookaside = false;
+    while stmt.step()? == ResultCode::ROW {
+        let name = stmt.column_text(0)?;
+        if name == table {
+            fingerprint.push_str(stmt.column_text(1)?);
+        } else if name.ends_with("__crsql_pks") {
+            has_lookaside = true;
+        } else {
+            has_col_ids = true;
+        }
+    }
+    if has_lookaside {
+        fingerprint.push_str("\npks");
+    }
+
+    if has_col_ids {
+        let stmt = db.prepare_v2(&format!(
+            "SELECT coalesce(group_concat(col_id || ' ' || col_name, ','), '') FROM \"{table}__crsql_cols\"",
+            table = crate::util::escape_ident(table),
+        ))?;
+        stmt.step()?;
+        fingerprint.push('\n');
+        fingerprint.push_str(stmt.column_text(0)?);
+    }
+
+    Ok(fingerprint)
+}
+
 /**
  * Given a table name, return the table info that describes that table.
  * TableInfo is a struct that represents the results
@@ -834,6 +1450,15 @@ pub fn pull_table_info(
     table: &str,
     err: *mut *mut c_char,
 ) -> Result<TableInfo, ResultCode> {
+    let schema = pull_table_schema(db, table, err)?;
+    Ok(TableInfo::new(Arc::new(schema), StmtBudget::new(0)))
+}
+
+fn pull_table_schema(
+    db: *mut sqlite::sqlite3,
+    table: &str,
+    err: *mut *mut c_char,
+) -> Result<TableSchema, ResultCode> {
     let sql = format!("SELECT count(*) FROM pragma_table_info('{table}')");
     let columns_len = match db.prepare_v2(&sql).and_then(|stmt| {
         stmt.step()?;
@@ -846,22 +1471,58 @@ pub fn pull_table_info(
         }
     };
 
-    let sql = format!(
-        "SELECT \"cid\", \"name\", \"pk\"
-         FROM pragma_table_info('{table}') ORDER BY cid ASC"
-    );
+    // Column ids only exist once the crr's clock tables have been created.
+    let has_col_ids = match db
+        .prepare_v2("SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?")
+        .and_then(|stmt| {
+            stmt.bind_text(
+                1,
+                &format!("{table}__crsql_cols"),
+                sqlite::Destructor::TRANSIENT,
+            )?;
+            stmt.step()?;
+            Ok(stmt.column_int(0) > 0)
+        }) {
+        Ok(exists) => exists,
+        Err(code) => {
+            err.set(&format!("Failed to look up column ids for crr -- {table}"));
+            return Err(code);
+        }
+    };
+
+    // pk columns have no clocks and so no id. Other columns get theirs when the
+    // crr is created or an alter of it is committed. Pulling only ever reads.
+    let sql = if has_col_ids {
+        format!(
+            "SELECT t.\"cid\", t.\"name\", t.\"pk\", CASE WHEN t.pk > 0 THEN 0 ELSE c.col_id END
+             FROM pragma_table_info('{table}') AS t
+             LEFT JOIN \"{table_ident}__crsql_cols\" AS c ON c.col_name = t.name
+             ORDER BY t.cid ASC",
+            table_ident = crate::util::escape_ident(table)
+        )
+    } else {
+        format!(
+            "SELECT \"cid\", \"name\", \"pk\", 0
+             FROM pragma_table_info('{table}') ORDER BY cid ASC"
+        )
+    };
     let column_infos = match db.prepare_v2(&sql) {
         Ok(stmt) => {
             let mut cols: Vec<ColumnInfo> = vec![];
 
             while stmt.step()? == ResultCode::ROW {
+                if stmt.column_type(3)? == sqlite::ColumnType::Null {
+                    err.set(&format!(
+                        "Column {} of crr {table} has no id. Was it added outside of crsql_begin_alter / crsql_commit_alter?",
+                        stmt.column_text(1)?
+                    ));
+                    return Err(ResultCode::ERROR);
+                }
                 cols.push(ColumnInfo {
                     name: stmt.column_text(1)?.to_string(),
                     cid: stmt.column_int(0),
                     pk: stmt.column_int(2),
-                    curr_value_stmt: RefCell::new(None),
-                    merge_insert_stmt: RefCell::new(None),
-                    row_patch_data_stmt: RefCell::new(None),
+                    col_id: stmt.column_int64(3),
                 });
             }
 
@@ -880,32 +1541,69 @@ pub fn pull_table_info(
     let (mut pks, non_pks): (Vec<_>, Vec<_>) = column_infos.into_iter().partition(|x| x.pk > 0);
     pks.sort_by_key(|x| x.pk);
 
-    Ok(TableInfo {
+    let schema_fingerprint = match schema_fingerprint(db, table) {
+        Ok(fingerprint) => fingerprint,
+        Err(code) => {
+            err.set(&format!("Failed to fingerprint schema for crr -- {table}"));
+            return Err(code);
+        }
+    };
+
+    let key_is_pk = match key_is_pk(db, table) {
+        Ok(key_is_pk) => key_is_pk,
+        Err(code) => {
+            err.set(&format!(
+                "Failed to find how clocks are keyed for crr -- {table}"
+            ));
+            return Err(code);
+        }
+    };
+
+    Ok(TableSchema {
         tbl_name: table.to_string(),
         pks,
         non_pks,
-        set_winner_clock_stmt: RefCell::new(None),
-        local_cl_stmt: RefCell::new(None),
-        col_version_stmt: RefCell::new(None),
-        col_site_id_stmt: RefCell::new(None),
-
-        select_key_stmt: RefCell::new(None),
-        insert_key_stmt: RefCell::new(None),
-        insert_or_ignore_returning_key_stmt: RefCell::new(None),
-
-        merge_pk_only_insert_stmt: RefCell::new(None),
-        merge_delete_stmt: RefCell::new(None),
-        merge_delete_drop_clocks_stmt: RefCell::new(None),
-        zero_clocks_on_resurrect_stmt: RefCell::new(None),
-
-        mark_locally_deleted_stmt: RefCell::new(None),
-        move_non_sentinels_stmt: RefCell::new(None),
-        mark_locally_created_stmt: RefCell::new(None),
-        mark_locally_updated_stmt: RefCell::new(None),
-        maybe_mark_locally_reinserted_stmt: RefCell::new(None),
+        schema_fingerprint,
+        key_is_pk,
     })
 }
 
+/**
+ * Crrs made once the table has a single rowid alias pk key their clocks by the
+ * pk. Others, including crrs made by earlier versions, have a lookaside.
+ */
+fn key_is_pk(db: *mut sqlite::sqlite3, table: &str) -> Result<bool, ResultCode> {
+    let stmt = db.prepare_v2(
+        "SELECT
+          (SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?1 || '__crsql_clock'),
+          (SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?1 || '__crsql_pks')",
+    )?;
+    stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
+    stmt.step()?;
+    if stmt.column_int(0) > 0 {
+        return Ok(stmt.column_int(1) == 0);
+    }
+    pk_is_rowid_alias(db, table)
+}
+
+/**
+ * Whether the table's pk is a single `INTEGER PRIMARY KEY` aliasing the rowid.
+ * Only those are guaranteed to hold integers. Rowid aliases are the one kind of
+ * pk without an index: `WITHOUT ROWID` tables and, by a quirk of SQLite, a
+ * column declared `INTEGER PRIMARY KEY DESC` get one. A table constraint
+ * `PRIMARY KEY (id DESC)` is still an alias.
+ */
+pub fn pk_is_rowid_alias(db: *mut sqlite::sqlite3, table: &str) -> Result<bool, ResultCode> {
+    let stmt = db.prepare_v2(
+        "SELECT count(*) = 1 AND sum(upper(type) = 'INTEGER') = 1
+          AND NOT EXISTS (SELECT 1 FROM pragma_index_list(?1) WHERE origin = 'pk')
+        FROM pragma_table_info(?1) WHERE pk > 0",
+    )?;
+    stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
+    stmt.step()?;
+    Ok(stmt.column_int(0) == 1)
+}
+
 pub fn is_table_compatible(
     db: *mut sqlite::sqlite3,
     table: &str,
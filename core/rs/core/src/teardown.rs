@@ -15,6 +15,10 @@ pub fn remove_crr_clock_table_if_exists(
     db.exec_safe(&format!(
         "DROP TABLE IF EXISTS \"{table}__crsql_pks\"",
         table = escaped_table
+    ))?;
+    db.exec_safe(&format!(
+        "DROP TABLE IF EXISTS \"{table}__crsql_cols\"",
+        table = escaped_table
     ))
 }
 
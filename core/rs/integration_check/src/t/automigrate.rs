@@ -591,6 +591,43 @@ fn rename_col() -> Result<(), ResultCode> {
     Ok(())
 }
 
+fn unchanged_schema() -> Result<(), ResultCode> {
+    let db = crate::opendb()?;
+    let schema = "
+        CREATE TABLE IF NOT EXISTS todo (id primary key not null, content text);
+        CREATE INDEX IF NOT EXISTS todo_content ON todo (content);
+        SELECT crsql_as_crr('todo');
+    ";
+    invoke_automigrate(&db.db, schema)?;
+    let version = schema_version(&db.db)?;
+
+    // Same schema, formatted differently. Nothing to do, not even re-creating the crr triggers.
+    invoke_automigrate(
+        &db.db,
+        "CREATE TABLE IF NOT EXISTS todo (id primary key not null, content text);
+        CREATE INDEX IF NOT EXISTS todo_content ON todo (content);
+        SELECT crsql_as_crr('todo');",
+    )?;
+    assert_eq!(schema_version(&db.db)?, version);
+
+    // The schema was changed behind automigrate's back. Migrate it back.
+    db.db.exec_safe("ALTER TABLE todo ADD COLUMN extra")?;
+    invoke_automigrate(&db.db, schema)?;
+    assert!(expect_columns(&db.db, "todo", vec!["id", "content"])?);
+    assert!(expect_indices(
+        &db.db,
+        "todo",
+        vec!["sqlite_autoindex_todo_1", "todo_content"]
+    )?);
+    Ok(())
+}
+
+fn schema_version(db: &ManagedConnection) -> Result<i64, ResultCode> {
+    let stmt = db.prepare_v2("PRAGMA schema_version")?;
+    stmt.step()?;
+    Ok(stmt.column_int64(0))
+}
+
 fn expect_columns(
     db: &ManagedConnection,
     table: &str,
@@ -663,6 +700,7 @@ pub fn run_suite() -> Result<(), ResultCode> {
     change_index_to_unique()?;
     remove_col_from_index()?;
     add_col_to_index()?;
+    unchanged_schema()?;
     idempotent();
     change_index_col_order();
     add_many_cols();
@@ -31,7 +31,7 @@ fn new_nonempty_table(apply_twice: bool) -> Result<(), ResultCode> {
     while stmt.step()? == ResultCode::ROW {
         cnt = cnt + 1;
         assert_eq!(stmt.column_int64(0), cnt); // pk
-        assert_eq!(stmt.column_text(1)?, "name"); // col name
+        assert_eq!(stmt.column_int64(1), 1); // col id
         assert_eq!(stmt.column_int64(2), 1); // col version
         assert_eq!(stmt.column_int64(3), 1); // db version
     }
@@ -1,5 +1,7 @@
 use crsql_bundle::test_exports::pack_columns::unpack_columns;
+use crsql_bundle::test_exports::pack_columns::unpack_columns_ref;
 use crsql_bundle::test_exports::pack_columns::ColumnValue;
+use crsql_bundle::test_exports::pack_columns::ColumnValueRef;
 use sqlite::{Connection, ResultCode};
 use sqlite_nostd as sqlite;
 
@@ -138,7 +140,45 @@ fn test_unpack_columns() -> Result<(), ResultCode> {
     Ok(())
 }
 
+fn test_unpack_columns_ref() -> Result<(), ResultCode> {
+    let db = crate::opendb()?;
+    // more columns than are held inline so the small vector spills
+    let select_stmt = db
+        .db
+        .prepare_v2("SELECT crsql_pack_columns(1, 'a', x'0102', 2.5, NULL, 'bc', -3)")?;
+    select_stmt.step()?;
+    let packed = select_stmt.column_blob(0)?;
+    let unpacked = unpack_columns_ref(packed)?;
+    assert!(unpacked.len() == 7);
+
+    assert!(matches!(unpacked[0], ColumnValueRef::Integer(1)));
+    if let ColumnValueRef::Text(t) = &unpacked[1] {
+        assert!(t.as_ref() == "a");
+        // borrowed from the packed buffer rather than copied out of it
+        assert!(packed.as_ptr_range().contains(&t.as_ptr()));
+    } else {
+        assert!("unexpected type" == "");
+    }
+    if let ColumnValueRef::Blob(b) = &unpacked[2] {
+        assert!(b.as_ref() == [1, 2]);
+        assert!(packed.as_ptr_range().contains(&b.as_ptr()));
+    } else {
+        assert!("unexpected type" == "");
+    }
+    assert!(matches!(unpacked[3], ColumnValueRef::Float(f) if f == 2.5));
+    assert!(matches!(unpacked[4], ColumnValueRef::Null));
+    assert!(matches!(unpacked[5], ColumnValueRef::Text(ref t) if t.as_ref() == "bc"));
+    assert!(matches!(unpacked[6], ColumnValueRef::Integer(-3)));
+
+    // truncated packages are rejected rather than read past
+    assert!(unpack_columns_ref(&packed[..packed.len() - 1]).is_err());
+    assert!(unpack_columns_ref(&[]).is_err());
+
+    Ok(())
+}
+
 pub fn run_suite() -> Result<(), ResultCode> {
     test_pack_columns()?;
-    test_unpack_columns()
+    test_unpack_columns()?;
+    test_unpack_columns_ref()
 }
@@ -1,7 +1,6 @@
 extern crate alloc;
 use alloc::boxed::Box;
 use alloc::ffi::CString;
-use alloc::string::ToString;
 use alloc::vec::Vec;
 use core::{ffi::c_char, mem};
 use crsql_bundle::test_exports;
@@ -43,7 +42,7 @@ fn test_ensure_table_infos_are_up_to_date() {
     c.exec_safe(
         "CREATE TABLE foo__crsql_clock (
       id,
-      col_name,
+      col_id,
       col_version,
       db_version,
       site_id,
@@ -62,8 +61,8 @@ fn test_ensure_table_infos_are_up_to_date() {
     assert_eq!(table_infos.len(), 1);
     assert_eq!(table_infos[0].tbl_name, "foo");
 
-    // we're going to change table infos so we can check that it does not get filled again since no schema changes happened
-    table_infos[0].tbl_name = "bar".to_string();
+    // table infos are immutable. Check that they do not get filled again since no schema changes happened
+    let foo_cols = table_infos[0].non_pks.as_ptr();
 
     unsafe {
         (*ext_data).updatedTableInfosThisTx = 0;
@@ -71,14 +70,14 @@ fn test_ensure_table_infos_are_up_to_date() {
     test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(raw_db, ext_data, err);
 
     assert_eq!(table_infos.len(), 1);
-    assert_eq!(table_infos[0].tbl_name, "bar");
+    assert_eq!(table_infos[0].non_pks.as_ptr(), foo_cols);
 
     c.exec_safe("CREATE TABLE boo (a PRIMARY KEY NOT NULL, b);")
         .expect("made boo");
     c.exec_safe(
         "CREATE TABLE boo__crsql_clock (
       id,
-      col_name,
+      col_id,
       col_version,
       db_version,
       site_id,
@@ -116,6 +115,125 @@ fn test_ensure_table_infos_are_up_to_date() {
     };
 }
 
+fn test_table_infos_kept_across_unrelated_schema_changes() {
+    let db = crate::opendb().expect("Opened DB");
+    let c = &db.db;
+    let raw_db = db.db.db;
+    let err = make_err_ptr();
+
+    c.exec_safe("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b);")
+        .expect("made foo");
+    c.exec_safe("SELECT crsql_as_crr('foo');")
+        .expect("made foo a crr");
+    c.exec_safe("CREATE TABLE boo (a PRIMARY KEY NOT NULL, b);")
+        .expect("made boo");
+    c.exec_safe("SELECT crsql_as_crr('boo');")
+        .expect("made boo a crr");
+
+    let ext_data = unsafe { test_exports::c::crsql_newExtData(raw_db, make_site()) };
+    test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(raw_db, ext_data, err);
+    let table_infos = unsafe {
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>))
+    };
+    assert_eq!(table_infos.len(), 2);
+    let foo_cols = table_infos[0].non_pks.as_ptr();
+    let boo_cols = table_infos[1].non_pks.as_ptr();
+
+    // schema changes that don't touch any crr keep every table info
+    c.exec_safe("CREATE INDEX foo_b ON foo (b);")
+        .expect("made index");
+    c.exec_safe("CREATE TEMP TABLE scratch (a);")
+        .expect("made temp table");
+    unsafe {
+        (*ext_data).updatedTableInfosThisTx = 0;
+    }
+    test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(raw_db, ext_data, err);
+    assert_eq!(table_infos.len(), 2);
+    assert_eq!(table_infos[0].non_pks.as_ptr(), foo_cols);
+    assert_eq!(table_infos[1].non_pks.as_ptr(), boo_cols);
+
+    // altering a crr only re-pulls that crr
+    c.exec_safe("SELECT crsql_begin_alter('boo');")
+        .expect("began alter");
+    c.exec_safe("ALTER TABLE boo ADD COLUMN c;")
+        .expect("altered boo");
+    c.exec_safe("SELECT crsql_commit_alter('boo');")
+        .expect("committed alter");
+    unsafe {
+        (*ext_data).updatedTableInfosThisTx = 0;
+    }
+    test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(raw_db, ext_data, err);
+    assert_eq!(table_infos.len(), 2);
+    assert_eq!(table_infos[0].tbl_name, "foo");
+    assert_eq!(table_infos[0].non_pks.as_ptr(), foo_cols);
+    assert_eq!(table_infos[1].tbl_name, "boo");
+    assert_eq!(table_infos[1].non_pks.len(), 2);
+    assert!(table_infos[1].non_pks[1].col_id > 0);
+
+    drop_err_ptr(err);
+    unsafe {
+        test_exports::c::crsql_freeExtData(ext_data);
+    };
+}
+
+fn test_schemas_shared_across_connections() {
+    let c1w = crate::opendb_file("test_schemas_shared_across_connections").expect("Opened DB");
+    let c2w = crate::opendb_file("test_schemas_shared_across_connections").expect("Opened DB");
+    let c1 = &c1w.db;
+    let err = make_err_ptr();
+
+    c1.exec_safe(
+        "DROP TABLE IF EXISTS foo;
+        VACUUM;",
+    )
+    .expect("reset db");
+    c1.exec_safe("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b);")
+        .expect("made foo");
+    c1.exec_safe("SELECT crsql_as_crr('foo');")
+        .expect("made foo a crr");
+
+    let ext_data1 = unsafe { test_exports::c::crsql_newExtData(c1w.db.db, make_site()) };
+    let ext_data2 = unsafe { test_exports::c::crsql_newExtData(c2w.db.db, make_site()) };
+    let ensure = || unsafe {
+        (*ext_data1).updatedTableInfosThisTx = 0;
+        (*ext_data2).updatedTableInfosThisTx = 0;
+        test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(c1w.db.db, ext_data1, err);
+        test_exports::tableinfo::crsql_ensure_table_infos_are_up_to_date(c2w.db.db, ext_data2, err);
+    };
+    let table_infos1 = unsafe {
+        mem::ManuallyDrop::new(Box::from_raw(
+            (*ext_data1).tableInfos as *mut Vec<TableInfo>,
+        ))
+    };
+    let table_infos2 = unsafe {
+        mem::ManuallyDrop::new(Box::from_raw(
+            (*ext_data2).tableInfos as *mut Vec<TableInfo>,
+        ))
+    };
+
+    ensure();
+    assert_eq!(table_infos1.len(), 1);
+    assert_eq!(table_infos2.len(), 1);
+    assert!(table_infos1[0].shares_schema_with(&table_infos2[0]));
+
+    // once one connection alters the table, both move to the same new schema
+    c1.exec_safe("SELECT crsql_begin_alter('foo');")
+        .expect("began alter");
+    c1.exec_safe("ALTER TABLE foo ADD COLUMN c;")
+        .expect("altered foo");
+    c1.exec_safe("SELECT crsql_commit_alter('foo');")
+        .expect("committed alter");
+    ensure();
+    assert_eq!(table_infos1[0].non_pks.len(), 2);
+    assert!(table_infos1[0].shares_schema_with(&table_infos2[0]));
+
+    drop_err_ptr(err);
+    unsafe {
+        test_exports::c::crsql_freeExtData(ext_data1);
+        test_exports::c::crsql_freeExtData(ext_data2);
+    };
+}
+
 fn test_pull_table_info() {
     let db = crate::opendb().expect("Opened DB");
     let c = &db.db;
@@ -358,6 +476,8 @@ fn test_leak_condition() {
 
 pub fn run_suite() {
     test_ensure_table_infos_are_up_to_date();
+    test_table_infos_kept_across_unrelated_schema_changes();
+    test_schemas_shared_across_connections();
     test_pull_table_info();
     test_is_table_compatible();
     test_create_clock_table_from_table_info();
@@ -104,8 +104,35 @@ fn test_next_db_version() -> Result<(), String> {
     Ok(())
 }
 
+fn test_next_db_version_checks_data_version_once_per_tx() -> Result<(), String> {
+    let c = crate::opendb().expect("db opened");
+    let db = &c.db;
+    let raw_db = db.db;
+    let ext_data = unsafe { test_exports::c::crsql_newExtData(raw_db, make_site()) };
+
+    // outside of a write transaction nothing would reset the bit
+    test_exports::db_version::next_db_version(raw_db, ext_data, None)?;
+    assert_eq!(0, unsafe { (*ext_data).checkedDataVersionThisTx });
+
+    db.exec_safe("BEGIN; CREATE TABLE foo (a primary key not null, b);")
+        .expect("started write tx");
+    test_exports::db_version::next_db_version(raw_db, ext_data, None)?;
+    assert_eq!(1, unsafe { (*ext_data).checkedDataVersionThisTx });
+    assert_eq!(
+        1,
+        test_exports::db_version::next_db_version(raw_db, ext_data, None)?
+    );
+    db.exec_safe("COMMIT").expect("committed");
+
+    unsafe {
+        test_exports::c::crsql_freeExtData(ext_data);
+    };
+    Ok(())
+}
+
 pub fn run_suite() -> Result<(), String> {
     test_fetch_db_version_from_storage()?;
     test_next_db_version()?;
+    test_next_db_version_checks_data_version_once_per_tx()?;
     Ok(())
 }
@@ -16,6 +16,11 @@
   "SELECT tbl_name FROM sqlite_master WHERE type='table' AND tbl_name LIKE " \
   "'%__crsql_clock'"
 
+#define SET_DB_VERSION                                                 \
+  "INSERT INTO crsql_master (key, value) VALUES ('db_version', ?) ON " \
+  "CONFLICT DO UPDATE SET value = excluded.value WHERE value < "       \
+  "excluded.value"
+
 #define SET_SYNC_BIT "SELECT crsql_internal_sync_bit(1)"
 #define CLEAR_SYNC_BIT "SELECT crsql_internal_sync_bit(0)"
 
@@ -39,6 +39,7 @@ static int commitHook(void *pUserData) {
   pExtData->pendingDbVersion = -1;
   pExtData->seq = 0;
   pExtData->updatedTableInfosThisTx = 0;
+  pExtData->checkedDataVersionThisTx = 0;
   return SQLITE_OK;
 }
 
@@ -48,6 +49,7 @@ static void rollbackHook(void *pUserData) {
   pExtData->pendingDbVersion = -1;
   pExtData->seq = 0;
   pExtData->updatedTableInfosThisTx = 0;
+  pExtData->checkedDataVersionThisTx = 0;
 }
 
 #ifdef LIBSQL
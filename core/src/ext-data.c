@@ -44,8 +44,14 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
       sqlite3_prepare_v3(db, CLOCK_TABLES_SELECT, -1, SQLITE_PREPARE_PERSISTENT,
                          &(pExtData->pSelectClockTablesStmt), 0);
 
+  pExtData->pSetDbVersionStmt = 0;
+  rc += sqlite3_prepare_v3(db, SET_DB_VERSION, -1, SQLITE_PREPARE_PERSISTENT,
+                           &(pExtData->pSetDbVersionStmt), 0);
+
   pExtData->dbVersion = -1;
   pExtData->pendingDbVersion = -1;
+  pExtData->siteCount = -1;
+  pExtData->siteCountDbVersion = -1;
   pExtData->seq = 0;
   pExtData->pragmaSchemaVersion = -1;
   pExtData->pragmaDataVersion = -1;
@@ -54,12 +60,13 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
   pExtData->tableInfos = 0;
   pExtData->rowsImpacted = 0;
   pExtData->updatedTableInfosThisTx = 0;
+  pExtData->checkedDataVersionThisTx = 0;
   crsql_init_table_info_vec(pExtData);
 
   sqlite3_stmt *pStmt;
 
   rc += sqlite3_prepare_v2(db,
-                           "SELECT ltrim(key, 'config.'), value FROM "
+                           "SELECT substr(key, 8), value FROM "
                            "crsql_master WHERE key LIKE 'config.%';",
                            -1, &pStmt, 0);
 
@@ -70,6 +77,10 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
 
   // set defaults!
   pExtData->mergeEqualValues = 0;
+  pExtData->implicitColumnClocks = 0;
+  pExtData->stmtCacheSize = 0;
+  pExtData->localChangesIndex = 0;
+  pExtData->totalChangesAtBeginAlter = -1;
 
   while (sqlite3_step(pStmt) == SQLITE_ROW) {
     const unsigned char *name = sqlite3_column_text(pStmt, 0);
@@ -84,6 +95,30 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
         crsql_freeExtData(pExtData);
         return 0;
       }
+    } else if (strcmp("implicit-column-clocks", (char *)name) == 0) {
+      if (colType == SQLITE_INTEGER) {
+        const int value = sqlite3_column_int(pStmt, 1);
+        pExtData->implicitColumnClocks = value;
+      } else {
+        crsql_freeExtData(pExtData);
+        return 0;
+      }
+    } else if (strcmp("stmt-cache-size", (char *)name) == 0) {
+      if (colType == SQLITE_INTEGER) {
+        const int value = sqlite3_column_int(pStmt, 1);
+        pExtData->stmtCacheSize = value;
+      } else {
+        crsql_freeExtData(pExtData);
+        return 0;
+      }
+    } else if (strcmp("local-changes-index", (char *)name) == 0) {
+      if (colType == SQLITE_INTEGER) {
+        const int value = sqlite3_column_int(pStmt, 1);
+        pExtData->localChangesIndex = value;
+      } else {
+        crsql_freeExtData(pExtData);
+        return 0;
+      }
     } else {
       // unhandled config setting
     }
@@ -110,6 +145,7 @@ void crsql_freeExtData(crsql_ExtData *pExtData) {
   sqlite3_finalize(pExtData->pSetSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectClockTablesStmt);
+  sqlite3_finalize(pExtData->pSetDbVersionStmt);
   crsql_clear_stmt_cache(pExtData);
   crsql_drop_table_info_vec(pExtData);
   sqlite3_free(pExtData);
@@ -129,6 +165,7 @@ void crsql_finalize(crsql_ExtData *pExtData) {
   sqlite3_finalize(pExtData->pSetSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectClockTablesStmt);
+  sqlite3_finalize(pExtData->pSetDbVersionStmt);
   crsql_clear_stmt_cache(pExtData);
   pExtData->pDbVersionStmt = 0;
   pExtData->pPragmaSchemaVersionStmt = 0;
@@ -138,6 +175,7 @@ void crsql_finalize(crsql_ExtData *pExtData) {
   pExtData->pSetSiteIdOrdinalStmt = 0;
   pExtData->pSelectSiteIdOrdinalStmt = 0;
   pExtData->pSelectClockTablesStmt = 0;
+  pExtData->pSetDbVersionStmt = 0;
 }
 
 #define DB_VERSION_SCHEMA_VERSION 0
@@ -186,3 +224,34 @@ int crsql_fetchPragmaDataVersion(sqlite3 *db, crsql_ExtData *pExtData) {
 
   return 0;
 }
+
+// Commit and rollback hooks only fire for write transactions so state that is
+// reset by those hooks may only be cached while one is open.
+int crsql_isInWriteTx(sqlite3 *db) {
+  return sqlite3_txn_state(db, "main") == SQLITE_TXN_WRITE;
+}
+
+// Guards the process wide schema cache. SQLite's static mutexes follow the
+// threading mode it was configured with and do nothing when single threaded.
+void crsql_lockSchemaCache() {
+  sqlite3_mutex_enter(sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1));
+}
+
+void crsql_unlockSchemaCache() {
+  sqlite3_mutex_leave(sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1));
+}
+
+// Whether the right hand side of constraint iCons is known while planning and
+// is this site's id. SQLite only knows it when it is a literal or a bound
+// parameter.
+int crsql_isLocalSiteIdConstraint(sqlite3_index_info *pIdxInfo, int iCons,
+                                  crsql_ExtData *pExtData) {
+  sqlite3_value *pVal = 0;
+  if (sqlite3_vtab_rhs_value(pIdxInfo, iCons, &pVal) != SQLITE_OK ||
+      pVal == 0) {
+    return 0;
+  }
+  return sqlite3_value_type(pVal) == SQLITE_BLOB &&
+         sqlite3_value_bytes(pVal) == SITE_ID_LEN &&
+         memcmp(sqlite3_value_blob(pVal), pExtData->siteId, SITE_ID_LEN) == 0;
+}
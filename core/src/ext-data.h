@@ -44,6 +44,33 @@ struct crsql_ExtData {
   sqlite3_stmt *pSelectClockTablesStmt;
 
   int mergeEqualValues;
+  // when set, a fresh local insert only records the create sentinel and
+  // non-pk columns inherit its clock until they're explicitly written.
+  int implicitColumnClocks;
+
+  // set once `crsql_next_db_version()` has checked `PRAGMA data_version` in
+  // the current write transaction. Reset on transaction commit or rollback.
+  int checkedDataVersionThisTx;
+
+  // persists the db_version assigned to the current transaction so other
+  // connections can read it back with a single lookup.
+  sqlite3_stmt *pSetDbVersionStmt;
+
+  // max number of statements the table infos of this connection keep
+  // prepared. The least recently used are finalized past it. 0 is unbounded.
+  int stmtCacheSize;
+
+  // whether crrs have a partial index on the db_version of local changes.
+  int localChangesIndex;
+
+  // `total_changes()` as of the first `crsql_begin_alter` not yet committed.
+  // -1 when no alter is in progress.
+  sqlite3_int64 totalChangesAtBeginAlter;
+
+  // number of rows in crsql_site_id as of `siteCountDbVersion`, for query
+  // planning. -1 until first counted.
+  sqlite3_int64 siteCount;
+  sqlite3_int64 siteCountDbVersion;
 };
 
 crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer);
@@ -51,6 +78,11 @@ void crsql_freeExtData(crsql_ExtData *pExtData);
 int crsql_fetchPragmaSchemaVersion(sqlite3 *db, crsql_ExtData *pExtData,
                                    int which);
 int crsql_fetchPragmaDataVersion(sqlite3 *db, crsql_ExtData *pExtData);
+int crsql_isInWriteTx(sqlite3 *db);
+void crsql_lockSchemaCache();
+void crsql_unlockSchemaCache();
+int crsql_isLocalSiteIdConstraint(sqlite3_index_info *pIdxInfo, int iCons,
+                                  crsql_ExtData *pExtData);
 int crsql_recreate_db_version_stmt(sqlite3 *db, crsql_ExtData *pExtData);
 void crsql_finalize(crsql_ExtData *pExtData);
 
@@ -33,6 +33,10 @@ static void textNewExtData() {
   assert(pExtData->siteId != 0);
   // no db version extraction yet
   assert(pExtData->pDbVersionStmt == 0);
+  // statement used to persist the db version
+  assert(pExtData->pSetDbVersionStmt != 0);
+  // sites are counted on first use
+  assert(pExtData->siteCount == -1);
   // table info allocated to an empty vec
   assert(pExtData->tableInfos != 0);
 
@@ -74,6 +78,7 @@ static void testFinalize() {
   crsql_finalize(pExtData);
   assert(pExtData->pDbVersionStmt == 0);
   assert(pExtData->pPragmaSchemaVersionStmt == 0);
+  assert(pExtData->pSetDbVersionStmt == 0);
 
   // finalizing twice should be a no-op
   crsql_finalize(pExtData);
@@ -213,11 +218,11 @@ static void testRecreateDbVersionStmt() {
   unsigned char *siteIdBuffer = sqlite3_malloc(SITE_ID_LEN * sizeof(char *));
   crsql_ExtData *pExtData = crsql_newExtData(db, siteIdBuffer);
 
+  // the db version is read from crsql_master so the statement doesn't
+  // depend on clock tables existing.
   rc = crsql_recreate_db_version_stmt(db, pExtData);
-
-  // there are no clock tables yet. nothing to create.
-  assert(rc == -1);
-  assert(pExtData->pDbVersionStmt == 0);
+  assert(rc == 0);
+  assert(pExtData->pDbVersionStmt != 0);
 
   sqlite3_exec(db, "CREATE TABLE foo (a primary key not null, b);", 0, 0, 0);
   sqlite3_exec(db, "SELECT crsql_as_crr('foo')", 0, 0, 0);
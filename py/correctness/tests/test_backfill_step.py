@@ -0,0 +1,103 @@
+from crsql_correctness import connect, close
+import pytest
+
+
+def make_db(n=10):
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    for i in range(n):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?)", (i, i * 10, i * 100))
+    c.commit()
+    return c
+
+
+def clocked_rows(c):
+    return c.execute("SELECT count(DISTINCT pk) FROM crsql_changes").fetchone()[0]
+
+
+def test_backfills_in_steps():
+    c = make_db()
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 6)
+    c.commit()
+    assert (clocked_rows(c) == 4)
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 2)
+    c.commit()
+    assert (clocked_rows(c) == 8)
+    # the last chunk is short so the backfill is done
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 0)
+    c.commit()
+    assert (clocked_rows(c) == 10)
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_master WHERE key LIKE 'backfill_%'").fetchone()[0] == 0)
+
+    # every step is its own db_version
+    assert (c.execute(
+        "SELECT db_version, count(*) FROM crsql_changes GROUP BY db_version").fetchall() ==
+        [(1, 8), (2, 8), (3, 4)])
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 0)
+    close(c)
+
+
+def test_writes_between_steps():
+    c = make_db()
+    c.execute("SELECT crsql_backfill_step('foo', 3)")
+    c.commit()
+    c.execute("UPDATE foo SET b = -1 WHERE a = 5")
+    c.execute("DELETE FROM foo WHERE a = 7")
+    c.execute("INSERT INTO foo VALUES (100, 1, 2)")
+    c.commit()
+    while c.execute("SELECT crsql_backfill_step('foo', 3)").fetchone()[0] != 0:
+        c.commit()
+    c.commit()
+
+    assert (c.execute(
+        "SELECT cid, val, col_version FROM crsql_changes WHERE pk = crsql_pack_columns(5) ORDER BY cid").fetchall() ==
+        [('b', -1, 1), ('c', 500, 1)])
+    assert (c.execute(
+        "SELECT cid, cl FROM crsql_changes WHERE pk = crsql_pack_columns(7)").fetchall() == [('-1', 2)])
+    assert (clocked_rows(c) == 11)
+    close(c)
+
+
+def test_resumes_after_rollback():
+    c = make_db()
+    c.execute("SELECT crsql_backfill_step('foo', 4)")
+    c.commit()
+    c.execute("BEGIN")
+    c.execute("SELECT crsql_backfill_step('foo', 4)")
+    c.rollback()
+    assert (clocked_rows(c) == 4)
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 2)
+    c.commit()
+    assert (clocked_rows(c) == 8)
+    close(c)
+
+
+def test_composite_pks():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a NOT NULL, b NOT NULL, c, PRIMARY KEY (a, b))")
+    for i in range(3):
+        for j in range(3):
+            c.execute("INSERT INTO foo VALUES (?, ?, ?)", (str(i), j, i * j))
+    c.commit()
+    while c.execute("SELECT crsql_backfill_step('foo', 2)").fetchone()[0] != 0:
+        c.commit()
+    c.commit()
+    assert (clocked_rows(c) == 9)
+    close(c)
+
+
+def test_already_a_crr():
+    c = make_db()
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    assert (c.execute("SELECT crsql_backfill_step('foo', 4)").fetchone()[0] == 0)
+    assert (clocked_rows(c) == 10)
+    close(c)
+
+
+def test_rejects_bad_chunk_size():
+    c = make_db()
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_backfill_step('foo', 0)")
+    close(c)
@@ -0,0 +1,145 @@
+from crsql_correctness import connect, close, min_db_v
+import pytest
+
+
+def sync_left_to_right(l, r, since):
+    changes = l.execute(
+        "SELECT * FROM crsql_changes WHERE db_version > ?", (since,))
+    for change in changes:
+        r.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    r.commit()
+
+
+def make_db(implicit=False):
+    c = connect(":memory:")
+    if implicit:
+        c.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("CREATE TABLE src (x, y, z)")
+    for n in range(0, 10):
+        c.execute("INSERT INTO src VALUES (?, ?, ?)", (n, n * 2, n * 3))
+    c.commit()
+    return c
+
+
+def test_bulk_insert():
+    c = make_db()
+    inserted = c.execute(
+        "SELECT crsql_bulk_insert('foo', 'SELECT x, y, z FROM src')").fetchone()[0]
+    c.commit()
+
+    assert (inserted == 10)
+    assert (c.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            [(n, n * 2, n * 3) for n in range(0, 10)])
+
+    # the whole batch lands at a single db_version with distinct seqs
+    assert (c.execute(
+        "SELECT DISTINCT db_version FROM crsql_changes").fetchall() == [(1,)])
+    seqs = c.execute("SELECT seq FROM crsql_changes").fetchall()
+    assert (len(seqs) == 20)
+    assert (len(set(seqs)) == 20)
+    close(c)
+
+
+def test_bulk_insert_matches_trigger_inserts():
+    a = make_db()
+    b = make_db()
+
+    a.execute("SELECT crsql_bulk_insert('foo', 'SELECT * FROM src')")
+    a.commit()
+    b.execute("INSERT INTO foo SELECT * FROM src")
+    b.commit()
+
+    assert (a.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            b.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    assert (a.execute("SELECT pk, cid, val, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+            b.execute("SELECT pk, cid, val, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall())
+    close(a)
+    close(b)
+
+
+def test_bulk_insert_pk_only_table():
+    c = make_db()
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.execute("SELECT crsql_bulk_insert('bar', 'SELECT x FROM src')")
+    c.commit()
+
+    assert (c.execute(
+        "SELECT cid, cl, count(*) FROM crsql_changes WHERE [table] = 'bar' GROUP BY cid, cl").fetchall() == [('-1', 1, 10)])
+    close(c)
+
+
+def test_bulk_insert_implicit_clocks():
+    c = make_db(True)
+    c.execute("SELECT crsql_bulk_insert('foo', 'SELECT * FROM src')")
+    c.commit()
+
+    assert (c.execute(
+        "SELECT DISTINCT col_id FROM foo__crsql_clock").fetchall() == [(-1,)])
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE cid != '-1'").fetchone()[0] == 20)
+    close(c)
+
+
+def test_bulk_insert_resurrects_deleted_rows():
+    a = make_db()
+    b = make_db()
+    for c in [a, b]:
+        c.execute("INSERT INTO foo SELECT * FROM src")
+        c.commit()
+        c.execute("DELETE FROM foo")
+        c.commit()
+
+    a.execute("SELECT crsql_bulk_insert('foo', 'SELECT * FROM src')")
+    a.commit()
+    b.execute("INSERT INTO foo SELECT * FROM src")
+    b.commit()
+
+    assert (a.execute("SELECT pk, cid, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+            b.execute("SELECT pk, cid, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall())
+    close(a)
+    close(b)
+
+
+def test_bulk_insert_syncs():
+    a = make_db()
+    b = make_db()
+    a.execute("SELECT crsql_bulk_insert('foo', 'SELECT * FROM src')")
+    a.commit()
+    sync_left_to_right(a, b, min_db_v)
+
+    assert (b.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            a.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    close(a)
+    close(b)
+
+
+def test_bulk_insert_conflict_rolls_back():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (5, 0, 0)")
+    c.commit()
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_bulk_insert('foo', 'SELECT * FROM src')")
+    assert (c.execute("SELECT count(*) FROM foo").fetchone()[0] == 1)
+    assert (c.execute("SELECT count(*) FROM crsql_changes").fetchone()[0] == 3)
+    close(c)
+
+
+def test_bulk_insert_applies_pk_affinity():
+    c = make_db()
+    c.execute("CREATE TABLE bar (a INT PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    c.execute(
+        "SELECT crsql_bulk_insert('bar', 'SELECT ''1'', 2 UNION ALL SELECT ''2'', 3')")
+    c.commit()
+
+    assert (c.execute("SELECT a, typeof(a) FROM bar ORDER BY a").fetchall() ==
+            [(1, 'integer'), (2, 'integer')])
+    assert (c.execute(
+        "SELECT pk, cid, val FROM crsql_changes WHERE [table] = 'bar' ORDER BY pk, cid").fetchall() ==
+        [(b'\x01\x09\x01', 'b', 2), (b'\x01\x09\x02', 'b', 3)])
+    close(c)
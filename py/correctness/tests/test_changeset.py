@@ -0,0 +1,182 @@
+from crsql_correctness import connect, close
+import pytest
+import random
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b, c)")
+    c.execute("CREATE TABLE bar (id INTEGER PRIMARY KEY NOT NULL, x)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def write_some(c):
+    c.execute("INSERT INTO foo VALUES (1, 'one', 1.5)")
+    c.execute("INSERT INTO foo VALUES ('two', x'00ff00', NULL)")
+    c.execute("INSERT INTO bar VALUES (1, 'x')")
+    c.commit()
+    c.execute("UPDATE foo SET b = -9223372036854775808 WHERE a = 1")
+    c.execute("DELETE FROM foo WHERE a = 'two'")
+    c.execute("INSERT INTO bar VALUES (2, 9223372036854775807)")
+    c.commit()
+
+
+# db_version and seq are local to each db
+def changes(c):
+    return c.execute("SELECT [table], pk, cid, val, col_version, site_id, cl FROM crsql_changes ORDER BY 1, 2, 3").fetchall()
+
+
+def apply(c, changeset):
+    ret = c.execute("SELECT crsql_changes_apply(?)", (changeset,)).fetchone()[0]
+    c.commit()
+    return ret
+
+
+def test_round_trip():
+    a = make_db()
+    b = make_db()
+    write_some(a)
+
+    changeset = a.execute("SELECT crsql_changes_encode(0)").fetchone()[0]
+    assert (apply(b, changeset) == len(changes(a)))
+    assert (changes(b) == changes(a))
+    for t in ["foo", "bar"]:
+        assert (b.execute("SELECT * FROM {} ORDER BY 1".format(t)).fetchall() ==
+                a.execute("SELECT * FROM {} ORDER BY 1".format(t)).fetchall())
+
+    # re-applying is a no-op, as with crsql_changes
+    apply(b, changeset)
+    assert (changes(b) == changes(a))
+    close(a)
+    close(b)
+
+
+def test_matches_row_by_row_sync():
+    a = make_db()
+    b = make_db()
+    c = make_db()
+    write_some(a)
+    c.execute("INSERT INTO foo VALUES (1, 'conflict', 0)")
+    c.commit()
+    b.execute("INSERT INTO foo VALUES (1, 'conflict', 0)")
+    b.commit()
+
+    for change in a.execute("SELECT * FROM crsql_changes"):
+        b.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    b.commit()
+    apply(c, a.execute("SELECT crsql_changes_encode(0)").fetchone()[0])
+
+    assert (c.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            b.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    assert (changes(c) == changes(b))
+    close(a)
+    close(b)
+    close(c)
+
+
+def test_since_and_excluded_site():
+    a = make_db()
+    b = make_db()
+    write_some(a)
+    since = a.execute("SELECT crsql_db_version()").fetchone()[0]
+    empty = a.execute("SELECT crsql_changes_encode(?)",
+                      (since,)).fetchone()[0]
+    assert (apply(b, empty) == 0)
+
+    apply(b, a.execute("SELECT crsql_changes_encode(0)").fetchone()[0])
+    b.execute("INSERT INTO bar VALUES (3, 'from b')")
+    b.commit()
+
+    a_site = a.execute("SELECT crsql_site_id()").fetchone()[0]
+    changeset = b.execute(
+        "SELECT crsql_changes_encode(0, ?)", (a_site,)).fetchone()[0]
+    assert (apply(a, changeset) == b.execute(
+        "SELECT count(*) FROM crsql_changes WHERE site_id IS NOT ?", (a_site,)).fetchone()[0])
+    assert (a.execute("SELECT x FROM bar WHERE id = 3").fetchone()[0] == 'from b')
+    assert (changes(a) == changes(b))
+    close(a)
+    close(b)
+
+
+def test_smaller_than_rows():
+    a = make_db()
+    for n in range(0, 200):
+        a.execute("INSERT INTO foo VALUES (?, ?, ?)", (n, "b" * 4, n * 2))
+    a.commit()
+    rows = a.execute("SELECT * FROM crsql_changes").fetchall()
+    raw = sum(len(str(v)) for row in rows for v in row)
+    changeset = a.execute("SELECT crsql_changes_encode(0)").fetchone()[0]
+    assert (len(changeset) * 3 < raw)
+    close(a)
+
+
+def test_rejects_malformed():
+    a = make_db()
+    b = make_db()
+    write_some(a)
+    changeset = a.execute("SELECT crsql_changes_encode(0)").fetchone()[0]
+
+    for bad in [b'', b'\x00\x63\x02' + changeset[3:], changeset[:-1], changeset + b'\x00', b'garbage']:
+        with pytest.raises(Exception):
+            b.execute("SELECT crsql_changes_apply(?)", (bad,))
+    assert (changes(b) == [])
+    close(a)
+    close(b)
+
+
+def test_corrupted_changesets_error_rather_than_crash():
+    a = make_db()
+    b = make_db()
+    write_some(a)
+    changeset = a.execute("SELECT crsql_changes_encode(0)").fetchone()[0]
+
+    def try_apply(bad):
+        try:
+            b.execute("SELECT crsql_changes_apply(?)", (bad,))
+        except Exception:
+            pass
+        b.rollback()
+
+    # Type bytes claiming 31 byte ints and text lengths at every position
+    for i in range(len(changeset)):
+        for type_byte in [0xF9, 0xFB]:
+            try_apply(changeset[:i] + bytes([type_byte]) + changeset[i + 1:])
+
+    rand = random.Random(1234)
+    for _ in range(2000):
+        bad = bytearray(changeset)
+        for _ in range(rand.randint(1, 4)):
+            bad[rand.randrange(len(bad))] = rand.randrange(256)
+        if rand.random() < 0.3:
+            bad = bad[:rand.randrange(len(bad))]
+        try_apply(bytes(bad))
+
+    # the connection is still usable
+    assert (apply(b, changeset) == len(changes(a)))
+    assert (changes(b) == changes(a))
+    close(a)
+    close(b)
+
+
+def test_all_or_nothing():
+    a = make_db()
+    a.execute("CREATE TABLE baz (a PRIMARY KEY NOT NULL, b)")
+    a.execute("SELECT crsql_as_crr('baz')")
+    a.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    a.execute("INSERT INTO baz VALUES (1, 2)")
+    a.commit()
+    changeset = a.execute("SELECT crsql_changes_encode(0)").fetchone()[0]
+
+    # b doesn't have `baz`
+    b = make_db()
+    with pytest.raises(Exception):
+        b.execute("SELECT crsql_changes_apply(?)", (changeset,))
+    b.commit()
+    assert (b.execute("SELECT * FROM foo").fetchall() == [])
+    assert (changes(b) == [])
+    close(a)
+    close(b)
@@ -94,3 +94,155 @@ def test_site_id_filter():
 # value type of the underlying storage rather than a stringified version
 # def test_val_filter():
 #     run_test("val")
+
+
+def test_ordering_across_tables():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b)")
+    c.execute("CREATE TABLE bar (a PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    for n in range(0, 4):
+        c.execute("INSERT INTO foo VALUES (?, ?)", (n, n))
+        c.execute("INSERT INTO bar VALUES (?, ?)", (n, n))
+        if n % 2 == 0:
+            c.commit()
+    c.commit()
+
+    all_changes = c.execute(
+        "SELECT [table], db_version, seq, val FROM crsql_changes").fetchall()
+    assert (all_changes == sorted(all_changes, key=lambda r: (r[1], r[2])))
+
+    desc = c.execute(
+        "SELECT [table], db_version, seq, val FROM crsql_changes ORDER BY db_version DESC, seq DESC").fetchall()
+    assert (desc == list(reversed(all_changes)))
+
+    mixed = c.execute(
+        "SELECT [table], db_version, seq, val FROM crsql_changes ORDER BY db_version ASC, seq DESC").fetchall()
+    assert (mixed == sorted(all_changes, key=lambda r: (r[1], -r[2])))
+
+    by_val = c.execute(
+        "SELECT [table], db_version, seq, val FROM crsql_changes ORDER BY val, [table]").fetchall()
+    assert (by_val == sorted(all_changes, key=lambda r: (r[3], r[0])))
+
+    filtered = c.execute(
+        "SELECT [table], db_version, seq, val FROM crsql_changes WHERE db_version > ? AND seq < ?", (1, 3)).fetchall()
+    assert (filtered == [r for r in all_changes if r[1] > 1 and r[2] < 3])
+    close(c)
+
+
+def test_clock_index_covers_seq():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    assert (c.execute(
+        "SELECT name FROM pragma_index_info('foo__crsql_clock_dbv_idx') ORDER BY seqno").fetchall() == [('db_version',), ('seq',)])
+    close(c)
+
+
+def test_filters_after_analyze():
+    (c, all_changes) = setup_db()
+    c.execute("ANALYZE")
+    c.commit()
+    for x in range(5):
+        changes = c.execute(
+            changes_query + " WHERE db_version = ? ORDER BY db_version, seq ASC", (x,)).fetchall()
+        assert (changes == [r for r in all_changes if r[5] == x])
+        changes = c.execute(
+            changes_query + " WHERE db_version > ? ORDER BY db_version, seq ASC", (x,)).fetchall()
+        assert (changes == [r for r in all_changes if r[5] > x])
+    close(c)
+
+
+def test_join_with_filter_table():
+    (c, all_changes) = setup_db()
+    c.execute("CREATE TABLE wanted (version INTEGER PRIMARY KEY)")
+    c.execute("INSERT INTO wanted VALUES (1), (3)")
+    c.commit()
+    changes = c.execute(
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, seq FROM crsql_changes JOIN wanted ON db_version = version ORDER BY db_version, seq ASC").fetchall()
+    assert (changes == [r for r in all_changes if r[5] in (1, 3)])
+    close(c)
+
+
+def make_two_tables(db_file=":memory:"):
+    c = connect(db_file)
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b)")
+    c.execute("CREATE TABLE bar (a PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def changes_since(c, version):
+    return c.execute(
+        "SELECT [table], pk, cid, val, db_version FROM crsql_changes WHERE db_version > ?", (version,)).fetchall()
+
+
+def test_polling_skips_idle_tables():
+    c = make_two_tables()
+    c.execute("INSERT INTO foo VALUES (1, 2)")
+    c.execute("INSERT INTO bar VALUES (1, 2)")
+    c.commit()
+    assert (changes_since(c, 1) == [])
+    assert (len(changes_since(c, 0)) == 2)
+
+    c.execute("UPDATE foo SET b = 3")
+    c.commit()
+    assert (changes_since(c, 1) == [('foo', b'\x01\t\x01', 'b', 3, 2)])
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE db_version >= 2").fetchone()[0] == 1)
+
+    c.execute("UPDATE bar SET b = 3")
+    c.commit()
+    assert (changes_since(c, 2) == [('bar', b'\x01\t\x01', 'b', 3, 3)])
+    close(c)
+
+
+def test_polling_sees_merged_changes():
+    a = make_two_tables()
+    b = make_two_tables()
+    a.execute("INSERT INTO foo VALUES (1, 2)")
+    a.commit()
+    b.execute("INSERT INTO bar VALUES (1, 2)")
+    b.commit()
+    assert (changes_since(a, 1) == [])
+
+    for row in b.execute("SELECT * FROM crsql_changes").fetchall():
+        a.execute("INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", row)
+    a.commit()
+    assert (changes_since(a, 1) == [('bar', b'\x01\t\x01', 'b', 2, 2)])
+    close(a)
+    close(b)
+
+
+def test_polling_sees_other_connections(tmp_path):
+    db_file = str(tmp_path / "db")
+    a = make_two_tables(db_file)
+    b = connect(db_file)
+    a.execute("INSERT INTO foo VALUES (1, 2)")
+    a.commit()
+    assert (changes_since(a, 1) == [])
+
+    b.execute("INSERT INTO bar VALUES (1, 2)")
+    b.commit()
+    assert (changes_since(a, 1) == [('bar', b'\x01\t\x01', 'b', 2, 2)])
+    close(a)
+    close(b)
+
+
+def test_polling_after_rollback():
+    c = make_two_tables()
+    c.execute("INSERT INTO foo VALUES (1, 2)")
+    c.commit()
+    assert (changes_since(c, 1) == [])
+    c.execute("INSERT INTO bar VALUES (1, 2)")
+    c.rollback()
+    assert (changes_since(c, 1) == [])
+    c.execute("INSERT INTO bar VALUES (1, 3)")
+    c.commit()
+    assert (changes_since(c, 1) == [('bar', b'\x01\t\x01', 'b', 3, 2)])
+    close(c)
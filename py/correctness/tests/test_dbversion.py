@@ -1,4 +1,5 @@
 import pathlib
+import pytest
 from crsql_correctness import connect, close, min_db_v
 
 # c1
@@ -105,3 +106,75 @@ def test_rollback_does_not_move_db_version():
     assert c.execute("SELECT crsql_db_version()").fetchone()[0] == min_db_v + 2
 
     close(c)
+
+
+def test_db_version_is_persisted():
+    c = connect(":memory:")
+    c.execute("create table foo (id primary key not null, a)")
+    c.execute("select crsql_as_crr('foo')")
+    c.execute("insert into foo values (1, 2)")
+    c.commit()
+    c.execute("insert into foo values (2, 2)")
+    c.commit()
+
+    assert c.execute(
+        "SELECT value FROM crsql_master WHERE key = 'db_version'").fetchone()[0] == min_db_v + 2
+    close(c)
+
+
+def test_db_version_seen_by_other_connections():
+    dbfile = "./dbversion_other_conn.db"
+    pathlib.Path(dbfile).unlink(missing_ok=True)
+    a = connect(dbfile)
+    a.execute("create table foo (id primary key not null, a)")
+    a.execute("select crsql_as_crr('foo')")
+    a.commit()
+    b = connect(dbfile)
+
+    a.execute("insert into foo values (1, 2)")
+    a.commit()
+    assert b.execute("SELECT crsql_db_version()").fetchone()[0] == min_db_v + 1
+
+    b.execute("insert into foo values (2, 2)")
+    b.commit()
+    assert a.execute("SELECT crsql_db_version()").fetchone()[0] == min_db_v + 2
+    close(a)
+    close(b)
+
+
+def test_rollback_to_savepoint_keeps_db_version():
+    c = connect(":memory:")
+    c.execute("create table foo (id primary key not null, a)")
+    c.execute("select crsql_as_crr('foo')")
+    c.commit()
+
+    c.execute("SAVEPOINT s")
+    c.execute("insert into foo values (1, 2)")
+    c.execute("ROLLBACK TO s")
+    c.execute("insert into foo values (2, 2)")
+    c.execute("RELEASE s")
+    c.commit()
+
+    assert c.execute(
+        "SELECT value FROM crsql_master WHERE key = 'db_version'").fetchone()[0] == min_db_v + 1
+    close(c)
+
+
+def test_failed_statement_keeps_db_version():
+    c = connect(":memory:")
+    c.execute("create table foo (id primary key not null, a)")
+    c.execute("select crsql_as_crr('foo')")
+    c.commit()
+
+    # the first row and the db_version are written, then the statement is
+    # rolled back but the transaction stays open
+    with pytest.raises(Exception):
+        c.execute("insert into foo values (1, 2), (1, 2)")
+    c.execute("insert into foo values (2, 2)")
+    c.commit()
+
+    assert c.execute(
+        "SELECT value FROM crsql_master WHERE key = 'db_version'").fetchone()[0] == min_db_v + 1
+    assert c.execute(
+        "SELECT DISTINCT db_version FROM crsql_changes").fetchall() == [(min_db_v + 1,)]
+    close(c)
@@ -0,0 +1,100 @@
+from crsql_correctness import connect, close, min_db_v
+import pytest
+
+
+def sync_left_to_right(l, r, since):
+    changes = l.execute(
+        "SELECT * FROM crsql_changes WHERE db_version > ?", (since,))
+    for change in changes:
+        r.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    r.commit()
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    for n in range(0, 20):
+        c.execute("INSERT INTO foo VALUES (?, ?)", (n, n * 2))
+    c.commit()
+    return c
+
+
+def test_delete_where():
+    c = make_db()
+    deleted = c.execute(
+        "SELECT crsql_delete_where('foo', 'a >= 10')").fetchone()[0]
+    c.commit()
+
+    assert (deleted == 10)
+    assert (c.execute("SELECT count(*) FROM foo").fetchone()[0] == 10)
+    assert (c.execute("SELECT max(a) FROM foo").fetchone()[0] == 9)
+
+    # one delete record per row, all at the same db_version with distinct seqs
+    deletes = c.execute(
+        "SELECT db_version, seq, cl FROM crsql_changes WHERE cid = '-1' ORDER BY seq").fetchall()
+    assert (deletes == [(2, n, 2) for n in range(0, 10)])
+
+    # the non-sentinel clocks of deleted rows are gone
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE cid != '-1'").fetchone()[0] == 10)
+    close(c)
+
+
+def test_delete_where_matches_trigger_deletes():
+    a = make_db()
+    b = make_db()
+
+    a.execute("SELECT crsql_delete_where('foo', 'b % 4 = 0')")
+    a.commit()
+    b.execute("DELETE FROM foo WHERE b % 4 = 0")
+    b.commit()
+
+    assert (a.execute("SELECT * FROM foo").fetchall() ==
+            b.execute("SELECT * FROM foo").fetchall())
+    assert (a.execute("SELECT pk, cid, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+            b.execute("SELECT pk, cid, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall())
+    close(a)
+    close(b)
+
+
+def test_delete_where_syncs():
+    a = make_db()
+    b = connect(":memory:")
+    b.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    b.execute("SELECT crsql_as_crr('foo')")
+    b.commit()
+    sync_left_to_right(a, b, min_db_v)
+
+    a.execute("SELECT crsql_delete_where('foo', 'a < 5')")
+    a.commit()
+    sync_left_to_right(a, b, 1)
+
+    assert (b.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            a.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    close(a)
+    close(b)
+
+
+def test_delete_where_rejects_non_crr():
+    c = make_db()
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL)")
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_delete_where('bar', '1')")
+    close(c)
+
+
+def test_delete_where_no_match_keeps_db_version():
+    c = make_db()
+    assert (c.execute(
+        "SELECT crsql_delete_where('foo', 'a > 100')").fetchone()[0] == 0)
+    c.commit()
+    assert (c.execute("SELECT crsql_db_version()").fetchone()[0] == 1)
+
+    c.execute("INSERT INTO foo VALUES (100, 0)")
+    c.commit()
+    assert (c.execute(
+        "SELECT DISTINCT db_version FROM crsql_changes WHERE pk = crsql_pack_columns(100)").fetchall() == [(2,)])
+    close(c)
@@ -0,0 +1,95 @@
+from crsql_correctness import connect, close
+import pytest
+
+
+def make_db():
+    c = connect(":memory:")
+    # INT rather than INTEGER so the table has a lookaside to collect.
+    c.execute("CREATE TABLE foo (a INT PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    for n in range(0, 10):
+        c.execute("INSERT INTO foo VALUES (?, ?)", (n, n))
+    c.commit()
+    # db_version 2
+    c.execute("DELETE FROM foo WHERE a < 5")
+    c.commit()
+    # db_version 3
+    c.execute("DELETE FROM foo WHERE a = 5")
+    c.commit()
+    return c
+
+
+def tombstones(c):
+    return c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE cid = '-1' AND cl % 2 = 0").fetchone()[0]
+
+
+def lookaside_keys(c):
+    return c.execute("SELECT count(*) FROM foo__crsql_pks").fetchone()[0]
+
+
+def test_gc_removes_acked_tombstones():
+    c = make_db()
+    assert (tombstones(c) == 6)
+    assert (lookaside_keys(c) == 10)
+
+    assert (c.execute("SELECT crsql_gc(2)").fetchone()[0] == 5)
+    c.commit()
+    assert (tombstones(c) == 1)
+    assert (lookaside_keys(c) == 5)
+
+    # live rows are untouched
+    assert (c.execute("SELECT count(*) FROM crsql_changes WHERE cid = 'b'").fetchone()[0] == 4)
+    close(c)
+
+
+def test_gc_is_bounded():
+    c = make_db()
+    assert (c.execute("SELECT crsql_gc(3, 4)").fetchone()[0] == 4)
+    c.commit()
+    assert (tombstones(c) == 2)
+    assert (c.execute("SELECT crsql_gc(3, 4)").fetchone()[0] == 2)
+    c.commit()
+    assert (c.execute("SELECT crsql_gc(3, 4)").fetchone()[0] == 0)
+    assert (tombstones(c) == 0)
+    close(c)
+
+
+def test_gc_from_tracked_peers():
+    c = make_db()
+    # no peers, nothing is known to be acknowledged
+    assert (c.execute("SELECT crsql_gc()").fetchone()[0] == 0)
+
+    c.execute(
+        "INSERT INTO crsql_tracked_peers (site_id, version, tag, event) VALUES (x'01', 3, 0, 1)")
+    c.execute(
+        "INSERT INTO crsql_tracked_peers (site_id, version, tag, event) VALUES (x'02', 2, 0, 1)")
+    # what we've received from a peer says nothing about what it has seen of us
+    c.execute(
+        "INSERT INTO crsql_tracked_peers (site_id, version, tag, event) VALUES (x'02', 0, 0, 0)")
+    c.commit()
+
+    assert (c.execute("SELECT crsql_gc()").fetchone()[0] == 5)
+    c.commit()
+    assert (tombstones(c) == 1)
+    close(c)
+
+
+def test_gc_reinsert_after_collection():
+    c = make_db()
+    c.execute("SELECT crsql_gc(3)")
+    c.commit()
+
+    c.execute("INSERT INTO foo VALUES (1, 100)")
+    c.commit()
+    assert (c.execute(
+        "SELECT cid, val, cl FROM crsql_changes WHERE pk = crsql_pack_columns(1)").fetchall() == [('b', 100, 1)])
+    close(c)
+
+
+def test_gc_rejects_too_many_args():
+    c = make_db()
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_gc(1, 2, 3)")
+    close(c)
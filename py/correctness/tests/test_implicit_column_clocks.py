@@ -0,0 +1,188 @@
+from crsql_correctness import connect, close, min_db_v
+import pathlib
+import pytest
+
+
+def sync_left_to_right(l, r, since):
+    changes = l.execute(
+        "SELECT * FROM crsql_changes WHERE db_version > ?", (since,))
+    for change in changes:
+        r.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    r.commit()
+
+
+def make_db(implicit=True):
+    c = connect(":memory:")
+    if implicit:
+        c.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c, d)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def test_config():
+    c = make_db(False)
+    assert (c.execute(
+        "SELECT crsql_config_get('implicit-column-clocks')").fetchone() == (0,))
+    c.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    assert (c.execute(
+        "SELECT crsql_config_get('implicit-column-clocks')").fetchone() == (1,))
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_config_set('implicit-column-clocks', 0)")
+    close(c)
+
+
+def test_insert_records_only_sentinel():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+
+    assert (c.execute(
+        "SELECT col_id, col_version, db_version, seq FROM foo__crsql_clock").fetchall() == [(-1, 1, 1, 0)])
+
+    # the changes set still has one change per column
+    changes = c.execute(
+        "SELECT cid, val, col_version, db_version, seq, cl FROM crsql_changes").fetchall()
+    assert (changes == [('-1', None, 1, 1, 0, 1),
+                        ('b', 2, 1, 1, 1, 1),
+                        ('c', 3, 1, 1, 2, 1),
+                        ('d', 4, 1, 1, 3, 1)])
+    close(c)
+
+
+def test_update_after_implicit_insert():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+    c.execute("UPDATE foo SET c = 33 WHERE a = 1")
+    c.commit()
+
+    changes = c.execute(
+        "SELECT cid, val, col_version, db_version FROM crsql_changes WHERE cid != '-1' ORDER BY cid").fetchall()
+    assert (changes == [('b', 2, 1, 1),
+                        ('c', 33, 2, 2),
+                        ('d', 4, 1, 1)])
+    close(c)
+
+
+def test_sync_matches_explicit_clocks():
+    implicit = make_db()
+    explicit = make_db(False)
+
+    implicit.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    implicit.execute("INSERT INTO foo VALUES (2, 5, 6, 7)")
+    implicit.commit()
+    implicit.execute("UPDATE foo SET d = 8 WHERE a = 2")
+    implicit.commit()
+
+    sync_left_to_right(implicit, explicit, min_db_v)
+
+    assert (explicit.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            implicit.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    assert (explicit.execute(
+        "SELECT cid, col_version FROM crsql_changes WHERE cid != '-1' ORDER BY pk, cid").fetchall() ==
+        implicit.execute(
+        "SELECT cid, col_version FROM crsql_changes WHERE cid != '-1' ORDER BY pk, cid").fetchall())
+    close(implicit)
+    close(explicit)
+
+
+def test_merge_against_implicit_clock():
+    implicit = make_db()
+    other = make_db(False)
+
+    implicit.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    implicit.commit()
+    other.execute("INSERT INTO foo VALUES (1, 2, 9, 1)")
+    other.execute("UPDATE foo SET d = 0 WHERE a = 1")
+    other.commit()
+
+    sync_left_to_right(other, implicit, min_db_v)
+
+    # c ties at version 1 and the larger value wins.
+    # d is at version 2 on `other` and beats the implicit version 1.
+    assert (implicit.execute("SELECT * FROM foo").fetchall() == [(1, 2, 9, 0)])
+    close(implicit)
+    close(other)
+
+
+def test_pk_change_keeps_clocks():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+    c.execute("UPDATE foo SET a = 10 WHERE a = 1")
+    c.commit()
+
+    changes = c.execute(
+        "SELECT cid, val, col_version FROM crsql_changes WHERE pk = crsql_pack_columns(10) AND cid != '-1' ORDER BY cid").fetchall()
+    assert (changes == [('b', 2, 1), ('c', 3, 1), ('d', 4, 1)])
+    close(c)
+
+
+def test_delete_and_reinsert():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+    c.execute("DELETE FROM foo")
+    c.commit()
+
+    assert (c.execute(
+        "SELECT cid, cl FROM crsql_changes").fetchall() == [('-1', 2)])
+
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE cid != '-1' AND cl = 3").fetchone()[0] == 3)
+    close(c)
+
+
+def test_config_survives_reopen():
+    dbfile = "./implicit_column_clocks.db"
+    pathlib.Path(dbfile).unlink(missing_ok=True)
+    c = connect(dbfile)
+    c.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    close(c)
+
+    c = connect(dbfile)
+    assert (c.execute(
+        "SELECT crsql_config_get('implicit-column-clocks')").fetchone() == (1,))
+    c.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    c.commit()
+    assert (c.execute(
+        "SELECT col_id FROM foo__crsql_clock").fetchall() == [(-1,)])
+    assert (c.execute(
+        "SELECT cid, val FROM crsql_changes ORDER BY cid").fetchall() == [('-1', None), ('b', 2), ('c', 3)])
+    close(c)
+
+
+def test_connections_opened_before_enabling_see_it():
+    dbfile = "./implicit_column_clocks_stale.db"
+    pathlib.Path(dbfile).unlink(missing_ok=True)
+    setup = connect(dbfile)
+    setup.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    setup.execute("SELECT crsql_as_crr('foo')")
+    setup.commit()
+    close(setup)
+
+    stale = connect(dbfile)
+    other = connect(dbfile)
+    assert (stale.execute(
+        "SELECT crsql_config_get('implicit-column-clocks')").fetchone() == (0,))
+    other.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    other.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    other.commit()
+
+    assert (stale.execute(
+        "SELECT cid, val FROM crsql_changes ORDER BY cid").fetchall() == [('-1', None), ('b', 2), ('c', 3)])
+    with pytest.raises(Exception):
+        stale.execute("SELECT crsql_config_set('implicit-column-clocks', 0)")
+    stale.rollback()
+    assert (other.execute(
+        "SELECT crsql_config_get('implicit-column-clocks')").fetchone() == (1,))
+    close(stale)
+    close(other)
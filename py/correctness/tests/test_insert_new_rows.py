@@ -12,8 +12,8 @@ def test_c1_c2_c3_c4_c6_c7_crr_values():
     c.commit()
 
     rows = c.execute(
-        "select key, col_name, col_version, db_version, site_id from foo__crsql_clock").fetchall()
-    assert [(1, 'a', 1, init_version + 1, 0)] == rows
+        "select key, col_id, col_version, db_version, site_id from foo__crsql_clock").fetchall()
+    assert [(1, 1, 1, init_version + 1, 0)] == rows
     new_version = c.execute("SELECT crsql_db_version()").fetchone()[0]
 
     assert new_version == init_version + 1
@@ -0,0 +1,185 @@
+# Tables whose primary key is a single INTEGER PRIMARY KEY key their clocks by
+# the primary key itself rather than through a `__crsql_pks` lookaside.
+
+from crsql_correctness import connect, close
+import pytest
+
+
+def sync_left_to_right(l, r, since):
+    changes = l.execute(
+        "SELECT * FROM crsql_changes WHERE db_version > ?", (since,))
+    for change in changes:
+        r.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    r.commit()
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def has_lookaside(c, table):
+    return c.execute(
+        "SELECT count(*) FROM sqlite_master WHERE name = ?", (table + "__crsql_pks",)).fetchone()[0] == 1
+
+
+def clock_keys(c, table):
+    return [r[0] for r in c.execute(
+        "SELECT DISTINCT key FROM {}__crsql_clock ORDER BY key".format(table)).fetchall()]
+
+
+def test_no_lookaside_for_rowid_alias():
+    c = make_db()
+    assert (not has_lookaside(c, "foo"))
+
+    # A DESC pk declared as a table constraint still aliases the rowid
+    c.execute("CREATE TABLE desc_alias (id INTEGER NOT NULL, b, PRIMARY KEY (id DESC))")
+    c.execute("SELECT crsql_as_crr('desc_alias')")
+    assert (not has_lookaside(c, "desc_alias"))
+
+    for (name, schema) in [
+        ("untyped", "(id PRIMARY KEY NOT NULL, b)"),
+        ("int", "(id INT PRIMARY KEY NOT NULL, b)"),
+        ("desc", "(id INTEGER PRIMARY KEY DESC NOT NULL, b)"),
+        ("no_rowid", "(id INTEGER PRIMARY KEY NOT NULL, b) WITHOUT ROWID"),
+        ("composite", "(id INTEGER NOT NULL, b INTEGER NOT NULL, PRIMARY KEY (id, b))"),
+    ]:
+        c.execute("CREATE TABLE {} {}".format(name, schema))
+        c.execute("SELECT crsql_as_crr(?)", (name,))
+        assert (has_lookaside(c, name))
+    close(c)
+
+
+def test_local_writes_key_by_pk():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (10, 1, 2)")
+    c.execute("INSERT INTO foo VALUES (-5, 1, 2)")
+    c.commit()
+    assert (clock_keys(c, "foo") == [-5, 10])
+
+    c.execute("UPDATE foo SET id = 11 WHERE id = 10")
+    c.commit()
+    assert (clock_keys(c, "foo") == [-5, 10, 11])
+    assert (c.execute(
+        "SELECT cid, cl FROM crsql_changes WHERE pk = crsql_pack_columns(10)").fetchall() == [('-1', 2)])
+
+    c.execute("DELETE FROM foo WHERE id = -5")
+    c.commit()
+    assert (c.execute(
+        "SELECT cid, cl FROM crsql_changes WHERE pk = crsql_pack_columns(-5)").fetchall() == [('-1', 2)])
+
+    # reinserting resurrects the same key
+    c.execute("INSERT INTO foo VALUES (-5, 3, 4)")
+    c.commit()
+    assert (c.execute(
+        "SELECT cid, val, cl FROM crsql_changes WHERE pk = crsql_pack_columns(-5) ORDER BY cid").fetchall() ==
+        [('-1', None, 3), ('b', 3, 3), ('c', 4, 3)])
+    close(c)
+
+
+def test_changes_match_lookaside_tables():
+    a = make_db()
+    a.execute("CREATE TABLE bar (id INT PRIMARY KEY NOT NULL, b, c)")
+    a.execute("SELECT crsql_as_crr('bar')")
+    for t in ["foo", "bar"]:
+        a.execute("INSERT INTO {} VALUES (1, 'x', 'y')".format(t))
+        a.execute("INSERT INTO {} VALUES (2, 'x', 'y')".format(t))
+        a.execute("UPDATE {} SET b = 'z' WHERE id = 1".format(t))
+        a.execute("DELETE FROM {} WHERE id = 2".format(t))
+    a.commit()
+
+    def changes(t): return a.execute(
+        "SELECT pk, cid, val, col_version, cl FROM crsql_changes WHERE [table] = ? ORDER BY pk, cid", (t,)).fetchall()
+    assert (changes("foo") == changes("bar"))
+    close(a)
+
+
+def test_merge():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    a.execute("INSERT INTO foo VALUES (7, 8, 9)")
+    a.commit()
+    sync_left_to_right(a, b, 0)
+    assert (b.execute("SELECT * FROM foo ORDER BY id").fetchall() ==
+            [(1, 2, 3), (7, 8, 9)])
+    assert (clock_keys(b, "foo") == [1, 7])
+
+    a.execute("DELETE FROM foo WHERE id = 1")
+    a.execute("UPDATE foo SET b = 80 WHERE id = 7")
+    a.commit()
+    sync_left_to_right(a, b, 1)
+    assert (b.execute("SELECT * FROM foo ORDER BY id").fetchall() ==
+            [(7, 80, 9)])
+    assert (b.execute("SELECT * FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+            a.execute("SELECT * FROM crsql_changes ORDER BY pk, cid").fetchall())
+    close(a)
+    close(b)
+
+
+def test_backfill_existing_rows():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("INSERT INTO foo VALUES (3, 1), (4, NULL)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    assert (not has_lookaside(c, "foo"))
+    assert (clock_keys(c, "foo") == [3, 4])
+    assert (c.execute("SELECT pk, cid, val FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+            [(b'\x01\x09\x03', 'b', 1), (b'\x01\x09\x04', 'b', None)])
+    close(c)
+
+
+def test_gc():
+    c = make_db()
+    for n in range(0, 4):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?)", (n, n, n))
+    c.commit()
+    c.execute("DELETE FROM foo WHERE id < 2")
+    c.commit()
+    assert (c.execute("SELECT crsql_gc(2)").fetchone()[0] == 2)
+    c.commit()
+    assert (clock_keys(c, "foo") == [2, 3])
+    close(c)
+
+
+def test_alter_away_from_rowid_alias():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    c.commit()
+
+    # renaming the pk keeps the rowids, and so the keys
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo RENAME COLUMN id TO ident")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.commit()
+    assert (not has_lookaside(c, "foo"))
+    assert (c.execute(
+        "SELECT cid, val FROM crsql_changes ORDER BY cid").fetchall() == [('b', 2), ('c', 3)])
+
+    # no longer a rowid alias. The crr is rebuilt with a lookaside.
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("CREATE TABLE new_foo (ident TEXT PRIMARY KEY NOT NULL, b, c)")
+    c.execute("INSERT INTO new_foo SELECT * FROM foo")
+    c.execute("DROP TABLE foo")
+    c.execute("ALTER TABLE new_foo RENAME TO foo")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.commit()
+    assert (has_lookaside(c, "foo"))
+    c.execute("INSERT INTO foo VALUES ('k', 5, 6)")
+    c.commit()
+    assert (c.execute(
+        "SELECT cid, val FROM crsql_changes WHERE pk = crsql_pack_columns('k') ORDER BY cid").fetchall() == [('b', 5), ('c', 6)])
+    close(c)
+
+
+def test_merge_rejects_non_integer_pk():
+    c = make_db()
+    with pytest.raises(Exception):
+        c.execute("INSERT INTO crsql_changes VALUES ('foo', crsql_pack_columns('a'), 'b', 1, 1, 1, ?, 1, 0)",
+                  (b'\x01' * 16,))
+    close(c)
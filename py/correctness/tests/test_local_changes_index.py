@@ -0,0 +1,68 @@
+from crsql_correctness import connect, close
+
+
+def local_index_count(c):
+    return c.execute(
+        "SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name LIKE '%__crsql_clock_local_dbv_idx'").fetchone()[0]
+
+
+def test_index_is_opt_in():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    assert (local_index_count(c) == 0)
+    assert (c.execute(
+        "SELECT crsql_config_get('local-changes-index')").fetchone()[0] == 0)
+
+    # existing crrs get the index when enabled
+    c.execute("SELECT crsql_config_set('local-changes-index', 1)")
+    assert (local_index_count(c) == 1)
+
+    # as do new crrs
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    assert (local_index_count(c) == 2)
+
+    c.execute("SELECT crsql_config_set('local-changes-index', 0)")
+    c.commit()
+    assert (local_index_count(c) == 0)
+    close(c)
+
+
+def test_local_only_changes():
+    a = connect(":memory:")
+    b = connect(":memory:")
+    for c in [a, b]:
+        c.execute("SELECT crsql_config_set('local-changes-index', 1)")
+        c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+        c.execute("SELECT crsql_as_crr('foo')")
+        c.commit()
+
+    a.execute("INSERT INTO foo VALUES (1, 1)")
+    a.execute("INSERT INTO foo VALUES (2, 2)")
+    a.commit()
+    b.execute("INSERT INTO foo VALUES (3, 3)")
+    b.commit()
+    changes = b.execute(
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes").fetchall()
+    a.executemany(
+        "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", changes)
+    a.commit()
+    a.execute("UPDATE foo SET b = 10 WHERE a = 1")
+    a.commit()
+
+    local = a.execute(
+        "SELECT pk, val FROM crsql_changes WHERE site_id = crsql_site_id() AND db_version > 0 ORDER BY db_version, seq").fetchall()
+    expected = a.execute(
+        "SELECT pk, val FROM crsql_changes WHERE site_id IS crsql_site_id() AND db_version > 0 ORDER BY db_version, seq").fetchall()
+    assert (local == expected)
+    assert (len(local) == 2)
+
+    # other sites still filter normally
+    remote = a.execute(
+        "SELECT val FROM crsql_changes WHERE site_id = ?", (b.execute("SELECT crsql_site_id()").fetchone()[0],)).fetchall()
+    assert (remote == [(3,)])
+    close(a)
+    close(b)
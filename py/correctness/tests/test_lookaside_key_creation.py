@@ -22,7 +22,8 @@ def sync_left_to_right(l, r, since):
 
 def simple_schema():
     c = connect(":memory:")
-    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT)")
+    # INT rather than INTEGER. An INTEGER PRIMARY KEY keys clocks by the pk, without a lookaside.
+    c.execute("CREATE TABLE foo (a INT PRIMARY KEY NOT NULL, b TEXT)")
     c.execute("SELECT crsql_as_crr('foo')")
     c.execute("CREATE TABLE bar (a NOT NULL, b NOT NULL, PRIMARY KEY(a, b))")
     c.execute("SELECT crsql_as_crr('bar')")
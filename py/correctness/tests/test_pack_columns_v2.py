@@ -0,0 +1,106 @@
+from crsql_correctness import connect, close
+import pytest
+
+VALUES = [
+    "NULL",
+    "-9223372036854775808",
+    "-1.5",
+    "-1",
+    "0",
+    "0.5",
+    "1",
+    "9007199254740992",
+    "9007199254740993",
+    "9223372036854775807",
+    "1e300",
+    "''",
+    "char(0)",
+    "'a'",
+    "'a' || char(0)",
+    "'ab'",
+    "'b'",
+    "x''",
+    "x'00'",
+    "x'0001'",
+    "x'01'",
+    "x'ff'",
+]
+
+
+def make_values(c):
+    c.execute("CREATE TABLE vals (v)")
+    for v in VALUES:
+        c.execute("INSERT INTO vals VALUES ({})".format(v))
+
+
+def test_v2_sorts_like_sqlite():
+    c = connect(":memory:")
+    make_values(c)
+    by_value = c.execute("SELECT v FROM vals ORDER BY v").fetchall()
+    by_package = c.execute(
+        "SELECT v FROM vals ORDER BY crsql_pack_columns_v2(v)").fetchall()
+    assert (by_package == by_value)
+
+    # multi column packages sort by the first column, then the next
+    by_value = c.execute(
+        "SELECT a.v, b.v FROM vals a, vals b ORDER BY a.v, b.v").fetchall()
+    by_package = c.execute(
+        "SELECT a.v, b.v FROM vals a, vals b ORDER BY crsql_pack_columns_v2(a.v, b.v)").fetchall()
+    assert (by_package == by_value)
+    close(c)
+
+
+def test_v2_round_trips():
+    c = connect(":memory:")
+    make_values(c)
+    for (v,) in c.execute("SELECT v FROM vals").fetchall():
+        assert (c.execute(
+            "SELECT cell FROM crsql_unpack_columns WHERE package = crsql_pack_columns_v2(?)", (v,)).fetchall() == [(v,)])
+    assert (c.execute(
+        "SELECT cell FROM crsql_unpack_columns WHERE package = crsql_pack_columns_v2(1, 'a', x'00ff', NULL)").fetchall() ==
+        [(1,), ('a',), (b'\x00\xff',), (None,)])
+    close(c)
+
+
+def test_v1_still_unpacks():
+    c = connect(":memory:")
+    assert (c.execute(
+        "SELECT cell FROM crsql_unpack_columns WHERE package = crsql_pack_columns(1, 'a', x'00ff')").fetchall() ==
+        [(1,), ('a',), (b'\x00\xff',)])
+    close(c)
+
+
+def test_truncated_v2_is_rejected():
+    c = connect(":memory:")
+    with pytest.raises(Exception):
+        c.execute(
+            "SELECT cell FROM crsql_unpack_columns WHERE package = substr(crsql_pack_columns_v2('abc'), 1, 5)").fetchall()
+    close(c)
+
+
+def test_merge_v2_packed_pks():
+    a = connect(":memory:")
+    b = connect(":memory:")
+    for c in [a, b]:
+        c.execute("CREATE TABLE foo (a NOT NULL, b NOT NULL, c, PRIMARY KEY (a, b))")
+        c.execute("SELECT crsql_as_crr('foo')")
+        c.commit()
+    a.execute("INSERT INTO foo VALUES (1, x'000102', 'x')")
+    a.execute("INSERT INTO foo VALUES ('k', 2.5, 'y')")
+    a.commit()
+
+    # repack the v1 pks the changes came out with as v2
+    changes = [
+        (tbl, a.execute(
+            "SELECT crsql_pack_columns_v2(a, b) FROM foo WHERE crsql_pack_columns(a, b) = ?", (pk,)).fetchone()[0],
+         cid, val, col_version, db_version, site_id, cl, seq)
+        for (tbl, pk, cid, val, col_version, db_version, site_id, cl, seq)
+        in a.execute("SELECT * FROM crsql_changes").fetchall()]
+    b.executemany(
+        "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", changes)
+    b.commit()
+
+    assert (b.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            a.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    close(a)
+    close(b)
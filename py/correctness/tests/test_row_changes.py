@@ -0,0 +1,119 @@
+from crsql_correctness import connect, close
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b, c, d)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def unpack(c, package):
+    return [r[0] for r in c.execute(
+        "SELECT cell FROM crsql_unpack_columns WHERE package = ?", (package,)).fetchall()]
+
+
+def row_changes(c, since=0):
+    return [(tbl, unpack(c, pk), unpack(c, cids), unpack(c, vals), unpack(c, col_versions), db_version, cl)
+            for (tbl, pk, cids, vals, col_versions, db_version, site_id, cl, seq) in c.execute(
+                "SELECT * FROM crsql_row_changes WHERE db_version > ?", (since,)).fetchall()]
+
+
+def test_one_row_per_row_and_version():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.execute("INSERT INTO foo VALUES (2, 'b', NULL, x'01')")
+    c.commit()
+    c.execute("UPDATE foo SET b = 20, d = 40 WHERE a = 1")
+    c.commit()
+    c.execute("DELETE FROM foo WHERE a = 2")
+    c.commit()
+
+    assert (row_changes(c) == [
+        # the update of row 1 at version 2 has since superseded b and d
+        ('foo', [1], ['c'], [3], [1], 1, 1),
+        ('foo', [1], ['b', 'd'], [20, 40], [2, 2], 2, 1),
+        ('foo', [2], [], [], [], 3, 2),
+    ])
+    assert (row_changes(c, 1) == row_changes(c)[1:])
+    close(c)
+
+
+def test_matches_crsql_changes():
+    c = make_db()
+    for n in range(0, 20):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?, ?)", (n, n * 2, str(n), None))
+    c.execute("UPDATE foo SET c = 'x' WHERE a % 3 = 0")
+    c.execute("DELETE FROM foo WHERE a % 5 = 0")
+    c.commit()
+    c.execute("UPDATE foo SET b = -1 WHERE a % 2 = 0")
+    c.execute("INSERT INTO foo (a) VALUES (100)")
+    c.commit()
+
+    cells = {}
+    for (tbl, pk, cid, val, col_version, db_version, site_id, cl, seq) in c.execute(
+            "SELECT * FROM crsql_changes"):
+        row = cells.setdefault((tbl, pk, db_version, site_id), [[], [], [], cl])
+        if cid != '-1':
+            row[0].append(cid)
+            row[1].append(val)
+            row[2].append(col_version)
+
+    rows = {}
+    for (tbl, pk, cids, vals, col_versions, db_version, site_id, cl, seq) in c.execute(
+            "SELECT * FROM crsql_row_changes"):
+        key = (tbl, pk, db_version, site_id)
+        assert (key not in rows)
+        rows[key] = [unpack(c, cids), unpack(c, vals),
+                     unpack(c, col_versions), cl]
+
+    assert (rows == cells)
+    close(c)
+
+
+def test_pk_only_and_multiple_tables():
+    c = make_db()
+    c.execute("CREATE TABLE bar (id INTEGER PRIMARY KEY NOT NULL)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.execute("INSERT INTO bar VALUES (1)")
+    c.execute("INSERT INTO foo (a, c) VALUES ('k', 'v')")
+    c.commit()
+
+    assert (sorted(row_changes(c)) == [
+        ('bar', [1], [], [], [], 1, 1),
+        ('foo', ['k'], ['b', 'c', 'd'], [None, 'v', None], [1, 1, 1], 1, 1),
+    ])
+    close(c)
+
+
+def test_merged_changes_keep_their_site():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    a.commit()
+    for change in a.execute("SELECT * FROM crsql_changes"):
+        b.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    b.commit()
+
+    a_site = a.execute("SELECT crsql_site_id()").fetchone()[0]
+    assert (b.execute("SELECT site_id, cids FROM crsql_row_changes").fetchall() ==
+            b.execute("SELECT ?, crsql_pack_columns('b', 'c', 'd')", (a_site,)).fetchall())
+    assert (b.execute(
+        "SELECT count(*) FROM crsql_row_changes WHERE site_id = crsql_site_id()").fetchone()[0] == 0)
+    close(a)
+    close(b)
+
+
+def test_values_outlive_the_row():
+    c = make_db()
+    for n in range(0, 50):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?, ?)", (n, "b" * n, n, n))
+    c.commit()
+
+    # aggregates hold on to values across rows
+    vals = [r[0] for r in c.execute("SELECT vals FROM crsql_row_changes").fetchall()]
+    assert (c.execute("SELECT min(vals) FROM crsql_row_changes").fetchone()[0] == min(vals))
+    assert (unpack(c, c.execute("SELECT max(pk) FROM crsql_row_changes").fetchone()[0]) == [49])
+    close(c)
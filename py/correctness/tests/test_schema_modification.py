@@ -5,7 +5,7 @@ import pytest
 changes_query = "SELECT [table], [pk], [cid], [val] FROM crsql_changes"
 changes_with_versions_query = "SELECT [table], [pk], [cid], [val], [db_version], [col_version] FROM crsql_changes"
 full_changes_query = "SELECT [table], [pk], [cid], [val], [db_version], [col_version], [site_id] FROM crsql_changes"
-clock_query = "SELECT key, col_version, db_version, col_name, site_id FROM todo__crsql_clock"
+clock_query = "SELECT key, col_version, db_version, col_name, site_id FROM todo__crsql_clock JOIN todo__crsql_cols USING (col_id) ORDER BY key, col_name"
 
 
 def test_c1_4_no_primary_keys():
@@ -25,7 +25,7 @@ def test_c1_3_quoted_identifiers():
     c.execute("select crsql_as_crr('baz')")
 
     def check_clock(t): return c.execute(
-        "SELECT col_version, db_version, col_name, site_id FROM {t}__crsql_clock".format(t=t)).fetchall()
+        "SELECT col_version, db_version, col_id, site_id FROM {t}__crsql_clock".format(t=t)).fetchall()
 
     check_clock("foo")
     check_clock("bar")
@@ -38,7 +38,7 @@ def test_c1_c5_compound_primary_key():
     c.execute("select crsql_as_crr('foo')")
 
     c.execute(
-        "SELECT key, col_version, col_name, db_version, site_id FROM foo__crsql_clock").fetchall()
+        "SELECT key, col_version, col_id, db_version, site_id FROM foo__crsql_clock").fetchall()
     c.execute(
         "SELECT __crsql_key, a, b FROM foo__crsql_pks").fetchall()
     # with pytest.raises(Exception) as e_info:
@@ -50,7 +50,7 @@ def test_c1_6_single_primary_key():
     c.execute("create table foo (a not null, b, c, primary key (a))")
     c.execute("select crsql_as_crr('foo')")
     c.execute(
-        "SELECT key, col_version, col_name, db_version, site_id FROM foo__crsql_clock").fetchall()
+        "SELECT key, col_version, col_id, db_version, site_id FROM foo__crsql_clock").fetchall()
     c.execute(
         "SELECT __crsql_key, a FROM foo__crsql_pks").fetchall()
 
@@ -146,6 +146,56 @@ def test_backfill_col_add():
                         ('todo', b'\x01\t\x02', 'due_date', '2018-01-01')])
 
 
+def test_col_ids_stable_across_alter():
+    c = setup_alter_test()
+    col_ids_query = "SELECT col_name, col_id FROM todo__crsql_cols ORDER BY col_id"
+    assert (c.execute(col_ids_query).fetchall() ==
+            [('-1', -1), ('name', 1), ('complete', 2), ('list', 3)])
+
+    c.execute("SELECT crsql_begin_alter('todo');")
+    c.execute("ALTER TABLE todo DROP COLUMN complete;")
+    c.execute("ALTER TABLE todo ADD COLUMN assignee;")
+    c.execute("SELECT crsql_commit_alter('todo');")
+    c.commit()
+
+    # surviving columns keep their ids and new columns never reuse an old one
+    assert (c.execute(col_ids_query).fetchall() ==
+            [('-1', -1), ('name', 1), ('list', 3), ('assignee', 4)])
+    assert (c.execute(
+        "SELECT DISTINCT col_id FROM todo__crsql_clock ORDER BY col_id").fetchall() == [(1,), (3,)])
+
+    # not even the id of the most recently added column
+    c.execute("SELECT crsql_begin_alter('todo');")
+    c.execute("ALTER TABLE todo DROP COLUMN assignee;")
+    c.execute("ALTER TABLE todo ADD COLUMN owner;")
+    c.execute("SELECT crsql_commit_alter('todo');")
+    c.commit()
+    assert (c.execute(col_ids_query).fetchall() ==
+            [('-1', -1), ('name', 1), ('list', 3), ('owner', 5)])
+
+
+def test_columns_added_outside_of_an_alter_get_ids_on_commit_alter():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    c.execute("ALTER TABLE foo ADD COLUMN c")
+    c.execute("ALTER TABLE foo ADD COLUMN d")
+    c.commit()
+
+    # reads never assign ids
+    with pytest.raises(Exception):
+        c.execute("SELECT * FROM crsql_changes").fetchall()
+    c.rollback()
+    assert (c.execute("SELECT count(*) FROM foo__crsql_cols").fetchone()[0] == 2)
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.commit()
+    assert (c.execute("SELECT col_name, col_id FROM foo__crsql_cols ORDER BY col_id").fetchall() ==
+            [('-1', -1), ('b', 1), ('c', 2), ('d', 3)])
+
+
 def test_merging_columns_with_no_metadata():
     # This is the case where we do not create metadata records for certain
     # columns because they were only set to the default value.
@@ -695,3 +745,54 @@ def test_changing_values_in_primary_key_columns():
 
 def test_12step_backfill_retains_siteid():
     None
+
+
+def test_add_drop_and_rename_columns_without_row_writes():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b, c, d)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("INSERT INTO foo VALUES (1, 2, 3, 4)")
+    c.commit()
+    c.execute("UPDATE foo SET b = 20")
+    c.commit()
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN e DEFAULT 0")
+    c.execute("ALTER TABLE foo ADD COLUMN f")
+    c.execute("ALTER TABLE foo DROP COLUMN c")
+    c.execute("ALTER TABLE foo RENAME COLUMN d TO dd")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.commit()
+    c.execute("UPDATE foo SET f = 5")
+    c.commit()
+
+    # untouched columns keep their clocks. Added and renamed columns are
+    # backfilled unless they hold the default.
+    assert (c.execute(
+        "SELECT cid, val, db_version, col_version FROM crsql_changes ORDER BY cid").fetchall() ==
+        [('b', 20, 2, 2), ('dd', 4, 2, 1), ('f', 5, 3, 1)])
+    assert (c.execute(
+        "SELECT col_name FROM foo__crsql_cols ORDER BY col_id").fetchall() ==
+        [('-1',), ('b',), ('dd',), ('e',), ('f',)])
+
+
+def test_nested_alters_with_row_writes():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a PRIMARY KEY NOT NULL, b)")
+    c.execute("CREATE TABLE bar (a PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.execute("INSERT INTO foo VALUES (1, 2)")
+    c.execute("INSERT INTO foo VALUES (3, 4)")
+    c.commit()
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("DELETE FROM foo WHERE a = 1")
+    c.execute("SELECT crsql_begin_alter('bar')")
+    c.execute("ALTER TABLE foo ADD COLUMN c")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.execute("SELECT crsql_commit_alter('bar')")
+    c.commit()
+
+    assert (c.execute(
+        "SELECT [table], pk, cid FROM crsql_changes").fetchall() == [('foo', b'\x01\x09\x03', 'b')])
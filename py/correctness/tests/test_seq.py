@@ -273,3 +273,34 @@ def test_seq_when_resinserting_from_merge():
 
 #     rows = c1.execute("SELECT seq FROM foo__crsql_clock").fetchall()
 #     pprint(rows)
+
+
+def test_backfill_numbers_seqs():
+    c = connect(":memory:")
+    c.execute("create table foo (id primary key not null, a, b)")
+    c.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    c.execute("INSERT INTO foo VALUES (2, 3, 4)")
+    c.execute("select crsql_as_crr('foo')")
+    # seqs continue after the backfilled ones in the same tx
+    c.execute("INSERT INTO foo VALUES (3, 4, 5)")
+    c.commit()
+
+    rows = c.execute(
+        "SELECT [pk], [cid], [seq] FROM crsql_changes ORDER BY seq").fetchall()
+    assert (rows == [(b'\x01\x09\x01', 'a', 0), (b'\x01\x09\x01', 'b', 1),
+                     (b'\x01\x09\x02', 'a', 2), (b'\x01\x09\x02', 'b', 3),
+                     (b'\x01\x09\x03', 'a', 4), (b'\x01\x09\x03', 'b', 5)])
+    close(c)
+
+
+def test_backfill_pk_only_table():
+    c = connect(":memory:")
+    c.execute("create table foo (id primary key not null)")
+    c.execute("INSERT INTO foo VALUES (1), (2)")
+    c.execute("select crsql_as_crr('foo')")
+    c.commit()
+
+    rows = c.execute(
+        "SELECT [pk], [cid], [seq] FROM crsql_changes ORDER BY seq").fetchall()
+    assert (rows == [(b'\x01\x09\x01', '-1', 0), (b'\x01\x09\x02', '-1', 1)])
+    close(c)
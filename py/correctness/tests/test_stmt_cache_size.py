@@ -0,0 +1,69 @@
+from crsql_correctness import connect, close
+import pytest
+
+
+def make_db(tables):
+    c = connect(":memory:")
+    for t in tables:
+        c.execute(
+            "CREATE TABLE {} (a INTEGER PRIMARY KEY NOT NULL, b, c)".format(t))
+        c.execute("SELECT crsql_as_crr('{}')".format(t))
+    c.commit()
+    return c
+
+
+def test_config_defaults_to_unbounded():
+    c = make_db([])
+    assert (c.execute(
+        "SELECT crsql_config_get('stmt-cache-size')").fetchone()[0] == 0)
+    close(c)
+
+
+def test_rejects_negative_size():
+    c = make_db([])
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_config_set('stmt-cache-size', -1)")
+    close(c)
+
+
+def test_writes_and_merges_with_small_cache():
+    tables = ["foo", "bar", "baz"]
+    a = make_db(tables)
+    b = make_db(tables)
+    a.execute("SELECT crsql_config_set('stmt-cache-size', 2)")
+    b.execute("SELECT crsql_config_set('stmt-cache-size', 2)")
+    assert (a.execute(
+        "SELECT crsql_config_get('stmt-cache-size')").fetchone()[0] == 2)
+
+    for n in range(0, 5):
+        for t in tables:
+            a.execute("INSERT INTO {} VALUES (?, ?, ?)".format(t), (n, n, n))
+            a.execute("UPDATE {} SET b = b + 1 WHERE a = ?".format(t), (n,))
+    a.execute("DELETE FROM foo WHERE a = 0")
+    a.commit()
+
+    changes = a.execute(
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes").fetchall()
+    b.executemany(
+        "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", changes)
+    b.commit()
+
+    for t in tables:
+        query = "SELECT * FROM {} ORDER BY a".format(t)
+        assert (a.execute(query).fetchall() == b.execute(query).fetchall())
+    assert (b.execute("SELECT count(*) FROM foo").fetchone()[0] == 4)
+    close(a)
+    close(b)
+
+
+def test_shrinking_cache_evicts():
+    c = make_db(["foo", "bar"])
+    c.execute("SELECT crsql_warmup()")
+    c.execute("SELECT crsql_config_set('stmt-cache-size', 1)")
+    c.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    c.execute("INSERT INTO bar VALUES (1, 2, 3)")
+    c.commit()
+    assert (c.execute(
+        "SELECT [table], cid, val FROM crsql_changes ORDER BY [table], cid").fetchall() ==
+        [('bar', 'b', 2), ('bar', 'c', 3), ('foo', 'b', 2), ('foo', 'c', 3)])
+    close(c)
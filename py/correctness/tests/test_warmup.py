@@ -0,0 +1,56 @@
+from crsql_correctness import connect, close
+import pytest
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def test_warmup_all():
+    c = make_db()
+    assert (c.execute("SELECT crsql_warmup()").fetchone()[0] == 2)
+
+    c.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    c.execute("INSERT INTO bar VALUES (1)")
+    c.commit()
+    assert (c.execute(
+        "SELECT [table], cid FROM crsql_changes ORDER BY [table], cid").fetchall() ==
+        [('bar', '-1'), ('foo', 'b'), ('foo', 'c')])
+    close(c)
+
+
+def test_warmup_some():
+    c = make_db()
+    assert (c.execute("SELECT crsql_warmup('foo')").fetchone()[0] == 1)
+    assert (c.execute("SELECT crsql_warmup('foo', 'bar')").fetchone()[0] == 2)
+    close(c)
+
+
+def test_warmup_rejects_non_crr():
+    c = make_db()
+    c.execute("CREATE TABLE baz (a INTEGER PRIMARY KEY NOT NULL)")
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_warmup('baz')")
+    close(c)
+
+
+def test_warmup_implicit_clocks():
+    c = connect(":memory:")
+    c.execute("SELECT crsql_config_set('implicit-column-clocks', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    assert (c.execute("SELECT crsql_warmup()").fetchone()[0] == 1)
+
+    c.execute("INSERT INTO foo VALUES (1, 2)")
+    c.execute("UPDATE foo SET a = 2")
+    c.commit()
+    assert (c.execute(
+        "SELECT cid, val FROM crsql_changes WHERE pk = crsql_pack_columns(2) AND cid = 'b'").fetchall() == [('b', 2)])
+    close(c)